@@ -0,0 +1,63 @@
+#include "arena.hpp"
+
+#include <algorithm>
+
+namespace obsidian
+{
+
+    size_t Arena::Reset()
+    {
+        size_t const peak = peak_;
+
+        // 次のターンでは1ブロックで足りるように，使用したブロックを合計の大きさの1ブロックにまとめる
+        if (blocks_.size() > 1)
+        {
+            size_t const reserved = GetReservedBytes();
+            blocks_.clear();
+            blocks_.push_back(Block{ std::make_unique<char[]>(reserved), reserved });
+        }
+
+        current_ = 0;
+        offset_ = 0;
+        used_ = 0;
+        peak_ = 0;
+        return peak;
+    }
+
+    size_t Arena::GetReservedBytes() const
+    {
+        size_t reserved = 0;
+        for (auto const &block : blocks_)
+        {
+            reserved += block.size;
+        }
+        return reserved;
+    }
+
+    void *Arena::AllocateSlow(size_t size, size_t alignment)
+    {
+        // 巻き戻した後は，確保済みの後続のブロックに収まればそちらを使う
+        for (size_t next = current_ + 1; next < blocks_.size(); ++next)
+        {
+            if (size + alignment <= blocks_[next].size)
+            {
+                used_ += blocks_[current_].size - offset_; // 使わなかったブロックの残りも使用量に数える
+                current_ = next;
+                offset_ = 0;
+                return Allocate(size, alignment);
+            }
+        }
+
+        // ブロックは既存のブロックの合計以上の大きさにして，ブロック数を対数的に抑える
+        size_t const block_size = std::max({ kMinBlockSize, size + alignment, GetReservedBytes() });
+        if (current_ < blocks_.size())
+        {
+            used_ += blocks_[current_].size - offset_;
+        }
+        blocks_.push_back(Block{ std::make_unique<char[]>(block_size), block_size });
+        current_ = blocks_.size() - 1;
+        offset_ = 0;
+        return Allocate(size, alignment);
+    }
+
+} // namespace obsidian
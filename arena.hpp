@@ -0,0 +1,164 @@
+#ifndef AICY_OBSIDIAN_ARENA_HPP
+#define AICY_OBSIDIAN_ARENA_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace obsidian
+{
+
+    /// \brief 探索の作業領域を確保する，1スレッド専用のバンプアロケータです．
+    ///
+    /// 確保はブロック内のオフセットを進めるだけで，個別の解放は行いません．
+    /// 領域は Rewind() でまとめて巻き戻し，ターンの終わりに Reset() で空にします．
+    /// Reset() では使用したブロックを1つにまとめ直すので，試合を通して確保するブロックは一定の大きさに収まります．
+    ///
+    /// 試合を通して生存するデータ(探索木など)はこの領域に置かないでください．
+    class Arena
+    {
+    public:
+        /// \brief ブロックの大きさの下限[byte]
+        static constexpr size_t kMinBlockSize = 64 * 1024;
+
+        /// \brief Rewind() で戻る位置
+        struct Mark
+        {
+            size_t block;
+            size_t offset;
+            size_t used;
+        };
+
+        Arena() = default;
+        Arena(Arena const &) = delete;
+        Arena &operator=(Arena const &) = delete;
+
+        /// \brief \p size バイトの領域を確保します．
+        ///
+        /// ブロックの先頭は new のアラインメントまでしか揃っていないので，\p alignment はそれ以下でなければなりません．
+        void *Allocate(size_t size, size_t alignment)
+        {
+            assert(alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+            if (current_ < blocks_.size())
+            {
+                size_t const offset = (offset_ + alignment - 1) & ~(alignment - 1);
+                if (offset + size <= blocks_[current_].size)
+                {
+                    used_ += offset + size - offset_;
+                    offset_ = offset + size;
+                    if (used_ > peak_)
+                        peak_ = used_;
+                    return blocks_[current_].data.get() + offset;
+                }
+            }
+            return AllocateSlow(size, alignment);
+        }
+
+        /// \brief 現在の位置を返します．
+        Mark GetMark() const { return Mark{ current_, offset_, used_ }; }
+
+        /// \brief GetMark() の位置まで巻き戻します．それ以降に確保した領域は使用できなくなります．
+        void Rewind(Mark const &mark)
+        {
+            current_ = mark.block;
+            offset_ = mark.offset;
+            used_ = mark.used;
+        }
+
+        /// \brief すべての領域を解放し，前回の Reset() からの使用量の最大値を返します．
+        ///
+        /// 複数のブロックを使用していた場合は，その合計の大きさの1ブロックに置き換えます．
+        size_t Reset();
+
+        /// \brief 使用中のバイト数(アラインメントの詰め物を含む)
+        size_t GetUsedBytes() const { return used_; }
+
+        /// \brief 前回の Reset() からの使用量の最大値
+        size_t GetPeakBytes() const { return peak_; }
+
+        /// \brief 確保しているブロックの合計の大きさ
+        size_t GetReservedBytes() const;
+
+    private:
+        struct Block
+        {
+            std::unique_ptr<char[]> data;
+            size_t size;
+        };
+
+        void *AllocateSlow(size_t size, size_t alignment);
+
+        std::vector<Block> blocks_;
+        size_t current_ = 0; ///< 確保中のブロック
+        size_t offset_ = 0;  ///< 確保中のブロック内の使用済みの位置
+        size_t used_ = 0;
+        size_t peak_ = 0;
+    };
+
+    /// \brief スコープを抜けるときに Arena をスコープに入ったときの位置まで巻き戻します．
+    class ArenaScope
+    {
+    public:
+        explicit ArenaScope(Arena &arena)
+            : arena_(arena)
+            , mark_(arena.GetMark())
+        {
+        }
+
+        ArenaScope(ArenaScope const &) = delete;
+        ArenaScope &operator=(ArenaScope const &) = delete;
+
+        ~ArenaScope() { arena_.Rewind(mark_); }
+
+    private:
+        Arena &arena_;
+        Arena::Mark mark_;
+    };
+
+    /// \brief Arena から確保する標準ライブラリ用のアロケータです．deallocate() は何もしません．
+    template <class T>
+    class ArenaAllocator
+    {
+    public:
+        using value_type = T;
+
+        explicit ArenaAllocator(Arena &arena) noexcept
+            : arena_(&arena)
+        {
+        }
+
+        template <class U>
+        ArenaAllocator(ArenaAllocator<U> const &other) noexcept
+            : arena_(other.GetArena())
+        {
+        }
+
+        T *allocate(size_t n)
+        {
+            static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "Arena blocks are only aligned as new char[]");
+            return static_cast<T *>(arena_->Allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T *, size_t) noexcept {}
+
+        Arena *GetArena() const noexcept { return arena_; }
+
+        template <class U>
+        bool operator==(ArenaAllocator<U> const &other) const noexcept { return arena_ == other.GetArena(); }
+
+        template <class U>
+        bool operator!=(ArenaAllocator<U> const &other) const noexcept { return arena_ != other.GetArena(); }
+
+    private:
+        Arena *arena_;
+    };
+
+    /// \brief Arena から確保する std::vector
+    template <class T>
+    using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_ARENA_HPP
@@ -0,0 +1,809 @@
+#include "batch_simulator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include "shot_velocity.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        using fcv1::kEpsilon;
+        using fcv1::kFrictionC0;
+        using fcv1::kFrictionC1;
+        using fcv1::kFrictionC2;
+        using fcv1::kYawRateCoefficient;
+        using fcv1::kYawRateExponent;
+        using fcv1::kAngularDeceleration;
+        using fcv1::kMinAngularSpeed;
+
+        /// \brief 接触するストーンの中心間の距離
+        constexpr float kContactDistance = 2.f * fcv1::kStoneRadius;
+
+        /// \brief 1フレームのめり込みの補正量の上限
+        constexpr float kMaxCorrection = 0.2f;
+
+#if defined(__AVX2__)
+
+        constexpr size_t kLaneWidth = 8;
+
+        /// \brief log2(x) の近似 (x > 0)．相対誤差は 1e-6 程度．
+        inline __m256 Log2(__m256 x)
+        {
+            __m256i const bits = _mm256_castps_si256(x);
+            __m256 const exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+            __m256 const mantissa = _mm256_castsi256_ps(_mm256_or_si256(
+                _mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)),
+                _mm256_set1_epi32(0x3f800000))); // [1, 2)
+
+            // ln(m) = 2 (t + t^3/3 + t^5/5 + t^7/7 + t^9/9), t = (m - 1) / (m + 1)
+            __m256 const one = _mm256_set1_ps(1.f);
+            __m256 const t = _mm256_div_ps(_mm256_sub_ps(mantissa, one), _mm256_add_ps(mantissa, one));
+            __m256 const t2 = _mm256_mul_ps(t, t);
+            __m256 p = _mm256_set1_ps(1.f / 9.f);
+            p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(1.f / 7.f));
+            p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(1.f / 5.f));
+            p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(1.f / 3.f));
+            p = _mm256_add_ps(_mm256_mul_ps(p, t2), one);
+            __m256 const ln_mantissa = _mm256_mul_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(2.f));
+
+            return _mm256_add_ps(exponent, _mm256_mul_ps(ln_mantissa, _mm256_set1_ps(1.4426950408889634f)));
+        }
+
+        /// \brief 2^x の近似．相対誤差は 1e-6 程度．
+        inline __m256 Exp2(__m256 x)
+        {
+            x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-126.f)), _mm256_set1_ps(126.f));
+            __m256 const integer = _mm256_floor_ps(x);
+            __m256 const f = _mm256_mul_ps(_mm256_sub_ps(x, integer), _mm256_set1_ps(0.6931471805599453f)); // [0, ln2)
+
+            // e^f のテイラー展開 (7次まで)
+            __m256 p = _mm256_set1_ps(1.f / 5040.f);
+            p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.f / 720.f));
+            p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.f / 120.f));
+            p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.f / 24.f));
+            p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.f / 6.f));
+            p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.5f));
+            p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.f));
+            p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.f));
+
+            __m256i const scale = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(integer), _mm256_set1_epi32(127)), 23);
+            return _mm256_mul_ps(p, _mm256_castsi256_ps(scale));
+        }
+
+        /// \brief 8ストーンの速度と角速度を1フレーム分更新する．
+        inline void UpdateVelocityLanes(float *vx_ptr, float *vy_ptr, float *w_ptr, float dt)
+        {
+            __m256 const zero = _mm256_setzero_ps();
+            __m256 const one = _mm256_set1_ps(1.f);
+            __m256 const sign_mask = _mm256_set1_ps(-0.f);
+            __m256 const dt_v = _mm256_set1_ps(dt);
+
+            __m256 vx = _mm256_loadu_ps(vx_ptr);
+            __m256 vy = _mm256_loadu_ps(vy_ptr);
+            __m256 w = _mm256_loadu_ps(w_ptr);
+
+            __m256 const speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)));
+            __m256 const moving = _mm256_cmp_ps(speed, zero, _CMP_GT_OQ);
+            __m256 const safe_speed = _mm256_blendv_ps(one, speed, moving); // 停止したストーンで0除算しないように
+
+            // 進行方向の減速
+            __m256 const acceleration = _mm256_mul_ps(
+                _mm256_add_ps(_mm256_div_ps(_mm256_set1_ps(kFrictionC0), _mm256_add_ps(speed, _mm256_set1_ps(kFrictionC1))), _mm256_set1_ps(kFrictionC2)),
+                _mm256_set1_ps(-fcv1::kGravity));
+            __m256 const new_speed = _mm256_add_ps(speed, _mm256_mul_ps(acceleration, dt_v));
+            __m256 const keep = _mm256_and_ps(moving, _mm256_cmp_ps(new_speed, zero, _CMP_GT_OQ));
+
+            // カールによる進行方向の回転
+            __m256 const abs_w = _mm256_andnot_ps(sign_mask, w);
+            __m256 const spinning = _mm256_cmp_ps(abs_w, _mm256_set1_ps(kEpsilon), _CMP_GT_OQ);
+            __m256 const sign_w = _mm256_or_ps(_mm256_and_ps(w, sign_mask), one);
+            __m256 const speed_pow = Exp2(_mm256_mul_ps(Log2(safe_speed), _mm256_set1_ps(kYawRateExponent)));
+            __m256 const yaw = _mm256_and_ps(spinning, _mm256_mul_ps(_mm256_mul_ps(sign_w, speed_pow), _mm256_set1_ps(kYawRateCoefficient * dt)));
+
+            // 1フレームの回転角は 1e-3 rad 未満なので sin, cos は低次の展開で十分
+            __m256 const yaw2 = _mm256_mul_ps(yaw, yaw);
+            __m256 const cos_yaw = _mm256_sub_ps(one, _mm256_mul_ps(yaw2, _mm256_set1_ps(0.5f)));
+            __m256 const sin_yaw = _mm256_mul_ps(yaw, _mm256_sub_ps(one, _mm256_mul_ps(yaw2, _mm256_set1_ps(1.f / 6.f))));
+
+            __m256 const longitudinal = _mm256_mul_ps(new_speed, cos_yaw);
+            __m256 const transverse = _mm256_mul_ps(new_speed, sin_yaw);
+            __m256 const ex = _mm256_div_ps(vx, safe_speed);
+            __m256 const ey = _mm256_div_ps(vy, safe_speed);
+            __m256 const new_vx = _mm256_sub_ps(_mm256_mul_ps(longitudinal, ex), _mm256_mul_ps(transverse, ey));
+            __m256 const new_vy = _mm256_add_ps(_mm256_mul_ps(longitudinal, ey), _mm256_mul_ps(transverse, ex));
+            vx = _mm256_and_ps(keep, new_vx);
+            vy = _mm256_and_ps(keep, new_vy);
+
+            // 角速度の減衰
+            __m256 const decrease = _mm256_div_ps(_mm256_set1_ps(kAngularDeceleration * dt), _mm256_max_ps(speed, _mm256_set1_ps(kMinAngularSpeed)));
+            __m256 const stop_spin = _mm256_cmp_ps(abs_w, decrease, _CMP_LE_OQ);
+            __m256 const decayed_w = _mm256_andnot_ps(stop_spin, _mm256_sub_ps(w, _mm256_mul_ps(sign_w, decrease)));
+            w = _mm256_blendv_ps(w, decayed_w, spinning);
+
+            _mm256_storeu_ps(vx_ptr, vx);
+            _mm256_storeu_ps(vy_ptr, vy);
+            _mm256_storeu_ps(w_ptr, w);
+        }
+
+#elif defined(__ARM_NEON)
+
+        constexpr size_t kLaneWidth = 4;
+
+        /// \brief log2(x) の近似 (x > 0)．相対誤差は 1e-6 程度．
+        inline float32x4_t Log2(float32x4_t x)
+        {
+            uint32x4_t const bits = vreinterpretq_u32_f32(x);
+            float32x4_t const exponent = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)), vdupq_n_s32(127)));
+            float32x4_t const mantissa = vreinterpretq_f32_u32(vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x007fffff)), vdupq_n_u32(0x3f800000)));
+
+            float32x4_t const one = vdupq_n_f32(1.f);
+            float32x4_t const t = vdivq_f32(vsubq_f32(mantissa, one), vaddq_f32(mantissa, one));
+            float32x4_t const t2 = vmulq_f32(t, t);
+            float32x4_t p = vdupq_n_f32(1.f / 9.f);
+            p = vmlaq_f32(vdupq_n_f32(1.f / 7.f), p, t2);
+            p = vmlaq_f32(vdupq_n_f32(1.f / 5.f), p, t2);
+            p = vmlaq_f32(vdupq_n_f32(1.f / 3.f), p, t2);
+            p = vmlaq_f32(one, p, t2);
+            float32x4_t const ln_mantissa = vmulq_f32(vmulq_f32(p, t), vdupq_n_f32(2.f));
+
+            return vmlaq_f32(exponent, ln_mantissa, vdupq_n_f32(1.4426950408889634f));
+        }
+
+        /// \brief 2^x の近似．相対誤差は 1e-6 程度．
+        inline float32x4_t Exp2(float32x4_t x)
+        {
+            x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(-126.f)), vdupq_n_f32(126.f));
+            float32x4_t const integer = vrndmq_f32(x);
+            float32x4_t const f = vmulq_f32(vsubq_f32(x, integer), vdupq_n_f32(0.6931471805599453f));
+
+            float32x4_t p = vdupq_n_f32(1.f / 5040.f);
+            p = vmlaq_f32(vdupq_n_f32(1.f / 720.f), p, f);
+            p = vmlaq_f32(vdupq_n_f32(1.f / 120.f), p, f);
+            p = vmlaq_f32(vdupq_n_f32(1.f / 24.f), p, f);
+            p = vmlaq_f32(vdupq_n_f32(1.f / 6.f), p, f);
+            p = vmlaq_f32(vdupq_n_f32(0.5f), p, f);
+            p = vmlaq_f32(vdupq_n_f32(1.f), p, f);
+            p = vmlaq_f32(vdupq_n_f32(1.f), p, f);
+
+            int32x4_t const scale = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(integer), vdupq_n_s32(127)), 23);
+            return vmulq_f32(p, vreinterpretq_f32_s32(scale));
+        }
+
+        /// \brief 4ストーンの速度と角速度を1フレーム分更新する．
+        inline void UpdateVelocityLanes(float *vx_ptr, float *vy_ptr, float *w_ptr, float dt)
+        {
+            float32x4_t const zero = vdupq_n_f32(0.f);
+            float32x4_t const one = vdupq_n_f32(1.f);
+            uint32x4_t const sign_mask = vdupq_n_u32(0x80000000);
+
+            float32x4_t vx = vld1q_f32(vx_ptr);
+            float32x4_t vy = vld1q_f32(vy_ptr);
+            float32x4_t w = vld1q_f32(w_ptr);
+
+            float32x4_t const speed = vsqrtq_f32(vmlaq_f32(vmulq_f32(vx, vx), vy, vy));
+            uint32x4_t const moving = vcgtq_f32(speed, zero);
+            float32x4_t const safe_speed = vbslq_f32(moving, speed, one);
+
+            float32x4_t const acceleration = vmulq_f32(
+                vaddq_f32(vdivq_f32(vdupq_n_f32(kFrictionC0), vaddq_f32(speed, vdupq_n_f32(kFrictionC1))), vdupq_n_f32(kFrictionC2)),
+                vdupq_n_f32(-fcv1::kGravity));
+            float32x4_t const new_speed = vmlaq_f32(speed, acceleration, vdupq_n_f32(dt));
+            uint32x4_t const keep = vandq_u32(moving, vcgtq_f32(new_speed, zero));
+
+            float32x4_t const abs_w = vabsq_f32(w);
+            uint32x4_t const spinning = vcgtq_f32(abs_w, vdupq_n_f32(kEpsilon));
+            float32x4_t const sign_w = vreinterpretq_f32_u32(vorrq_u32(vandq_u32(vreinterpretq_u32_f32(w), sign_mask), vreinterpretq_u32_f32(one)));
+            float32x4_t const speed_pow = Exp2(vmulq_f32(Log2(safe_speed), vdupq_n_f32(kYawRateExponent)));
+            float32x4_t const yaw = vreinterpretq_f32_u32(vandq_u32(spinning, vreinterpretq_u32_f32(
+                vmulq_f32(vmulq_f32(sign_w, speed_pow), vdupq_n_f32(kYawRateCoefficient * dt)))));
+
+            float32x4_t const yaw2 = vmulq_f32(yaw, yaw);
+            float32x4_t const cos_yaw = vmlsq_f32(one, yaw2, vdupq_n_f32(0.5f));
+            float32x4_t const sin_yaw = vmulq_f32(yaw, vmlsq_f32(one, yaw2, vdupq_n_f32(1.f / 6.f)));
+
+            float32x4_t const longitudinal = vmulq_f32(new_speed, cos_yaw);
+            float32x4_t const transverse = vmulq_f32(new_speed, sin_yaw);
+            float32x4_t const ex = vdivq_f32(vx, safe_speed);
+            float32x4_t const ey = vdivq_f32(vy, safe_speed);
+            float32x4_t const new_vx = vmlsq_f32(vmulq_f32(longitudinal, ex), transverse, ey);
+            float32x4_t const new_vy = vmlaq_f32(vmulq_f32(longitudinal, ey), transverse, ex);
+            vx = vreinterpretq_f32_u32(vandq_u32(keep, vreinterpretq_u32_f32(new_vx)));
+            vy = vreinterpretq_f32_u32(vandq_u32(keep, vreinterpretq_u32_f32(new_vy)));
+
+            float32x4_t const decrease = vdivq_f32(vdupq_n_f32(kAngularDeceleration * dt), vmaxq_f32(speed, vdupq_n_f32(kMinAngularSpeed)));
+            uint32x4_t const stop_spin = vcleq_f32(abs_w, decrease);
+            float32x4_t const decayed_w = vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(vmlsq_f32(w, sign_w, decrease)), stop_spin));
+            w = vbslq_f32(spinning, decayed_w, w);
+
+            vst1q_f32(vx_ptr, vx);
+            vst1q_f32(vy_ptr, vy);
+            vst1q_f32(w_ptr, w);
+        }
+
+#else
+
+        constexpr size_t kLaneWidth = 1;
+
+        /// \brief 1ストーンの速度と角速度を1フレーム分更新する．
+        inline void UpdateVelocity(float &vx, float &vy, float &angular_velocity, float dt)
+        {
+            float const speed = std::sqrt(vx * vx + vy * vy);
+            if (speed > 0.f)
+            {
+                float const new_speed = speed + fcv1::LongitudinalAcceleration(speed) * dt;
+                if (new_speed <= 0.f)
+                {
+                    vx = 0.f;
+                    vy = 0.f;
+                }
+                else
+                {
+                    float const yaw = fcv1::YawRate(speed, angular_velocity) * dt;
+                    float const longitudinal = new_speed * std::cos(yaw);
+                    float const transverse = new_speed * std::sin(yaw);
+                    float const ex = vx / speed;
+                    float const ey = vy / speed;
+                    vx = longitudinal * ex - transverse * ey;
+                    vy = longitudinal * ey + transverse * ex;
+                }
+            }
+
+            if (std::abs(angular_velocity) > kEpsilon)
+            {
+                float const decrease = -fcv1::AngularAcceleration(speed) * dt;
+                if (std::abs(angular_velocity) <= decrease)
+                {
+                    angular_velocity = 0.f;
+                }
+                else
+                {
+                    angular_velocity -= angular_velocity > 0.f ? decrease : -decrease;
+                }
+            }
+        }
+
+        inline void UpdateVelocityLanes(float *vx_ptr, float *vy_ptr, float *w_ptr, float dt)
+        {
+            UpdateVelocity(*vx_ptr, *vy_ptr, *w_ptr, dt);
+        }
+
+#endif
+
+        static_assert(BatchSimulatorFCV1::kStoneCount % kLaneWidth == 0, "lanes must not straddle boards");
+
+    } // unnamed namespace
+
+    BatchSimulatorFCV1::BatchSimulatorFCV1(size_t board_count, fcv1::CollisionParameters const &collision)
+        : board_count_(board_count)
+        , collision_(collision)
+        , x_(board_count * kStoneCount, 0.f)
+        , y_(board_count * kStoneCount, 0.f)
+        , vx_(board_count * kStoneCount, 0.f)
+        , vy_(board_count * kStoneCount, 0.f)
+        , angle_(board_count * kStoneCount, 0.f)
+        , angular_velocity_(board_count * kStoneCount, 0.f)
+        , exists_(board_count * kStoneCount, 0)
+        , board_moving_(board_count, 0)
+        , moved_(board_count, 0)
+        , order_(board_count * kStoneCount)
+    {
+        static_assert(kStoneCount <= 16, "moved_ holds one bit per stone");
+        for (size_t lane = 0; lane < order_.size(); ++lane)
+        {
+            order_[lane] = static_cast<std::uint8_t>(lane % kStoneCount);
+        }
+    }
+
+    void BatchSimulatorFCV1::SetStones(size_t board, dc::ISimulator::AllStones const &stones)
+    {
+        assert(board < board_count_);
+        bool moving = false;
+        std::uint16_t placed = 0;
+        for (size_t i = 0; i < kStoneCount; ++i)
+        {
+            size_t const lane = board * kStoneCount + i;
+            auto const &stone = stones[i];
+            exists_[lane] = stone.has_value();
+            if (stone)
+            {
+                placed |= static_cast<std::uint16_t>(1u << i);
+                x_[lane] = stone->position.x;
+                y_[lane] = stone->position.y;
+                vx_[lane] = stone->linear_velocity.x;
+                vy_[lane] = stone->linear_velocity.y;
+                angle_[lane] = stone->angle;
+                angular_velocity_[lane] = stone->angular_velocity;
+                moving = moving || vx_[lane] != 0.f || vy_[lane] != 0.f;
+            }
+            else
+            {
+                x_[lane] = y_[lane] = vx_[lane] = vy_[lane] = angle_[lane] = angular_velocity_[lane] = 0.f;
+            }
+        }
+        board_moving_[board] = moving;
+        moved_[board] = placed;
+    }
+
+    void BatchSimulatorFCV1::SetStones(size_t board, BoardSnapshot const &snapshot)
+    {
+        assert(board < board_count_);
+        for (size_t i = 0; i < kStoneCount; ++i)
+        {
+            size_t const lane = board * kStoneCount + i;
+            bool const exists = snapshot.HasStone(i);
+            exists_[lane] = exists;
+            x_[lane] = exists ? snapshot.stones[i].x : 0.f;
+            y_[lane] = exists ? snapshot.stones[i].y : 0.f;
+            angle_[lane] = exists ? snapshot.stones[i].angle : 0.f;
+            vx_[lane] = vy_[lane] = angular_velocity_[lane] = 0.f;
+        }
+        board_moving_[board] = false;
+        moved_[board] = snapshot.exists;
+    }
+
+    void BatchSimulatorFCV1::LaunchStone(size_t board, size_t stone, dc::Vector2 const &velocity, float angular_velocity)
+    {
+        assert(board < board_count_ && stone < kStoneCount);
+        size_t const lane = board * kStoneCount + stone;
+        exists_[lane] = true;
+        x_[lane] = y_[lane] = angle_[lane] = 0.f;
+        vx_[lane] = velocity.x;
+        vy_[lane] = velocity.y;
+        angular_velocity_[lane] = angular_velocity;
+        board_moving_[board] = board_moving_[board] || velocity.x != 0.f || velocity.y != 0.f;
+        moved_[board] |= static_cast<std::uint16_t>(1u << stone);
+    }
+
+    void BatchSimulatorFCV1::GetStones(size_t board, dc::ISimulator::AllStones &stones) const
+    {
+        assert(board < board_count_);
+        for (size_t i = 0; i < kStoneCount; ++i)
+        {
+            size_t const lane = board * kStoneCount + i;
+            if (exists_[lane])
+            {
+                stones[i].emplace(
+                    dc::Vector2(x_[lane], y_[lane]),
+                    angle_[lane],
+                    dc::Vector2(vx_[lane], vy_[lane]),
+                    angular_velocity_[lane]);
+            }
+            else
+            {
+                stones[i].reset();
+            }
+        }
+    }
+
+    void BatchSimulatorFCV1::GetStones(size_t board, dc::GameState::Stones &stones, float min_y) const
+    {
+        assert(board < board_count_);
+        for (size_t team = 0; team < 2; ++team)
+        {
+            for (size_t i = 0; i < stones[team].size(); ++i)
+            {
+                size_t const lane = board * kStoneCount + team * stones[team].size() + i;
+                if (exists_[lane] && y_[lane] >= min_y)
+                {
+                    stones[team][i].emplace(dc::Vector2(x_[lane], y_[lane]), angle_[lane]);
+                }
+                else
+                {
+                    stones[team][i].reset();
+                }
+            }
+        }
+    }
+
+    bool BatchSimulatorFCV1::RemoveStonesOutside(size_t board, float side_limit, float back_limit)
+    {
+        assert(board < board_count_);
+        size_t const base = board * kStoneCount;
+
+        // 静止しているストーンは前回の判定から位置が変わらないので調べない
+        bool removed = false;
+        for (size_t i = 0; i < kStoneCount; ++i)
+        {
+            size_t const lane = base + i;
+            if ((moved_[board] >> i & 1) != 0 && exists_[lane] && (std::abs(x_[lane]) > side_limit || y_[lane] > back_limit))
+            {
+                exists_[lane] = 0;
+                x_[lane] = y_[lane] = vx_[lane] = vy_[lane] = angle_[lane] = angular_velocity_[lane] = 0.f;
+                removed = true;
+            }
+        }
+        moved_[board] = 0;
+
+        if (removed)
+        {
+            bool moving = false;
+            for (size_t lane = base; lane < base + kStoneCount; ++lane)
+            {
+                moving = moving || vx_[lane] != 0.f || vy_[lane] != 0.f;
+            }
+            board_moving_[board] = moving;
+        }
+        return removed;
+    }
+
+    bool BatchSimulatorFCV1::IsSettled(size_t board, float side_limit, float back_limit, float hog_limit) const
+    {
+        assert(board < board_count_);
+        if (!board_moving_[board])
+            return true;
+
+        size_t const base = board * kStoneCount;
+        std::array<float, kStoneCount> travels{};
+        for (size_t i = 0; i < kStoneCount; ++i)
+        {
+            size_t const lane = base + i;
+            if (exists_[lane])
+            {
+                travels[i] = fcv1::MaxTravelDistance(std::hypot(vx_[lane], vy_[lane]));
+            }
+        }
+
+        for (size_t i = 0; i < kStoneCount; ++i)
+        {
+            size_t const lane = base + i;
+            if (!exists_[lane] || travels[i] <= 0.f)
+                continue;
+
+            if (side_limit - std::abs(x_[lane]) <= travels[i]
+                || back_limit - y_[lane] <= travels[i]
+                || std::abs(y_[lane] - hog_limit) <= travels[i])
+            {
+                return false;
+            }
+
+            for (size_t j = 0; j < kStoneCount; ++j)
+            {
+                size_t const other = base + j;
+                if (j == i || !exists_[other])
+                    continue;
+                float const gap = std::hypot(x_[other] - x_[lane], y_[other] - y_[lane]) - kContactDistance;
+                if (gap <= travels[i] + travels[j])
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    void BatchSimulatorFCV1::Step()
+    {
+        float const dt = fcv1::kSecondsPerFrame;
+        size_t const lane_count = board_count_ * kStoneCount;
+
+        // 摩擦とカール (全ストーンをSIMDでまとめて処理する．存在しないストーンは速度0なので変化しない)
+        for (size_t lane = 0; lane < lane_count; lane += kLaneWidth)
+        {
+            UpdateVelocityLanes(&vx_[lane], &vy_[lane], &angular_velocity_[lane], dt);
+        }
+
+        // 衝突による速度変化
+        for (size_t board = 0; board < board_count_; ++board)
+        {
+            if (board_moving_[board])
+            {
+                ResolveCollisions(board);
+            }
+        }
+
+        // 位置の更新
+        for (size_t lane = 0; lane < lane_count; ++lane)
+        {
+            x_[lane] += vx_[lane] * dt;
+            y_[lane] += vy_[lane] * dt;
+            angle_[lane] += angular_velocity_[lane] * dt;
+        }
+
+        // めり込みの解消
+        for (size_t board = 0; board < board_count_; ++board)
+        {
+            if (board_moving_[board])
+            {
+                CorrectPositions(board);
+            }
+        }
+
+        UpdateMovingFlags();
+    }
+
+    size_t BatchSimulatorFCV1::StepUntilStopped(size_t max_steps)
+    {
+        size_t steps = 0;
+        while (steps < max_steps && !AreAllBoardsStopped())
+        {
+            Step();
+            ++steps;
+        }
+        return steps;
+    }
+
+    bool BatchSimulatorFCV1::AreAllBoardsStopped() const
+    {
+        return std::none_of(board_moving_.begin(), board_moving_.end(), [](std::uint8_t moving) { return moving != 0; });
+    }
+
+    /// \brief 盤面 \p board で接触しうるストーンの組 (i, j) (i < j) について function(i, j) を呼ぶ．i, j はレーンのインデックス．
+    ///
+    /// 組の少なくとも一方は動いているストーンで，y座標の差がストーンの直径未満のものに限る．
+    /// function が true を返した場合，静止していた側のストーンも動いているものとして以降の組を探す．
+    template <class Function>
+    void BatchSimulatorFCV1::ForEachContactCandidate(size_t board, Function &&function)
+    {
+        constexpr std::uint8_t kInactive = kStoneCount;
+        size_t const base = board * kStoneCount;
+        std::uint8_t *const order = &order_[base];
+
+        // 前のフレームの並びから挿入ソートで y の昇順に戻す
+        for (size_t k = 1; k < kStoneCount; ++k)
+        {
+            std::uint8_t const stone = order[k];
+            float const y = y_[base + stone];
+            size_t m = k;
+            for (; m > 0 && y_[base + order[m - 1]] > y; --m)
+            {
+                order[m] = order[m - 1];
+            }
+            order[m] = stone;
+        }
+
+        std::array<std::uint8_t, kStoneCount> rank;
+        for (size_t k = 0; k < kStoneCount; ++k)
+        {
+            rank[order[k]] = static_cast<std::uint8_t>(k);
+        }
+
+        // 動いているストーンを調べる順に並べる．active_index はその順番(対象外なら kInactive)
+        std::array<std::uint8_t, kStoneCount> active;
+        std::array<std::uint8_t, kStoneCount> active_index;
+        active_index.fill(kInactive);
+        size_t active_count = 0;
+        for (size_t i = 0; i < kStoneCount; ++i)
+        {
+            size_t const lane = base + i;
+            if (exists_[lane] && (vx_[lane] != 0.f || vy_[lane] != 0.f))
+            {
+                active_index[i] = static_cast<std::uint8_t>(active_count);
+                active[active_count++] = static_cast<std::uint8_t>(i);
+            }
+        }
+
+        for (size_t a = 0; a < active_count; ++a)
+        {
+            size_t const i = active[a];
+            float const y = y_[base + i];
+            auto visit = [&](size_t j)
+            {
+                // 先に調べた動いているストーンとの組は処理済み
+                if (!exists_[base + j] || active_index[j] < a)
+                    return;
+                if (function(base + std::min(i, j), base + std::max(i, j)) && active_index[j] == kInactive)
+                {
+                    active_index[j] = static_cast<std::uint8_t>(active_count);
+                    active[active_count++] = static_cast<std::uint8_t>(j);
+                }
+            };
+            for (size_t k = rank[i]; k > 0 && y - y_[base + order[k - 1]] < kContactDistance; --k)
+            {
+                visit(order[k - 1]);
+            }
+            for (size_t k = rank[i] + 1; k < kStoneCount && y_[base + order[k]] - y < kContactDistance; ++k)
+            {
+                visit(order[k]);
+            }
+        }
+    }
+
+    void BatchSimulatorFCV1::ResolveCollisions(size_t board)
+    {
+        ForEachContactCandidate(board, [this](size_t i, size_t j)
+        {
+            float const dx = x_[j] - x_[i];
+            float const dy = y_[j] - y_[i];
+            float const distance2 = dx * dx + dy * dy;
+            if (distance2 >= kContactDistance * kContactDistance || distance2 <= 0.f)
+                return false;
+
+            float const distance = std::sqrt(distance2);
+            float const nx = dx / distance;
+            float const ny = dy / distance;
+            float const relative_normal = (vx_[j] - vx_[i]) * nx + (vy_[j] - vy_[i]) * ny;
+            if (relative_normal >= 0.f)
+                return false; // 離れつつある
+
+            // 法線方向の撃力 (質量が等しいので単位質量あたりで扱う)
+            float const restitution = -relative_normal > collision_.restitution_threshold ? collision_.restitution : 0.f;
+            float const normal_impulse = -(1.f + restitution) * relative_normal * 0.5f;
+
+            // 接線方向の摩擦による撃力．有効質量は 1/m * 2 + r^2/I * 2 = 6/m
+            float const tx = -ny;
+            float const ty = nx;
+            float const relative_tangent = (vx_[j] - vx_[i]) * tx + (vy_[j] - vy_[i]) * ty
+                - fcv1::kStoneRadius * (angular_velocity_[i] + angular_velocity_[j]);
+            float const max_friction = collision_.friction * normal_impulse;
+            float const tangent_impulse = std::clamp(-relative_tangent / 6.f, -max_friction, max_friction);
+
+            vx_[i] -= normal_impulse * nx + tangent_impulse * tx;
+            vy_[i] -= normal_impulse * ny + tangent_impulse * ty;
+            vx_[j] += normal_impulse * nx + tangent_impulse * tx;
+            vy_[j] += normal_impulse * ny + tangent_impulse * ty;
+            angular_velocity_[i] -= 2.f * tangent_impulse / fcv1::kStoneRadius;
+            angular_velocity_[j] -= 2.f * tangent_impulse / fcv1::kStoneRadius;
+            return true;
+        });
+    }
+
+    void BatchSimulatorFCV1::CorrectPositions(size_t board)
+    {
+        ForEachContactCandidate(board, [this, board](size_t i, size_t j)
+        {
+            float const dx = x_[j] - x_[i];
+            float const dy = y_[j] - y_[i];
+            float const distance2 = dx * dx + dy * dy;
+            if (distance2 >= kContactDistance * kContactDistance || distance2 <= 0.f)
+                return false;
+
+            float const distance = std::sqrt(distance2);
+            float const penetration = kContactDistance - distance - collision_.linear_slop;
+            if (penetration <= 0.f)
+                return false;
+
+            float const correction = std::min(collision_.position_correction * penetration, kMaxCorrection) * 0.5f;
+            float const nx = dx / distance;
+            float const ny = dy / distance;
+            x_[i] -= correction * nx;
+            y_[i] -= correction * ny;
+            x_[j] += correction * nx;
+            y_[j] += correction * ny;
+            moved_[board] |= static_cast<std::uint16_t>(1u << (i % kStoneCount) | 1u << (j % kStoneCount));
+            return false; // 速度は変わらないので静止したストーンは起こさない
+        });
+    }
+
+    void BatchSimulatorFCV1::UpdateMovingFlags()
+    {
+        for (size_t board = 0; board < board_count_; ++board)
+        {
+            if (!board_moving_[board])
+                continue;
+            // 位置の更新で動いたストーンは，更新後も速度を持つストーンと一致する(めり込みの補正は CorrectPositions() で記録する)
+            bool moving = false;
+            std::uint16_t moved = 0;
+            for (size_t i = 0; i < kStoneCount; ++i)
+            {
+                size_t const lane = board * kStoneCount + i;
+                if (vx_[lane] != 0.f || vy_[lane] != 0.f)
+                {
+                    moving = true;
+                    moved |= static_cast<std::uint16_t>(1u << i);
+                }
+            }
+            board_moving_[board] = moving;
+            moved_[board] |= moved;
+        }
+    }
+
+    BatchSimulatorValidation ValidateBatchSimulatorFCV1(
+        dc::ISimulatorFactory const &reference_factory,
+        std::vector<dc::ISimulator::AllStones> const &initial_stones,
+        float tolerance)
+    {
+        constexpr size_t kMaxSteps = 200000;
+
+        auto const layouts = initial_stones.empty() ? CreateValidationLayouts() : initial_stones;
+
+        BatchSimulatorFCV1 batch(layouts.size());
+
+        // フレーム時間が異なると停止位置がたまたま近くても途中の挙動は一致しない
+        if (auto const fcv1_factory = dynamic_cast<dc::simulators::SimulatorFCV1Factory const *>(&reference_factory);
+            fcv1_factory != nullptr && fcv1_factory->seconds_per_frame != batch.GetSecondsPerFrame())
+        {
+            BatchSimulatorValidation validation;
+            validation.max_position_error = std::numeric_limits<float>::infinity();
+            return validation;
+        }
+
+        for (size_t board = 0; board < layouts.size(); ++board)
+        {
+            batch.SetStones(board, layouts[board]);
+        }
+        batch.StepUntilStopped(kMaxSteps);
+
+        auto reference = reference_factory.CreateSimulator();
+
+        BatchSimulatorValidation validation;
+        validation.board_count = layouts.size();
+        for (size_t board = 0; board < layouts.size(); ++board)
+        {
+            reference->SetStones(layouts[board]);
+            for (size_t step = 0; step < kMaxSteps && !reference->AreAllStonesStopped(); ++step)
+            {
+                reference->Step();
+            }
+
+            dc::ISimulator::AllStones batch_stones;
+            batch.GetStones(board, batch_stones);
+            auto const &reference_stones = reference->GetStones();
+            for (size_t i = 0; i < BatchSimulatorFCV1::kStoneCount; ++i)
+            {
+                if (batch_stones[i].has_value() != reference_stones[i].has_value())
+                {
+                    validation.max_position_error = std::numeric_limits<float>::infinity();
+                }
+                else if (batch_stones[i])
+                {
+                    validation.max_position_error = std::max(
+                        validation.max_position_error,
+                        (batch_stones[i]->position - reference_stones[i]->position).Length());
+                }
+            }
+        }
+
+        validation.passed = validation.max_position_error <= tolerance;
+        return validation;
+    }
+
+    std::vector<dc::ISimulator::AllStones> CreateValidationLayouts()
+    {
+        using ShotRotation = dc::moves::Shot::Rotation;
+
+        dc::Vector2 const tee = kTee;
+
+        // 投げるストーンを最後のインデックスに置く
+        auto shot_stone = [](dc::Vector2 const &target, float target_speed, ShotRotation rotation)
+        {
+            float const angular_velocity = (rotation == ShotRotation::kCCW ? 1.f : -1.f) * fcv1::kShotAngularVelocity;
+            return dc::ISimulator::Stone(dc::Vector2(), 0.f, EstimateShotVelocityFCV1(target, target_speed, rotation), angular_velocity);
+        };
+        auto resting_stone = [](dc::Vector2 const &position)
+        {
+            return dc::ISimulator::Stone(position, 0.f, dc::Vector2(), 0.f);
+        };
+
+        std::vector<dc::ISimulator::AllStones> layouts;
+
+        // ドロー
+        for (auto const rotation : { ShotRotation::kCCW, ShotRotation::kCW })
+        {
+            auto &layout = layouts.emplace_back();
+            layout[15] = shot_stone(tee, 0.f, rotation);
+        }
+
+        // ティー上のストーンへのヒット (強い/弱い)
+        for (float const speed : { 0.5f, 2.f, 3.f })
+        {
+            auto &layout = layouts.emplace_back();
+            layout[0] = resting_stone(tee);
+            layout[15] = shot_stone(tee, speed, speed < 1.f ? ShotRotation::kCW : ShotRotation::kCCW);
+        }
+
+        // ガードとハウス内に複数のストーンがある盤面へのヒット
+        {
+            auto &layout = layouts.emplace_back();
+            layout[0] = resting_stone(tee + dc::Vector2(0.3f, 0.2f));
+            layout[1] = resting_stone(tee + dc::Vector2(-0.5f, -0.4f));
+            layout[2] = resting_stone(tee + dc::Vector2(0.1f, -0.7f));
+            layout[8] = resting_stone(tee + dc::Vector2(-0.1f, 0.6f));
+            layout[9] = resting_stone(tee + dc::Vector2(0.6f, -0.3f));
+            layout[10] = resting_stone(tee + dc::Vector2(-1.2f, -3.f));
+            layout[15] = shot_stone(tee + dc::Vector2(0.3f, 0.2f), 2.5f, ShotRotation::kCCW);
+        }
+
+        return layouts;
+    }
+
+} // namespace obsidian
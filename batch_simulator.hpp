@@ -0,0 +1,173 @@
+#ifndef AICY_OBSIDIAN_BATCH_SIMULATOR_HPP
+#define AICY_OBSIDIAN_BATCH_SIMULATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "board_snapshot.hpp"
+#include "fcv1_physics.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief 独立した複数の盤面をまとめてシミュレーションする，FCV1 互換のシミュレータです．
+    ///
+    /// 全盤面のストーンを構造体配列(SoA)形式で保持し，摩擦とカールによる速度の更新を
+    /// AVX2 / NEON 命令で8または4ストーンずつ並列に行います．衝突は盤面ごとに解決します．
+    /// 衝突の判定はy座標でソートしたストーンの並びを使って，動いているストーンの近くのストーンとの組に限ります．
+    /// 静止しているストーンは，動いているストーンに当たった時点で判定の対象に加えます．
+    /// ISimulator の仮想関数を介さないので，多数のロールアウトをまとめて行う場合に高速です．
+    ///
+    /// 衝突の扱いは Box2D を近似したものなので，使用前に ValidateBatchSimulatorFCV1() で参照シミュレータとの一致を確認してください．
+    class BatchSimulatorFCV1
+    {
+    public:
+        static constexpr size_t kStoneCount = dc::ISimulator::kStoneMax;
+
+        /// \param board_count 盤面数
+        ///
+        /// \param collision 衝突のパラメータ
+        explicit BatchSimulatorFCV1(size_t board_count, fcv1::CollisionParameters const &collision = fcv1::kCollisionParameters);
+
+        size_t GetBoardCount() const { return board_count_; }
+
+        /// \brief 盤面のストーン配置を設定します．
+        void SetStones(size_t board, dc::ISimulator::AllStones const &stones);
+
+        /// \brief 盤面を静止したストーンの配置 \p snapshot にします．
+        void SetStones(size_t board, BoardSnapshot const &snapshot);
+
+        /// \brief 盤面のストーン \p stone をティーライン側へ向けて投げます(原点に配置して速度を与えます)．
+        void LaunchStone(size_t board, size_t stone, dc::Vector2 const &velocity, float angular_velocity);
+
+        /// \brief 盤面のストーン配置を取得します．
+        void GetStones(size_t board, dc::ISimulator::AllStones &stones) const;
+
+        /// \brief 盤面のストーン配置を dc::GameState::Stones の形で取得します．y座標が \p min_y より小さいストーンは除外します．
+        void GetStones(size_t board, dc::GameState::Stones &stones, float min_y) const;
+
+        /// \brief 盤面の x座標の絶対値が \p side_limit より大きいか，y座標が \p back_limit より大きいストーンを取り除きます．
+        ///
+        /// 前回の呼出し以降に動いたストーンと，SetStones() や LaunchStone() で配置したストーンのみを調べます．
+        ///
+        /// \return 取り除いたストーンがあれば true
+        bool RemoveStonesOutside(size_t board, float side_limit, float back_limit);
+
+        /// \brief 盤面のどのストーンも，各境界(x座標の絶対値が \p side_limit，y座標が \p back_limit または \p hog_limit)を
+        ///     越えられなくなったか調べます．
+        ///
+        /// 動いているストーンそれぞれの移動距離の上限が，境界までの距離と他のストーンと接触するまでの距離のいずれよりも短い場合に true を返します．
+        bool IsSettled(size_t board, float side_limit, float back_limit, float hog_limit) const;
+
+        /// \brief 全盤面を1フレーム進めます．停止済みの盤面の衝突判定は省略します．
+        void Step();
+
+        /// \brief 全盤面のストーンが停止するか，\p max_steps フレーム進めるまでシミュレーションします．
+        ///
+        /// \return 進めたフレーム数
+        size_t StepUntilStopped(size_t max_steps);
+
+        /// \brief 盤面のストーンがすべて停止しているか調べます．
+        bool AreAllStonesStopped(size_t board) const { return !board_moving_[board]; }
+
+        /// \brief 全盤面のストーンがすべて停止しているか調べます．
+        bool AreAllBoardsStopped() const;
+
+        /// \brief 1フレームの秒数．ValidateBatchSimulatorFCV1() はこれと異なるフレーム時間のファクトリを不一致とします．
+        float GetSecondsPerFrame() const { return fcv1::kSecondsPerFrame; }
+
+    private:
+        template <class Function>
+        void ForEachContactCandidate(size_t board, Function &&function);
+        void ResolveCollisions(size_t board);
+        void CorrectPositions(size_t board);
+        void UpdateMovingFlags();
+
+        size_t board_count_;
+        fcv1::CollisionParameters collision_;
+
+        // インデックスは 盤面 * kStoneCount + ストーン．存在しないストーンは速度0で exists_ が 0
+        std::vector<float> x_;
+        std::vector<float> y_;
+        std::vector<float> vx_;
+        std::vector<float> vy_;
+        std::vector<float> angle_;
+        std::vector<float> angular_velocity_;
+        std::vector<std::uint8_t> exists_;
+        std::vector<std::uint8_t> board_moving_;
+        std::vector<std::uint16_t> moved_; ///< 盤面ごとの，前回の RemoveStonesOutside() 以降に動いたか配置されたストーンのビット
+        std::vector<std::uint8_t> order_; ///< 盤面ごとの y_ の昇順に並べたストーンのインデックス．フレーム間の移動は小さいので挿入ソートで保つ
+    };
+
+    /// \brief 1盤面の BatchSimulatorFCV1 を dc::ISimulator と同じ形の非仮想の関数で操作するシミュレータです．
+    ///
+    /// RunEarlyExitRollout() などのテンプレート引数として使用すると，フレームごとの仮想関数呼出しを介さずにロールアウトを行えます．
+    /// その場合，プレーエリアの判定も dc::ISimulator::AllStones に変換せずに構造体配列のまま行います．
+    /// ValidateBatchSimulatorFCV1() で試合のシミュレータとの一致を確認した場合にのみ使用してください．
+    class BoardSimulatorFCV1 final
+    {
+    public:
+        BoardSimulatorFCV1() : batch_(1) {}
+
+        /// \brief ストーン配置を設定します．
+        void SetStones(dc::ISimulator::AllStones const &stones) { batch_.SetStones(0, stones); }
+
+        /// \brief ストーン配置を取得します．返す参照は次の GetStones() の呼出しまで有効です．
+        dc::ISimulator::AllStones const &GetStones()
+        {
+            batch_.GetStones(0, stones_);
+            return stones_;
+        }
+
+        /// \brief 1フレーム進めます．
+        void Step() { batch_.Step(); }
+
+        /// \brief ストーンがすべて停止しているか調べます．
+        bool AreAllStonesStopped() const { return batch_.AreAllStonesStopped(0); }
+
+        /// \brief ストーン配置を dc::GameState::Stones の形で取得します．dc::ISimulator::AllStones には変換しません．
+        void GetStones(dc::GameState::Stones &stones, float min_y) const { batch_.GetStones(0, stones, min_y); }
+
+        /// \brief BatchSimulatorFCV1::RemoveStonesOutside() を参照してください．
+        bool RemoveStonesOutside(float side_limit, float back_limit) { return batch_.RemoveStonesOutside(0, side_limit, back_limit); }
+
+        /// \brief BatchSimulatorFCV1::IsSettled() を参照してください．
+        bool IsSettled(float side_limit, float back_limit, float hog_limit) const { return batch_.IsSettled(0, side_limit, back_limit, hog_limit); }
+
+    private:
+        BatchSimulatorFCV1 batch_;
+        dc::ISimulator::AllStones stones_;
+    };
+
+    /// \brief BatchSimulatorFCV1 と参照シミュレータの比較結果
+    struct BatchSimulatorValidation
+    {
+        size_t board_count = 0;
+        float max_position_error = 0.f; ///< 停止後のストーン位置のずれの最大値[m]．フレーム時間が異なる場合は無限大
+        bool passed = false;            ///< 全盤面でずれが許容値以内か
+    };
+
+    /// \brief BatchSimulatorFCV1 の結果を参照シミュレータと比較します．
+    ///
+    /// 各初期配置を両方のシミュレータで停止するまで進め，停止後のストーン位置を比較します．
+    /// BatchSimulatorFCV1 は1フレームの秒数が固定なので，\p reference_factory の FCV1 のフレーム時間が異なる場合は比較せずに不一致とします．
+    ///
+    /// \param reference_factory 参照シミュレータ(通常は試合で使用される FCV1)のファクトリ
+    ///
+    /// \param initial_stones 初期配置．空の場合は CreateValidationLayouts() の配置を使用する．
+    ///
+    /// \param tolerance 位置のずれの許容値[m]
+    BatchSimulatorValidation ValidateBatchSimulatorFCV1(
+        dc::ISimulatorFactory const &reference_factory,
+        std::vector<dc::ISimulator::AllStones> const &initial_stones,
+        float tolerance);
+
+    /// \brief 比較用の典型的な初期配置(ドロー，単純なヒット，複数のストーンがある盤面へのヒット)を生成します．
+    std::vector<dc::ISimulator::AllStones> CreateValidationLayouts();
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_BATCH_SIMULATOR_HPP
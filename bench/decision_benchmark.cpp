@@ -0,0 +1,466 @@
+// 思考の主要な処理のマイクロベンチマークです．
+//
+// 実行例: aicy_obsidian_benchmark --benchmark_format=json --benchmark_out=result.json
+//
+// ロールアウトのスループットは items_per_second (ロールアウト/秒)，
+// 思考時間は Decision の p50_ms / p99_ms カウンタとして出力されます．
+// BatchSimulatorBreak は混み合った盤面へのショットを停止まで進める速さを items_per_second (盤面/秒) として出力します．
+// LookaheadReuse は，探索後のブレのあるショットの結果を根にしたとき部分木または評価値を引き継げた割合を subtree_rate / warm_start_rate カウンタとして出力します．
+// ShotCorridor は，経路が阻まれると判定したドローのうちブレの無い試行で実際に他のストーンを動かした割合を blocked_precision カウンタとして出力します．
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "batch_simulator.hpp"
+#include "board_snapshot.hpp"
+#include "engine.hpp"
+#include "fcv1_physics.hpp"
+#include "lookahead_search.hpp"
+#include "opening_book.hpp"
+#include "rollout.hpp"
+#include "shot_corridor.hpp"
+#include "shot_velocity.hpp"
+#include "stone_order.hpp"
+#include "worker_pool.hpp"
+
+namespace dc = digitalcurling3;
+
+namespace
+{
+
+    /// \brief 記録した局面のストーン
+    struct RecordedStone
+    {
+        size_t team;
+        float x;
+        float y;
+    };
+
+    /// \brief 8ストーンの局面(エンドの中盤，ガードとハウス内が混み合った状態)
+    constexpr std::array<RecordedStone, 8> kMiddlePosition = { {
+        { 0, 0.10f, 35.20f }, { 1, 0.00f, 38.60f }, { 0, -1.10f, 35.60f }, { 1, 0.60f, 37.40f },
+        { 0, 0.30f, 38.20f }, { 1, -0.40f, 36.90f }, { 0, -0.80f, 39.50f }, { 1, 1.20f, 39.90f },
+    } };
+
+    /// \brief 15ストーンの局面(ラストストーンの直前)
+    constexpr std::array<RecordedStone, 15> kLatePosition = { {
+        { 0, 0.10f, 35.20f }, { 1, 0.00f, 38.60f }, { 0, -1.10f, 35.60f }, { 1, 0.60f, 37.40f },
+        { 0, 0.30f, 38.20f }, { 1, -0.40f, 36.90f }, { 0, -0.80f, 39.50f }, { 1, 1.20f, 39.90f },
+        { 0, 0.05f, 37.95f }, { 1, -0.30f, 38.90f }, { 0, 0.70f, 38.80f }, { 1, -1.40f, 38.10f },
+        { 0, 0.45f, 36.10f }, { 1, 1.60f, 37.20f }, { 0, -0.20f, 39.30f },
+    } };
+
+    dc::GameSetting MakeGameSetting()
+    {
+        dc::GameSetting setting;
+        setting.max_end = 10;
+        setting.five_rock_rule = true;
+        setting.sheet_width = 4.75f;
+        return setting;
+    }
+
+    /// \brief 記録した局面を先攻チーム0，後攻チーム1の GameState にする．
+    template <size_t N>
+    dc::GameState MakeGameState(dc::GameSetting const &setting, std::array<RecordedStone, N> const &position)
+    {
+        dc::GameState state(setting);
+        state.shot = static_cast<std::uint8_t>(N);
+        std::array<size_t, 2> thrown{ 0, 0 };
+        for (auto const &stone : position)
+        {
+            state.stones[stone.team][thrown[stone.team]++] = dc::Transform(dc::Vector2(stone.x, stone.y), 0.f);
+        }
+        return state;
+    }
+
+    /// \brief 盤面上に \p stone_count 個のストーンがある局面を返す．0, 8, 15 に対応する．
+    dc::GameState MakeGameState(dc::GameSetting const &setting, size_t stone_count)
+    {
+        switch (stone_count)
+        {
+        case 8:
+            return MakeGameState(setting, kMiddlePosition);
+        case 15:
+            return MakeGameState(setting, kLatePosition);
+        default:
+            return dc::GameState(setting);
+        }
+    }
+
+    /// \brief ティーに止めるドローショット
+    dc::moves::Shot MakeDrawShot()
+    {
+        dc::Vector2 const tee = obsidian::kTee;
+        return { obsidian::EstimateShotVelocityFCV1(tee, 0.f, dc::moves::Shot::Rotation::kCCW), dc::moves::Shot::Rotation::kCCW };
+    }
+
+    /// \brief ソート済みの \p samples の \p p 分位点
+    double GetPercentile(std::vector<double> const &samples, double p)
+    {
+        if (samples.empty())
+            return 0.;
+        size_t const rank = static_cast<size_t>(std::ceil(p * static_cast<double>(samples.size())));
+        return samples[std::min(samples.size(), std::max<size_t>(rank, 1)) - 1];
+    }
+
+    /// \brief ベンチマーク全体で共有するずれ角のテーブル．Engine にも Options::velocity_table として渡す
+    std::shared_ptr<obsidian::VelocityTable const> const &GetSharedVelocityTable()
+    {
+        static std::shared_ptr<obsidian::VelocityTable const> const table = []
+        {
+            auto t = std::make_shared<obsidian::VelocityTable>();
+            t->Build();
+            return t;
+        }();
+        return table;
+    }
+
+    obsidian::VelocityTable const &GetVelocityTable()
+    {
+        return *GetSharedVelocityTable();
+    }
+
+    /// \brief ベンチマーク全体で共有するワーカープール
+    obsidian::WorkerPool &GetWorkerPool()
+    {
+        static dc::simulators::SimulatorFCV1Factory const simulator_factory;
+        static obsidian::WorkerPool pool(simulator_factory, { nullptr, nullptr, nullptr, nullptr });
+        return pool;
+    }
+
+    /// \brief 初速の推定．引数はずれ角のテーブルを使用するか(0 / 1)とヒットか(0 / 1)
+    void BM_EstimateShotVelocityFCV1(benchmark::State &state)
+    {
+        obsidian::VelocityTable const *table = state.range(0) != 0 ? &GetVelocityTable() : nullptr;
+        float const target_speed = state.range(1) != 0 ? 2.5f : 0.f;
+        float x = -1.f;
+        for (auto _ : state)
+        {
+            // 同じ入力が続かないように目標地点を少しずつ動かす
+            x = x < 1.f ? x + 0.01f : -1.f;
+            auto const velocity = obsidian::EstimateShotVelocityFCV1(dc::Vector2(x, 38.405f), target_speed, dc::moves::Shot::Rotation::kCW, table);
+            benchmark::DoNotOptimize(velocity);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    /// \brief ティーからの距離でのソート(Engine::SortStones() の本体)．引数は盤面上のストーン数
+    void BM_SortStones(benchmark::State &state)
+    {
+        auto const setting = MakeGameSetting();
+        auto const game_state = MakeGameState(setting, static_cast<size_t>(state.range(0)));
+        obsidian::StoneOrder order;
+        for (auto _ : state)
+        {
+            order.Build(game_state.stones);
+            benchmark::DoNotOptimize(order);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    /// \brief ショット後の距離順の更新(探索木の子ノードで行う StoneOrder::Update())と得点の参照．引数は盤面上のストーン数
+    ///
+    /// 投げたストーンと当たったストーンの2つが動いた場合を想定し，毎回ストーンを2つ動かす．
+    void BM_StoneOrderUpdate(benchmark::State &state)
+    {
+        auto const setting = MakeGameSetting();
+        auto board = obsidian::BoardSnapshot::FromGameState(MakeGameState(setting, static_cast<size_t>(state.range(0))));
+        obsidian::StoneOrder order;
+        order.Build(board);
+        size_t moved = 0;
+        for (auto _ : state)
+        {
+            std::uint16_t mask = 0;
+            for (size_t k = 0; k < 2; ++k)
+            {
+                do
+                {
+                    moved = (moved + 7) % obsidian::BoardSnapshot::kStoneCount;
+                } while (!board.HasStone(moved));
+                board.stones[moved].y += board.stones[moved].y < obsidian::kTee.y ? 0.05f : -0.05f;
+                mask |= static_cast<std::uint16_t>(1u << moved);
+            }
+            order.Update(board, mask);
+            benchmark::DoNotOptimize(order.GetScore());
+            benchmark::DoNotOptimize(order.GetScoringTeam());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    /// \brief ApplyMove() による1ショットのロールアウト．引数は盤面上のストーン数
+    void BM_ApplyMoveRollout(benchmark::State &state)
+    {
+        auto const setting = MakeGameSetting();
+        auto const game_state = MakeGameState(setting, static_cast<size_t>(state.range(0)));
+        dc::simulators::SimulatorFCV1Factory const simulator_factory;
+        dc::players::PlayerNormalDistFactory const player_factory;
+        auto simulator = simulator_factory.CreateSimulator();
+        auto storage = simulator->CreateStorage();
+        auto player = player_factory.CreatePlayer();
+        auto const shot = MakeDrawShot();
+        for (auto _ : state)
+        {
+            auto temp_game_state = game_state;
+            dc::Move temp_move = shot;
+            simulator->Load(*storage);
+            dc::ApplyMove(setting, *simulator, *player, temp_game_state, temp_move, std::chrono::milliseconds(0));
+            benchmark::DoNotOptimize(temp_game_state);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    /// \brief 探索で使用する RunRollout() による1ショットのロールアウト．引数は盤面上のストーン数
+    void BM_RunRollout(benchmark::State &state)
+    {
+        auto const setting = MakeGameSetting();
+        auto const board = obsidian::BoardSnapshot::FromGameState(MakeGameState(setting, static_cast<size_t>(state.range(0))));
+        dc::simulators::SimulatorFCV1Factory const simulator_factory;
+        dc::players::PlayerNormalDistFactory const player_factory;
+        auto simulator = simulator_factory.CreateSimulator();
+        auto player = player_factory.CreatePlayer();
+        auto const shot = MakeDrawShot();
+        for (auto _ : state)
+        {
+            auto const stones = obsidian::RunRollout(setting, *simulator, *player, board, shot);
+            benchmark::DoNotOptimize(stones);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    /// \brief 仮想関数を介さない BoardSimulatorFCV1 による RunRollout()．引数は盤面上のストーン数
+    void BM_RunRolloutFCV1(benchmark::State &state)
+    {
+        auto const setting = MakeGameSetting();
+        auto const board = obsidian::BoardSnapshot::FromGameState(MakeGameState(setting, static_cast<size_t>(state.range(0))));
+        dc::players::PlayerNormalDistFactory const player_factory;
+        obsidian::BoardSimulatorFCV1 simulator;
+        auto player = player_factory.CreatePlayer();
+        auto const shot = MakeDrawShot();
+        for (auto _ : state)
+        {
+            auto const stones = obsidian::RunRollout(setting, simulator, *player, board, shot);
+            benchmark::DoNotOptimize(stones);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    /// \brief 15ストーンの局面へのショットを BatchSimulatorFCV1 で停止まで進める．引数は盤面数
+    ///
+    /// ハウスが混み合った盤面でのブレイク(多数のストーンの連鎖衝突)が多く，衝突判定の対象の絞り込みの効果を測る．
+    /// items_per_second は1秒あたりに停止まで進めた盤面数．
+    void BM_BatchSimulatorBreak(benchmark::State &state)
+    {
+        constexpr size_t kShotCount = 16;
+        constexpr size_t kMaxSteps = 100000;
+
+        auto const setting = MakeGameSetting();
+        auto const board = obsidian::BoardSnapshot::FromGameState(MakeGameState(setting, kLatePosition));
+        auto const &table = GetVelocityTable();
+
+        // ドローから強いヒットまで，ティー付近を狙うショット
+        dc::Vector2 const tee = obsidian::kTee;
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> offset(-0.6f, 0.6f);
+        std::uniform_real_distribution<float> speed(0.f, 4.f);
+        std::array<dc::Vector2, kShotCount> velocities;
+        std::array<float, kShotCount> angular_velocities;
+        for (size_t i = 0; i < kShotCount; ++i)
+        {
+            auto const rotation = i % 2 == 0 ? dc::moves::Shot::Rotation::kCCW : dc::moves::Shot::Rotation::kCW;
+            velocities[i] = obsidian::EstimateShotVelocityFCV1(tee + dc::Vector2(offset(random), offset(random)), speed(random), rotation, &table);
+            angular_velocities[i] = (i % 2 == 0 ? 1.f : -1.f) * obsidian::fcv1::kShotAngularVelocity;
+        }
+
+        size_t const board_count = static_cast<size_t>(state.range(0));
+        obsidian::BatchSimulatorFCV1 simulator(board_count);
+        size_t shot = 0;
+        for (auto _ : state)
+        {
+            for (size_t i = 0; i < board_count; ++i, shot = (shot + 1) % kShotCount)
+            {
+                simulator.SetStones(i, board);
+                simulator.LaunchStone(i, obsidian::BatchSimulatorFCV1::kStoneCount - 1, velocities[shot], angular_velocities[shot]);
+            }
+            benchmark::DoNotOptimize(simulator.StepUntilStopped(kMaxSteps));
+        }
+        state.SetItemsProcessed(state.iterations() * board_count);
+    }
+
+    /// \brief ShotCorridor による経路の判定．引数は盤面上のストーン数
+    ///
+    /// ハウス内のランダムな地点への400本のドローを判定し，阻まれると判定したものをブレの無い試行で確かめる．
+    void BM_ShotCorridor(benchmark::State &state)
+    {
+        constexpr size_t kDrawCount = 400;
+        constexpr float kClearance = 2.f * dc::ISimulator::kStoneRadius - 0.08f; // 候補ショットの生成と同じ値
+        constexpr float kMovedDistance = 0.01f; // これ以上動いたストーンは「動かした」とみなす
+
+        auto const setting = MakeGameSetting();
+        auto const game_state = MakeGameState(setting, static_cast<size_t>(state.range(0)));
+        auto const board = obsidian::BoardSnapshot::FromGameState(game_state);
+        auto const &table = GetVelocityTable();
+
+        dc::Vector2 const tee = obsidian::kTee;
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> offset(-1.8f, 1.8f);
+        std::vector<dc::moves::Shot> shots;
+        std::vector<dc::Vector2> targets;
+        for (size_t i = 0; i < kDrawCount; ++i)
+        {
+            auto const rotation = i % 2 == 0 ? dc::moves::Shot::Rotation::kCCW : dc::moves::Shot::Rotation::kCW;
+            targets.push_back(tee + dc::Vector2(offset(random), offset(random)));
+            shots.push_back({ obsidian::EstimateShotVelocityFCV1(targets.back(), 0.f, rotation, &table), rotation });
+        }
+
+        size_t blocked_count = 0;
+        for (auto _ : state)
+        {
+            blocked_count = 0;
+            for (size_t i = 0; i < kDrawCount; ++i)
+                blocked_count += obsidian::ShotCorridor(shots[i].velocity, targets[i]).IsBlocked(board, 0, kClearance);
+        }
+
+        // 阻まれると判定したドローが，実際に盤面のストーンを除去するか動かすか
+        dc::players::PlayerIdenticalFactory const player_factory;
+        auto player = player_factory.CreatePlayer();
+        obsidian::BoardSimulatorFCV1 simulator;
+        size_t disturbed_count = 0;
+        for (size_t i = 0; i < kDrawCount; ++i)
+        {
+            if (!obsidian::ShotCorridor(shots[i].velocity, targets[i]).IsBlocked(board, 0, kClearance))
+                continue;
+            auto const stones = obsidian::RunRollout(setting, simulator, *player, board, shots[i]);
+            bool disturbed = false;
+            for (size_t team = 0; team < 2; ++team)
+            {
+                for (size_t stone = 0; stone < stones[team].size(); ++stone)
+                {
+                    auto const &before = game_state.stones[team][stone];
+                    auto const &after = stones[team][stone];
+                    if (before && (!after || (after->position - before->position).Length() > kMovedDistance))
+                        disturbed = true;
+                }
+            }
+            disturbed_count += disturbed;
+        }
+
+        state.counters["blocked_fraction"] = static_cast<double>(blocked_count) / kDrawCount;
+        state.counters["blocked_precision"] = blocked_count > 0 ? static_cast<double>(disturbed_count) / blocked_count : 0.;
+        state.SetItemsProcessed(state.iterations() * kDrawCount);
+    }
+
+    /// \brief 1手の思考(Engine::OnMyTurn() 全体)にかかる時間．引数は盤面上のストーン数と，最終エンドの自チームの残り思考時間[ms]
+    ///
+    /// 思考時間の配分，定跡の参照，探索，探索が足りない場合のヒットの探索，初速の精密化と集計をすべて含む．
+    /// 最終エンドの局面にして TimeManager が配分する時間を残り思考時間だけで決まるようにする．
+    /// 木の再利用が起きないように毎回 Engine を作り直し，OnInit() は計測から除く．
+    void BM_Decision(benchmark::State &state)
+    {
+        auto const setting = MakeGameSetting();
+        auto game_state = MakeGameState(setting, static_cast<size_t>(state.range(0)));
+        game_state.end = static_cast<std::uint8_t>(setting.max_end - 1);
+        game_state.thinking_time_remaining.fill(std::chrono::milliseconds(state.range(1)));
+
+        // スレッドとテーブルは共有し，定跡は空にしてキャッシュファイルに依存しないようにする
+        static auto const thread_pool = std::make_shared<obsidian::ThreadPool>();
+        obsidian::Engine::Options options;
+        options.thread_pool = thread_pool;
+        options.velocity_table = GetSharedVelocityTable();
+        options.opening_book = std::make_shared<obsidian::OpeningBook const>();
+        options.ponder = false;
+        dc::simulators::SimulatorFCV1Factory const simulator_factory;
+        dc::players::PlayerNormalDistFactory const player_factory;
+
+        std::vector<double> latencies;
+        size_t rollout_count = 0;
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            obsidian::Engine engine(options);
+            std::array<std::unique_ptr<dc::IPlayerFactory>, 4> player_factories;
+            for (auto &factory : player_factories)
+            {
+                factory = player_factory.Clone();
+            }
+            std::array<size_t, 4> player_order{ 0, 1, 2, 3 };
+            engine.OnInit(game_state.GetNextTeam(), setting, simulator_factory.Clone(), std::move(player_factories), player_order);
+            state.ResumeTiming();
+
+            auto const start = std::chrono::steady_clock::now();
+            auto const move = engine.OnMyTurn(game_state);
+            latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            benchmark::DoNotOptimize(move);
+
+            rollout_count += engine.GetStatistics().simulation_count;
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        state.counters["p50_ms"] = GetPercentile(latencies, 0.5);
+        state.counters["p99_ms"] = GetPercentile(latencies, 0.99);
+        state.counters["rollouts_per_second"] = benchmark::Counter(static_cast<double>(rollout_count), benchmark::Counter::kIsRate);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    /// \brief 探索後に実際のブレのあるショットの結果を根にしたとき，木から引き継げる割合．引数は盤面上のストーン数(0 または 8)
+    ///
+    /// 探索で最も訪問したショットをシードを変えたプレイヤーで投げ，その結果で SetRoot() を呼ぶ．
+    /// 根から1手先の局面は相手の手番なので，自チームの手番の探索結果を相手の手番へ引き継ぐ場合(OnOpponentTurn())に相当する．
+    void BM_LookaheadReuse(benchmark::State &state)
+    {
+        constexpr size_t kSearchVisits = 256;
+
+        auto const setting = MakeGameSetting();
+        auto const game_state = MakeGameState(setting, static_cast<size_t>(state.range(0)));
+        auto const board = obsidian::BoardSnapshot::FromGameState(game_state);
+        auto &pool = GetWorkerPool();
+        auto const &table = GetVelocityTable();
+        obsidian::BoardSimulatorFCV1 simulator;
+
+        std::array<size_t, 3> reuse_counts{ 0, 0, 0 };
+        std::uint32_t seed = 0;
+        for (auto _ : state)
+        {
+            obsidian::LookaheadSearch search(pool, setting, game_state.GetNextTeam(), &table);
+            search.SetRoot(game_state);
+            search.Run([](size_t visits, std::chrono::steady_clock::duration) { return visits < kSearchVisits; });
+            auto const best = search.GetBestShot();
+            if (!best)
+                continue;
+
+            dc::players::PlayerNormalDistFactory player_factory;
+            player_factory.seed = seed++;
+            auto const player = player_factory.CreatePlayer();
+            auto next_state = game_state;
+            next_state.stones = obsidian::RunRollout(setting, simulator, *player, board, best->shot);
+            ++next_state.shot;
+            ++reuse_counts[static_cast<size_t>(search.SetRoot(next_state))];
+        }
+
+        double const total = static_cast<double>(reuse_counts[0] + reuse_counts[1] + reuse_counts[2]);
+        state.counters["new_rate"] = total > 0. ? reuse_counts[0] / total : 0.;
+        state.counters["subtree_rate"] = total > 0. ? reuse_counts[1] / total : 0.;
+        state.counters["warm_start_rate"] = total > 0. ? reuse_counts[2] / total : 0.;
+        state.SetItemsProcessed(state.iterations());
+    }
+
+} // unnamed namespace
+
+BENCHMARK(BM_EstimateShotVelocityFCV1)->ArgsProduct({ { 0, 1 }, { 0, 1 } })->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_SortStones)->Arg(0)->Arg(8)->Arg(15);
+BENCHMARK(BM_StoneOrderUpdate)->Arg(8)->Arg(15);
+BENCHMARK(BM_ApplyMoveRollout)->Arg(0)->Arg(8)->Arg(15)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_RunRollout)->Arg(0)->Arg(8)->Arg(15)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_RunRolloutFCV1)->Arg(0)->Arg(8)->Arg(15)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_BatchSimulatorBreak)->Arg(1)->Arg(64)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ShotCorridor)->Arg(8)->Arg(15)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Decision)->Args({ 0, 3000 })->Args({ 8, 2000 })->Args({ 15, 400 })->Iterations(100)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LookaheadReuse)->Arg(0)->Arg(8)->Iterations(50)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,280 @@
+#include "board_evaluator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        constexpr size_t kStoneCount = BoardSnapshot::kStoneCount;
+        constexpr size_t kStonesPerTeam = kStoneCount / 2;
+        constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+        /// \brief 存在しないストーンを置く y 座標．ハウスからもガードの範囲からも外れる．
+        constexpr float kAbsentY = 1.e18f;
+
+        /// \brief ガードとみなす y 座標の下限(ストーン全体がホグラインを越えている)
+        float GetGuardMinY()
+        {
+            return dc::coordinate::GetHogLineY(true, dc::coordinate::Id::kShot0) + dc::ISimulator::kStoneRadius;
+        }
+
+        /// \brief 残りショット数の割合
+        float GetRemainingFraction(BoardSnapshot const &board)
+        {
+            return static_cast<float>(std::max(0, static_cast<int>(dc::GameState::kShotPerEnd) - static_cast<int>(board.shot))) / dc::GameState::kShotPerEnd;
+        }
+
+        /// \brief チーム0から見たラストストーンの符号
+        float GetHammerSign(BoardSnapshot const &board)
+        {
+            return board.hammer == 0 ? 1.f : -1.f;
+        }
+
+        /// \brief チーム0から見た評価値を組み立てる．SIMD 版と同じ順序で計算する．
+        float Combine(
+            EvaluatorWeights const &weights, float f, float hammer_sign,
+            float count0, float count1, float house0, float house1, float guard0, float guard1)
+        {
+            float const certainty = 1.f - weights.count_uncertainty * f;
+            return certainty * (count0 - count1)
+                + weights.house * f * ((house0 - count0) - (house1 - count1))
+                + weights.guard * f * (guard0 - guard1)
+                + weights.hammer * f * hammer_sign;
+        }
+
+#if defined(__AVX2__)
+        constexpr size_t kLaneCount = 8;
+
+        /// \brief 8盤面をまとめて評価する．\p count < 8 の場合，残りのレーンは空の盤面として扱う．
+        void EvaluateLanes(BoardSnapshot const *boards, size_t count, dc::Team team, float *values, EvaluatorWeights const &weights)
+        {
+            // 盤面ごとの配列をストーンごと(盤面をレーンとする)の配列に並べ替える
+            alignas(32) float xs[kStoneCount][kLaneCount];
+            alignas(32) float ys[kStoneCount][kLaneCount];
+            alignas(32) float fs[kLaneCount];
+            alignas(32) float hammer_signs[kLaneCount];
+            for (size_t lane = 0; lane < kLaneCount; ++lane)
+            {
+                BoardSnapshot const *board = lane < count ? &boards[lane] : nullptr;
+                for (size_t i = 0; i < kStoneCount; ++i)
+                {
+                    bool const exists = board && board->HasStone(i);
+                    xs[i][lane] = exists ? board->stones[i].x : 0.f;
+                    ys[i][lane] = exists ? board->stones[i].y : kAbsentY;
+                }
+                fs[lane] = board ? GetRemainingFraction(*board) : 0.f;
+                hammer_signs[lane] = board ? GetHammerSign(*board) : 0.f;
+            }
+
+            __m256 const tee_y = _mm256_set1_ps(kTee.y);
+            __m256 const guard_min_y = _mm256_set1_ps(GetGuardMinY());
+            __m256 const lane_half_width = _mm256_set1_ps(weights.guard_lane_half_width);
+            __m256 const house = _mm256_set1_ps(kHouseSquaredDistance);
+            __m256 const infinity = _mm256_set1_ps(kInfinity);
+            __m256 const one = _mm256_set1_ps(1.f);
+            __m256 const abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+            __m256 d2[kStoneCount];
+            __m256 guard[2] = { _mm256_setzero_ps(), _mm256_setzero_ps() };
+            __m256 nearest[2] = { infinity, infinity };
+            for (size_t i = 0; i < kStoneCount; ++i)
+            {
+                __m256 const x = _mm256_load_ps(xs[i]);
+                __m256 const y = _mm256_load_ps(ys[i]);
+                __m256 const dy = _mm256_sub_ps(y, tee_y);
+                d2[i] = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(dy, dy));
+
+                size_t const team_index = i / kStonesPerTeam;
+                nearest[team_index] = _mm256_min_ps(nearest[team_index], d2[i]);
+
+                __m256 const is_guard = _mm256_and_ps(
+                    _mm256_and_ps(_mm256_cmp_ps(y, guard_min_y, _CMP_GE_OQ), _mm256_cmp_ps(y, tee_y, _CMP_LT_OQ)),
+                    _mm256_and_ps(_mm256_cmp_ps(d2[i], house, _CMP_GT_OQ), _mm256_cmp_ps(_mm256_and_ps(x, abs_mask), lane_half_width, _CMP_LE_OQ)));
+                guard[team_index] = _mm256_add_ps(guard[team_index], _mm256_and_ps(is_guard, one));
+            }
+
+            // ハウス外の最も近いストーンは得点を妨げない
+            __m256 const blocker[2] = {
+                _mm256_blendv_ps(infinity, nearest[1], _mm256_cmp_ps(nearest[1], house, _CMP_LE_OQ)),
+                _mm256_blendv_ps(infinity, nearest[0], _mm256_cmp_ps(nearest[0], house, _CMP_LE_OQ)),
+            };
+
+            __m256 counts[2] = { _mm256_setzero_ps(), _mm256_setzero_ps() };
+            __m256 houses[2] = { _mm256_setzero_ps(), _mm256_setzero_ps() };
+            for (size_t i = 0; i < kStoneCount; ++i)
+            {
+                size_t const team_index = i / kStonesPerTeam;
+                __m256 const in_house = _mm256_cmp_ps(d2[i], house, _CMP_LE_OQ);
+                __m256 const counting = _mm256_and_ps(in_house, _mm256_cmp_ps(d2[i], blocker[team_index], _CMP_LT_OQ));
+                houses[team_index] = _mm256_add_ps(houses[team_index], _mm256_and_ps(in_house, one));
+                counts[team_index] = _mm256_add_ps(counts[team_index], _mm256_and_ps(counting, one));
+            }
+
+            alignas(32) float count0[kLaneCount], count1[kLaneCount], house0[kLaneCount], house1[kLaneCount], guard0[kLaneCount], guard1[kLaneCount];
+            _mm256_store_ps(count0, counts[0]);
+            _mm256_store_ps(count1, counts[1]);
+            _mm256_store_ps(house0, houses[0]);
+            _mm256_store_ps(house1, houses[1]);
+            _mm256_store_ps(guard0, guard[0]);
+            _mm256_store_ps(guard1, guard[1]);
+
+            float const sign = team == dc::Team::k0 ? 1.f : -1.f;
+            for (size_t lane = 0; lane < count; ++lane)
+            {
+                values[lane] = sign * Combine(weights, fs[lane], hammer_signs[lane], count0[lane], count1[lane], house0[lane], house1[lane], guard0[lane], guard1[lane]);
+            }
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        constexpr size_t kLaneCount = 4;
+
+        /// \brief 4盤面をまとめて評価する．\p count < 4 の場合，残りのレーンは空の盤面として扱う．
+        void EvaluateLanes(BoardSnapshot const *boards, size_t count, dc::Team team, float *values, EvaluatorWeights const &weights)
+        {
+            alignas(16) float xs[kStoneCount][kLaneCount];
+            alignas(16) float ys[kStoneCount][kLaneCount];
+            alignas(16) float fs[kLaneCount];
+            alignas(16) float hammer_signs[kLaneCount];
+            for (size_t lane = 0; lane < kLaneCount; ++lane)
+            {
+                BoardSnapshot const *board = lane < count ? &boards[lane] : nullptr;
+                for (size_t i = 0; i < kStoneCount; ++i)
+                {
+                    bool const exists = board && board->HasStone(i);
+                    xs[i][lane] = exists ? board->stones[i].x : 0.f;
+                    ys[i][lane] = exists ? board->stones[i].y : kAbsentY;
+                }
+                fs[lane] = board ? GetRemainingFraction(*board) : 0.f;
+                hammer_signs[lane] = board ? GetHammerSign(*board) : 0.f;
+            }
+
+            float32x4_t const tee_y = vdupq_n_f32(kTee.y);
+            float32x4_t const guard_min_y = vdupq_n_f32(GetGuardMinY());
+            float32x4_t const lane_half_width = vdupq_n_f32(weights.guard_lane_half_width);
+            float32x4_t const house = vdupq_n_f32(kHouseSquaredDistance);
+            float32x4_t const infinity = vdupq_n_f32(kInfinity);
+            uint32x4_t const one = vreinterpretq_u32_f32(vdupq_n_f32(1.f));
+
+            auto select_one = [one](uint32x4_t mask) { return vreinterpretq_f32_u32(vandq_u32(mask, one)); };
+
+            float32x4_t d2[kStoneCount];
+            float32x4_t guard[2] = { vdupq_n_f32(0.f), vdupq_n_f32(0.f) };
+            float32x4_t nearest[2] = { infinity, infinity };
+            for (size_t i = 0; i < kStoneCount; ++i)
+            {
+                float32x4_t const x = vld1q_f32(xs[i]);
+                float32x4_t const y = vld1q_f32(ys[i]);
+                float32x4_t const dy = vsubq_f32(y, tee_y);
+                d2[i] = vaddq_f32(vmulq_f32(x, x), vmulq_f32(dy, dy));
+
+                size_t const team_index = i / kStonesPerTeam;
+                nearest[team_index] = vminq_f32(nearest[team_index], d2[i]);
+
+                uint32x4_t const is_guard = vandq_u32(
+                    vandq_u32(vcgeq_f32(y, guard_min_y), vcltq_f32(y, tee_y)),
+                    vandq_u32(vcgtq_f32(d2[i], house), vcleq_f32(vabsq_f32(x), lane_half_width)));
+                guard[team_index] = vaddq_f32(guard[team_index], select_one(is_guard));
+            }
+
+            float32x4_t const blocker[2] = {
+                vbslq_f32(vcleq_f32(nearest[1], house), nearest[1], infinity),
+                vbslq_f32(vcleq_f32(nearest[0], house), nearest[0], infinity),
+            };
+
+            float32x4_t counts[2] = { vdupq_n_f32(0.f), vdupq_n_f32(0.f) };
+            float32x4_t houses[2] = { vdupq_n_f32(0.f), vdupq_n_f32(0.f) };
+            for (size_t i = 0; i < kStoneCount; ++i)
+            {
+                size_t const team_index = i / kStonesPerTeam;
+                uint32x4_t const in_house = vcleq_f32(d2[i], house);
+                uint32x4_t const counting = vandq_u32(in_house, vcltq_f32(d2[i], blocker[team_index]));
+                houses[team_index] = vaddq_f32(houses[team_index], select_one(in_house));
+                counts[team_index] = vaddq_f32(counts[team_index], select_one(counting));
+            }
+
+            alignas(16) float count0[kLaneCount], count1[kLaneCount], house0[kLaneCount], house1[kLaneCount], guard0[kLaneCount], guard1[kLaneCount];
+            vst1q_f32(count0, counts[0]);
+            vst1q_f32(count1, counts[1]);
+            vst1q_f32(house0, houses[0]);
+            vst1q_f32(house1, houses[1]);
+            vst1q_f32(guard0, guard[0]);
+            vst1q_f32(guard1, guard[1]);
+
+            float const sign = team == dc::Team::k0 ? 1.f : -1.f;
+            for (size_t lane = 0; lane < count; ++lane)
+            {
+                values[lane] = sign * Combine(weights, fs[lane], hammer_signs[lane], count0[lane], count1[lane], house0[lane], house1[lane], guard0[lane], guard1[lane]);
+            }
+        }
+#endif
+
+    } // unnamed namespace
+
+    float EvaluateBoard(BoardSnapshot const &board, dc::Team team, EvaluatorWeights const &weights)
+    {
+        float const tee_y = kTee.y;
+        float const guard_min_y = GetGuardMinY();
+
+        float d2[kStoneCount];
+        float nearest[2] = { kInfinity, kInfinity };
+        float guard[2] = { 0.f, 0.f };
+        for (size_t i = 0; i < kStoneCount; ++i)
+        {
+            bool const exists = board.HasStone(i);
+            float const x = exists ? board.stones[i].x : 0.f;
+            float const y = exists ? board.stones[i].y : kAbsentY;
+            float const dy = y - tee_y;
+            d2[i] = x * x + dy * dy;
+
+            size_t const team_index = i / kStonesPerTeam;
+            nearest[team_index] = std::min(nearest[team_index], d2[i]);
+            guard[team_index] += static_cast<float>(
+                (y >= guard_min_y) & (y < tee_y) & (d2[i] > kHouseSquaredDistance) & (std::abs(x) <= weights.guard_lane_half_width));
+        }
+
+        // ハウス外の最も近いストーンは得点を妨げない
+        float const blocker[2] = {
+            nearest[1] <= kHouseSquaredDistance ? nearest[1] : kInfinity,
+            nearest[0] <= kHouseSquaredDistance ? nearest[0] : kInfinity,
+        };
+
+        float counts[2] = { 0.f, 0.f };
+        float houses[2] = { 0.f, 0.f };
+        for (size_t i = 0; i < kStoneCount; ++i)
+        {
+            size_t const team_index = i / kStonesPerTeam;
+            bool const in_house = d2[i] <= kHouseSquaredDistance;
+            houses[team_index] += static_cast<float>(in_house);
+            counts[team_index] += static_cast<float>(in_house & (d2[i] < blocker[team_index]));
+        }
+
+        float const value = Combine(weights, GetRemainingFraction(board), GetHammerSign(board), counts[0], counts[1], houses[0], houses[1], guard[0], guard[1]);
+        return team == dc::Team::k0 ? value : -value;
+    }
+
+    void EvaluateBoards(BoardSnapshot const *boards, size_t count, dc::Team team, float *values, EvaluatorWeights const &weights)
+    {
+#if defined(__AVX2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+        for (size_t i = 0; i < count; i += kLaneCount)
+        {
+            EvaluateLanes(boards + i, std::min(kLaneCount, count - i), team, values + i, weights);
+        }
+#else
+        for (size_t i = 0; i < count; ++i)
+        {
+            values[i] = EvaluateBoard(boards[i], team, weights);
+        }
+#endif
+    }
+
+} // namespace obsidian
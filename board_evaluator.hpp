@@ -0,0 +1,53 @@
+#ifndef AICY_OBSIDIAN_BOARD_EVALUATOR_HPP
+#define AICY_OBSIDIAN_BOARD_EVALUATOR_HPP
+
+#include <cstddef>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "board_snapshot.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief 静的評価の重み
+    ///
+    /// 各項は残りショット数の割合 f = (16 - shot) / 16 に応じて重みを変えます．エンドが終わった盤面(f = 0)の評価値は実際の得点と一致します．
+    struct EvaluatorWeights
+    {
+        float count_uncertainty = 0.5f; ///< ショットが残っている場合に No.1 ストーン側の得点を割り引く割合(f = 1 のとき)
+        float house = 0.2f;             ///< 得点にならないハウス内のストーン1個あたりの値(f = 1 のとき)
+        float guard = 0.15f;            ///< フリーガードゾーン内のハウス前のガード1個あたりの値(f = 1 のとき)
+        float hammer = 1.f;             ///< ラストストーンを持つことの値(f = 1 のとき)
+        float guard_lane_half_width = dc::coordinate::kHouseRadius; ///< ガードとみなすセンターラインからの横方向の距離
+    };
+
+    /// \brief 盤面からエンドの得点の期待値を見積もります．
+    ///
+    /// No.1 ストーンを持つチームの得点(No.1 側のストーンのうち相手の最も近いストーンより内側にあるものの数)を基本とし，
+    /// ショットが残っている場合は得点にならないハウス内のストーン，フリーガードゾーン内のガード，ラストストーンの有無を加味します．
+    /// 動的確保を行わず，ストーンごとの処理に分岐がありません．
+    ///
+    /// \param board 盤面
+    ///
+    /// \param team 評価値の基準となるチーム
+    ///
+    /// \return \p team から見たエンドの得点の見積もり[点]
+    float EvaluateBoard(BoardSnapshot const &board, dc::Team team, EvaluatorWeights const &weights = EvaluatorWeights());
+
+    /// \brief 複数の盤面をまとめて評価します．
+    ///
+    /// 盤面をSIMDレジスタのレーンに割り当て，AVX2 では8盤面，NEON では4盤面を同時に評価します．結果は EvaluateBoard() と一致します．
+    ///
+    /// \param boards 盤面の配列
+    ///
+    /// \param count 盤面数
+    ///
+    /// \param team 評価値の基準となるチーム
+    ///
+    /// \param values 出力先．\p count 要素
+    void EvaluateBoards(BoardSnapshot const *boards, size_t count, dc::Team team, float *values, EvaluatorWeights const &weights = EvaluatorWeights());
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_BOARD_EVALUATOR_HPP
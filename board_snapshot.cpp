@@ -0,0 +1,69 @@
+#include "board_snapshot.hpp"
+
+namespace obsidian
+{
+
+    BoardSnapshot BoardSnapshot::FromGameState(dc::GameState const &game_state)
+    {
+        BoardSnapshot snapshot{};
+        snapshot.SetStones(game_state.stones);
+        snapshot.end = game_state.end;
+        snapshot.shot = game_state.shot;
+        snapshot.hammer = static_cast<std::uint8_t>(game_state.hammer);
+        for (size_t team = 0; team < 2; ++team)
+        {
+            snapshot.scores[team] = static_cast<std::uint16_t>(game_state.GetTotalScore(static_cast<dc::Team>(team)));
+        }
+        return snapshot;
+    }
+
+    void BoardSnapshot::SetStones(dc::GameState::Stones const &game_stones)
+    {
+        exists = 0;
+        for (size_t team = 0; team < 2; ++team)
+        {
+            for (size_t i = 0; i < game_stones[team].size(); ++i)
+            {
+                size_t const index = team * game_stones[team].size() + i;
+                if (auto const &stone = game_stones[team][i])
+                {
+                    stones[index] = Stone{ stone->position.x, stone->position.y, stone->angle };
+                    exists |= static_cast<std::uint16_t>(1u << index);
+                }
+            }
+        }
+    }
+
+    dc::GameState::Stones BoardSnapshot::ToGameStones() const
+    {
+        dc::GameState::Stones game_stones;
+        for (size_t team = 0; team < 2; ++team)
+        {
+            for (size_t i = 0; i < game_stones[team].size(); ++i)
+            {
+                size_t const index = team * game_stones[team].size() + i;
+                if (HasStone(index))
+                {
+                    game_stones[team][i].emplace(dc::Vector2(stones[index].x, stones[index].y), stones[index].angle);
+                }
+            }
+        }
+        return game_stones;
+    }
+
+    void BoardSnapshot::ToAllStones(dc::ISimulator::AllStones &all_stones) const
+    {
+        for (size_t i = 0; i < kStoneCount; ++i)
+        {
+            if (HasStone(i))
+            {
+                all_stones[i].emplace(dc::Vector2(stones[i].x, stones[i].y), stones[i].angle, dc::Vector2(), 0.f);
+            }
+            else
+            {
+                all_stones[i].reset();
+            }
+        }
+    }
+
+} // namespace obsidian
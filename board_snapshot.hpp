@@ -0,0 +1,95 @@
+#ifndef AICY_OBSIDIAN_BOARD_SNAPSHOT_HPP
+#define AICY_OBSIDIAN_BOARD_SNAPSHOT_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "digitalcurling3/digitalcurling3.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief ティー(ハウスの中心)の位置
+    constexpr dc::Vector2 kTee(
+        dc::coordinate::GetCenterLineX(dc::coordinate::Id::kShot0),
+        dc::coordinate::GetTeeLineY(true, dc::coordinate::Id::kShot0));
+
+    /// \brief ストーンの重心がハウス内とみなされるティーからの距離の2乗．ストーンの一部でもハウスに掛かっていればハウス内とする
+    constexpr float kHouseSquaredDistance =
+        (dc::coordinate::kHouseRadius + dc::ISimulator::kStoneRadius) * (dc::coordinate::kHouseRadius + dc::ISimulator::kStoneRadius);
+
+    /// \brief 位置 \p position のストーンのティーからの距離の2乗
+    inline float GetSquaredDistanceFromTee(dc::Vector2 const &position)
+    {
+        float const dx = position.x - kTee.x;
+        float const dy = position.y - kTee.y;
+        return dx * dx + dy * dy;
+    }
+
+    /// \brief 位置 \p position のストーンがハウス内にあるか．ハウスの縁にちょうど接するストーンもハウス内とする
+    ///
+    /// 探索，ヒットの対象の選択，盤面の評価，StoneOrder はすべてこの判定(kHouseSquaredDistance 以下)に揃える．
+    inline bool IsInHouse(dc::Vector2 const &position)
+    {
+        return GetSquaredDistanceFromTee(position) <= kHouseSquaredDistance;
+    }
+
+    /// \brief 盤面の軽量なスナップショットです．
+    ///
+    /// dc::GameState と異なり動的確保を行うメンバを持たず，トリビアルにコピーできます．
+    /// 探索木のノードやワーカーへ局面を渡す際に，シミュレータの Save() / Load() と dc::GameState のコピーの代わりに使用します．
+    /// ストーンのインデックスは ISimulator::AllStones と同じ(チーム * 8 + チーム内の番号)です．
+    struct BoardSnapshot
+    {
+        static constexpr size_t kStoneCount = dc::ISimulator::kStoneMax;
+
+        /// \brief 静止しているストーン
+        struct Stone
+        {
+            float x;
+            float y;
+            float angle;
+        };
+
+        std::array<Stone, kStoneCount> stones; ///< exists のビットが立っていないストーンの値は不定
+        std::uint16_t exists;                  ///< ストーンが存在するかのビットマスク
+        std::uint8_t end;
+        std::uint8_t shot;
+        std::uint8_t hammer;                   ///< dc::Team の値
+        std::array<std::uint16_t, 2> scores;   ///< チームごとの合計得点
+
+        /// \brief 試合状況からスナップショットを作成します．
+        static BoardSnapshot FromGameState(dc::GameState const &game_state);
+
+        bool HasStone(size_t index) const { return (exists >> index & 1) != 0; }
+
+        /// \brief 次にショットを行うチーム(dc::GameState::GetNextTeam() と同じ)
+        dc::Team GetNextTeam() const
+        {
+            return static_cast<dc::Team>(shot % 2 == 0 ? 1 - hammer : hammer);
+        }
+
+        /// \brief 次のショットで投げるストーンのインデックス
+        size_t GetShotStoneIndex() const
+        {
+            return static_cast<size_t>(GetNextTeam()) * (kStoneCount / 2) + shot / 2;
+        }
+
+        /// \brief ストーンの配置を置き換えます．
+        void SetStones(dc::GameState::Stones const &game_stones);
+
+        /// \brief ストーンの配置を dc::GameState::Stones に変換します．
+        dc::GameState::Stones ToGameStones() const;
+
+        /// \brief 静止したストーンの配置をシミュレータ用の形式に変換します．
+        void ToAllStones(dc::ISimulator::AllStones &all_stones) const;
+    };
+
+    static_assert(std::is_trivially_copyable_v<BoardSnapshot>, "BoardSnapshot must be trivially copyable");
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_BOARD_SNAPSHOT_HPP
@@ -0,0 +1,702 @@
+#include "engine.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include "batch_simulator.hpp"
+#include "board_snapshot.hpp"
+#include "remote_rollout.hpp"
+#include "rollout.hpp"
+#include "stone_order.hpp"
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        /// \brief BatchSimulatorFCV1 の停止位置のずれの許容値[m]
+        constexpr float kBatchSimulatorTolerance = 0.01f;
+
+        /// \brief 探索の根の訪問回数がこれに満たない場合は，最も近い相手のストーンへのヒットを選ぶ
+        constexpr size_t kMinLookaheadVisits = 64;
+
+        /// \brief 先読み結果をそのまま採用するストーン位置のずれの許容値
+        constexpr float kPonderReuseTolerance = 0.005f;
+
+        /// \brief 先読み結果を探索の初期値とするストーン位置のずれの許容値
+        constexpr float kPonderHintTolerance = 0.05f;
+
+        /// \brief ヒットの速度の成否の境界を挟むために最初に試行する対象到達時の速度
+        constexpr std::array<float, 6> kSweepSpeeds = { 0.5f, 1.f, 1.5f, 2.f, 2.5f, 3.f };
+
+        /// \brief ヒットの速度の境界を狭める1回の並列試行の最大数
+        constexpr size_t kMaxBoundarySpeeds = 8;
+
+        /// \brief ヒットの速度の境界を求める精度[m/s]
+        constexpr float kBoundaryResolution = 0.05f;
+
+        /// \brief ブレのある試行で比較するヒットの速度の，境界からの余裕[m/s]
+        constexpr std::array<float, 3> kSpeedMargins = { 0.f, 0.3f, 0.8f };
+
+        /// \brief ヒットの対象到達時の速度の上限．境界が見つからない場合はこの速度を使う．
+        constexpr float kMaxHitSpeed = 3.5f;
+
+    } // unnamed namespace
+
+    Engine::Engine()
+        : Engine(Options())
+    {
+    }
+
+    Engine::Engine(Options const &options)
+        : options_(options)
+        , log_(options.log)
+        , noise_seed_random_(std::random_device()())
+        , ponder_thread_(options.log)
+    {
+    }
+
+    Engine::~Engine() = default;
+
+    /// \brief ティー(ハウスの中心)からの距離でストーンをソートする．
+    ///
+    /// \param result 出力先パラメータ．ソート結果のインデックスが格納される．盤面上に無いストーンは末尾に並ぶ．
+    ///
+    /// \param stones ストーンの配置
+    void Engine::SortStones(std::array<StoneIndex, 16> &result, dc::GameState::Stones const &stones)
+    {
+        StoneOrder order;
+        order.Build(stones);
+        for (size_t rank = 0; rank < result.size(); ++rank)
+        {
+            result[rank].team = order[rank] / kStonesPerTeam;
+            result[rank].stone = order[rank] % kStonesPerTeam;
+        }
+    }
+
+    void Engine::OnInit(
+        dc::Team team,
+        dc::GameSetting const &game_setting,
+        std::unique_ptr<dc::ISimulatorFactory> simulator_factory,
+        std::array<std::unique_ptr<dc::IPlayerFactory>, 4> player_factories,
+        std::array<size_t, 4> &player_order)
+    {
+        if (simulator_factory == nullptr || simulator_factory->GetSimulatorId() != "fcv1")
+        {
+            log_ << "warning!: Unsupported simulator!"
+                " EstimateShotVelocityFCV1() is only available for \"fcv1\" simulator." << std::endl;
+        }
+        team_ = team;
+        game_setting_ = game_setting;
+        if (!simulator_factory) {
+            simulator_factory = std::make_unique<dc::simulators::SimulatorFCV1Factory>();
+        }
+
+        // ワーカーごとにシミュレータとプレイヤーを生成する
+        // プレイヤーが非対応の場合は NormalDistプレイヤーを使用する．
+        std::array<dc::IPlayerFactory const*, 4> ordered_player_factories;
+        for (size_t i = 0; i < ordered_player_factories.size(); ++i) {
+            ordered_player_factories[i] = player_factories[player_order[i]].get();
+        }
+        if (options_.thread_pool)
+        {
+            worker_pool_ = std::make_unique<WorkerPool>(*simulator_factory, ordered_player_factories, options_.thread_pool);
+        }
+        else
+        {
+            worker_pool_ = std::make_unique<WorkerPool>(*simulator_factory, ordered_player_factories, options_.worker_count);
+        }
+        log_ << "worker pool: " << worker_pool_->GetWorkerCount() << " workers" << std::endl;
+
+        // まとめてシミュレーションを行う BatchSimulatorFCV1 が試合のシミュレータと一致するか確認する
+        batch_simulator_validated_ = false;
+        if (simulator_factory->GetSimulatorId() == "fcv1")
+        {
+            auto const validation = ValidateBatchSimulatorFCV1(*simulator_factory, {}, kBatchSimulatorTolerance);
+            batch_simulator_validated_ = validation.passed;
+            log_ << "batch simulator: max error " << validation.max_position_error << " m over "
+                << validation.board_count << " boards" << (validation.passed ? "" : " (disabled)") << std::endl;
+        }
+        // 一致した場合はロールアウトを仮想関数を介さない BoardSimulatorFCV1 で行う
+        worker_pool_->EnableSimulatorFCV1(batch_simulator_validated_);
+
+        // 評価ノードにも同じシミュレータで試行させる．接続は探索と並行して進む
+        remote_client_.reset();
+        if (!options_.remote_nodes.empty())
+        {
+            remote_client_ = std::make_unique<RemoteRolloutClient>(options_.remote_nodes, game_setting_, *simulator_factory, batch_simulator_validated_);
+        }
+
+        // ずれ角のテーブルを準備する
+        velocity_table_ = options_.velocity_table ? options_.velocity_table : PrepareVelocityTable(options_.cache_path, &log_);
+        if (MakeCacheKey(*simulator_factory) != VelocityTable::GetCacheKey())
+        {
+            log_ << "warning!: Velocity table is built for \"" << VelocityTable::GetCacheKey()
+                << "\", but the game uses \"" << MakeCacheKey(*simulator_factory) << "\"." << std::endl;
+        }
+        solver_simulator_ = dc::simulators::SimulatorFCV1Factory().CreateSimulator();
+
+        // 定跡は FCV1 での探索結果なので，シミュレータが異なる場合は使用しない
+        opening_book_ = options_.opening_book ? options_.opening_book : PrepareOpeningBook(options_.cache_path, &log_);
+        if (MakeCacheKey(*simulator_factory) != VelocityTable::GetCacheKey())
+        {
+            opening_book_.reset();
+        }
+
+        // 共通乱数は探索と先読みで共有する
+        common_noise_.Generate(options_.noise_sequence, noise_seed_random_());
+        LookaheadSearch::Options search_options;
+        search_options.common_noise = options_.common_random_numbers ? &common_noise_ : nullptr;
+        lookahead_search_ = std::make_unique<LookaheadSearch>(*worker_pool_, game_setting_, team_, velocity_table_.get(), search_options);
+    }
+
+    /// \brief 自チームのショットを探索します．
+    ///
+    /// 最も近い相手のストーンを除去できる最小の速度(成否の境界)をブレの無い試行の並列な二分法で求め，
+    /// 境界から余裕を持たせたいくつかの速度と回転方向の組を ShotSampler によるブレのある試行で比較して決定します．
+    /// 相手のストーンが無い場合はティーへのドローショットを返します．
+    ///
+    /// \param game_state 現在の試合状況(自チームの手番)
+    ///
+    /// \param should_continue 回転方向の試行を続けるかの判定(ShotSampler::Run() を参照)
+    ///
+    /// \param hint 近い局面の探索結果．対象のストーンが同じ場合は境界の探索を省略する．
+    Engine::SearchResult Engine::SearchShot(dc::GameState const &game_state, ContinueCondition const &should_continue, std::optional<SearchResult> const &hint)
+    {
+        using ShotRotation = dc::moves::Shot::Rotation;
+
+        std::array<StoneIndex, 16> sorted_indices;
+        SortStones(sorted_indices, game_state.stones);
+
+        size_t const player_index = game_state.shot / 4;
+
+        // フリーガードゾーンのルールで除去が取り消されうるショットは ApplyMove で最後まで試行する
+        bool const free_guard_zone = game_setting_.five_rock_rule && game_state.shot < 5;
+
+        // 試行ごとの局面のコピーとシミュレータの Load() を避けるため，盤面を一度だけスナップショットにする
+        auto const board = BoardSnapshot::FromGameState(game_state);
+
+        // 投げたストーンは PlaceShot() と同じく次にショットを行うチームの枠に置かれる(ショット番号の偶奇とはハンマーによって異なる)
+        size_t const shooter_index = board.GetShotStoneIndex();
+        size_t const shooter_team = shooter_index / kStonesPerTeam;
+        size_t const shooter_stone = shooter_index % kStonesPerTeam;
+        assert(!game_state.stones[shooter_team][shooter_stone]);
+
+        // ブレの無いショットの停止後のストーンを置換表を使って求める
+        auto const stones_key = TranspositionTable::ComputeStonesKey(game_state.stones);
+        auto simulate_noiseless = [this, &game_state, &board, free_guard_zone, stones_key](WorkerPool::Worker &worker, dc::moves::Shot const &candidate)
+        {
+            std::uint64_t const key = stones_key ^ TranspositionTable::ComputeShotKey(game_state, candidate);
+            if (auto stones = transposition_table_.Find(key))
+            {
+                CountTelemetry(TelemetryCounter::kCacheHit);
+                return *stones;
+            }
+            CountTelemetry(TelemetryCounter::kCacheMiss);
+
+            ++simulation_count_;
+            dc::GameState::Stones stones;
+            if (!free_guard_zone)
+            {
+                stones = worker.VisitSimulator([&](auto &simulator)
+                {
+                    return RunRollout(game_setting_, simulator, *worker.noiseless_player, board, candidate);
+                });
+            }
+            else
+            {
+                worker.simulator->Load(*worker.simulator_storage);
+                CountTelemetry(TelemetryCounter::kSimulatorLoad);
+                auto &temp_game_state = worker.scratch_game_state;
+                temp_game_state = game_state;
+                dc::Move temp_move = candidate;
+                dc::ApplyMove(game_setting_, *worker.simulator, *worker.noiseless_player, temp_game_state, temp_move, std::chrono::milliseconds(0));
+                CountTelemetry(TelemetryCounter::kApplyMove);
+                stones = temp_game_state.stones;
+            }
+            transposition_table_.Store(key, stones);
+            return stones;
+        };
+
+        // ワーカー上でショットを1回試行し，評価値を返す．結果が確定した時点でシミュレーションを打ち切る．
+        // 共通乱数を使う場合は，候補ごとの sample 回目の試行に同じブレを加えてからブレの無いプレイヤーで投げる．
+        auto rollout = [this, &game_state, &board, player_index, free_guard_zone](WorkerPool::Worker &worker, dc::moves::Shot const &shot, size_t sample, RolloutPredicate const &predicate)
+        {
+            auto const &noise_model = worker.noise_models[player_index];
+            bool const common_noise = options_.common_random_numbers && noise_model.has_value();
+            dc::moves::Shot const candidate = common_noise ? noise_model->Apply(shot, common_noise_[sample]) : shot;
+            dc::IPlayer &player = common_noise ? *worker.noiseless_player : *worker.players[player_index];
+            if (!free_guard_zone)
+            {
+                return worker.VisitSimulator([&](auto &simulator)
+                {
+                    return RunEarlyExitRollout(game_setting_, simulator, player, board, candidate, predicate).value;
+                });
+            }
+            worker.simulator->Load(*worker.simulator_storage);
+            CountTelemetry(TelemetryCounter::kSimulatorLoad);
+            auto &temp_game_state = worker.scratch_game_state;
+            temp_game_state = game_state;
+            dc::Move temp_move = candidate;
+            dc::ApplyMove(game_setting_, *worker.simulator, player, temp_game_state, temp_move, std::chrono::milliseconds(0));
+            CountTelemetry(TelemetryCounter::kApplyMove);
+            return predicate(temp_game_state.stones, true).value_or(0.);
+        };
+
+        for (auto const idx : sorted_indices)
+        {
+            if (idx.team == static_cast<size_t>(team_))
+                continue;
+            auto const stone = game_state.stones[idx.team][idx.stone];
+            if (!stone.has_value()) break;
+
+            // ブレの無い試行で，自分の石が残り対象の石を除去できる最小の速度(成否の境界)を求める
+            auto const take_out = MakeTakeOutPredicate(shooter_team, shooter_stone, idx.team, idx.stone);
+            auto evaluate_speeds = [&](float const *speeds, bool *succeeded, size_t count)
+            {
+                worker_pool_->Run(count, [&](WorkerPool::Worker &worker, size_t i)
+                {
+                    dc::moves::Shot const candidate{ EstimateShotVelocityFCV1(stone->position, speeds[i], ShotRotation::kCCW, velocity_table_.get()), ShotRotation::kCCW };
+                    succeeded[i] = take_out(simulate_noiseless(worker, candidate), true).value_or(0.) > 0.;
+                });
+            };
+
+            std::optional<float> boundary_speed;
+            if (hint && hint->target && hint->target->team == idx.team && hint->target->stone == idx.stone)
+            {
+                boundary_speed = hint->boundary_speed;
+            }
+            else
+            {
+                // 粗い速度をまとめて試行し，成功した最小の速度とその1段下の速度で境界を挟む
+                std::array<bool, kSweepSpeeds.size()> sweep_succeeded{};
+                evaluate_speeds(kSweepSpeeds.data(), sweep_succeeded.data(), kSweepSpeeds.size());
+                auto const first_success = std::find(sweep_succeeded.begin(), sweep_succeeded.end(), true) - sweep_succeeded.begin();
+                if (first_success < static_cast<std::ptrdiff_t>(kSweepSpeeds.size()))
+                {
+                    float low = first_success > 0 ? kSweepSpeeds[first_success - 1] : 0.f;
+                    float high = kSweepSpeeds[first_success];
+
+                    // 区間を等分する速度をワーカー数だけ並列に試行して境界を狭める(並列化した二分法)
+                    std::array<float, kMaxBoundarySpeeds> speeds;
+                    std::array<bool, kMaxBoundarySpeeds> succeeded;
+                    size_t const count = std::clamp<size_t>(worker_pool_->GetWorkerCount(), 1, kMaxBoundarySpeeds);
+                    while (high - low > kBoundaryResolution)
+                    {
+                        for (size_t i = 0; i < count; ++i)
+                        {
+                            speeds[i] = low + (high - low) * static_cast<float>(i + 1) / static_cast<float>(count + 1);
+                        }
+                        evaluate_speeds(speeds.data(), succeeded.data(), count);
+                        size_t i = 0;
+                        while (i < count && !succeeded[i])
+                            ++i;
+                        if (i > 0)
+                            low = speeds[i - 1];
+                        if (i < count)
+                            high = speeds[i];
+                    }
+                    boundary_speed = high;
+                }
+            }
+
+            // 境界から余裕を持たせた速度と回転方向の組を候補とし，ブレのある試行で比較する
+            // 境界ぎりぎりの速度はブレで失敗しやすく，速すぎる速度は自分の石が残りにくい．
+            // 評価値は自分の石が残れば1点，対象の石を除去できれば1点とする．
+            std::vector<dc::moves::Shot> candidate_shots;
+            std::vector<float> candidate_speeds;
+            for (float const margin : kSpeedMargins)
+            {
+                float const speed = boundary_speed ? std::min(*boundary_speed + margin, kMaxHitSpeed) : kMaxHitSpeed;
+                if (!candidate_speeds.empty() && speed <= candidate_speeds.back())
+                    break;
+                for (auto const rotation : { ShotRotation::kCCW, ShotRotation::kCW })
+                {
+                    candidate_shots.push_back({ EstimateShotVelocityFCV1(stone->position, speed, rotation, velocity_table_.get()), rotation });
+                    candidate_speeds.push_back(speed);
+                }
+            }
+
+            auto const take_out_score = MakeTakeOutScorePredicate(shooter_team, shooter_stone, idx.team, idx.stone);
+            ShotSampler sampler(*worker_pool_);
+            size_t const best = sampler.Run(candidate_shots.size(), [&](WorkerPool::Worker &worker, size_t candidate, size_t sample)
+            {
+                return rollout(worker, candidate_shots[candidate], sample, take_out_score);
+            }, should_continue);
+            simulation_count_ += sampler.GetTotalSamples();
+
+            SearchResult result{ candidate_shots[best], idx, candidate_speeds[best], boundary_speed, sampler.GetTotalSamples(), {} };
+            for (size_t i = 0; i < candidate_shots.size(); ++i)
+            {
+                auto const &stats = sampler.GetStats()[i];
+                result.estimates.push_back({ candidate_shots[i], candidate_speeds[i], stats.GetMean(), sampler.GetConfidenceHalfWidth(i), stats.count, sampler.IsActive(i) });
+            }
+            return result;
+        }
+
+        auto const v0 = EstimateShotVelocityFCV1(kTee, 0.f, ShotRotation::kCCW, velocity_table_.get());
+        return SearchResult{ dc::moves::Shot{v0, ShotRotation::kCCW}, std::nullopt, 0.f, std::nullopt, 0, {} };
+    }
+
+    /// \brief 実際に投げるショットの初速を高精度の逆算で求め直します．
+    ///
+    /// 探索中の候補ショットはテーブルによる推定で済ませているので，採用したショットだけ目標地点に収束するまでシミュレーションで修正する．
+    dc::moves::Shot Engine::RefineShot(dc::Vector2 const &target, float target_speed, dc::moves::Shot::Rotation rotation)
+    {
+        TelemetryPhaseTimer timer(TelemetryPhase::kRefine);
+        auto const solution = SolveShotVelocityFCV1(target, target_speed, rotation, ShotPrecision::kFinal, velocity_table_.get(), solver_simulator_.get());
+        log_ << "  solver  : " << solution.iterations << " iterations, error " << solution.error << " m" << std::endl;
+        return dc::moves::Shot{ solution.velocity, rotation };
+    }
+
+    dc::Move Engine::OnMyTurn(dc::GameState const &game_state)
+    {
+        std::atomic<bool> const never_cancelled{false};
+        return OnMyTurn(game_state, never_cancelled);
+    }
+
+    dc::Move Engine::OnMyTurn(dc::GameState const &game_state, std::atomic<bool> const &cancel_requested)
+    {
+        time_manager_.StartTurn(game_setting_, game_state, team_);
+        log_ << "  time budget: " << time_manager_.GetBudget().count() << " ms" << std::endl;
+
+        ponder_thread_.Stop();
+        ResetArena();
+        common_noise_.Generate(options_.noise_sequence, noise_seed_random_());
+
+        // 先読みの分を除くため，先読みを止めてからの集計の差分をこのターンの集計とする
+        TelemetryScope telemetry_scope(thread_telemetry_);
+        auto const telemetry_start = CollectTelemetry();
+
+        auto const move = ChooseMove(game_state, cancel_requested);
+        log_ << "  arena   : " << ResetArena() / 1024 << " KiB peak" << std::endl;
+        ++turn_count_;
+        thinking_time_ += time_manager_.GetElapsed();
+
+        auto const telemetry = CollectTelemetry() - telemetry_start;
+        game_telemetry_ += telemetry;
+        if (options_.log)
+        {
+            options_.log->LogTelemetry(LogLevel::kInfo, telemetry, false);
+        }
+        return move;
+    }
+
+    /// \brief 探索の作業領域を空にし，使用量の最大値を試合の統計に反映する．先読みの停止中に呼び出す必要がある．
+    ///
+    /// \return 前回の呼出しからの使用量の最大値[byte]
+    size_t Engine::ResetArena()
+    {
+        size_t const peak = worker_pool_->ResetCallerArena();
+        arena_peak_bytes_ = std::max(arena_peak_bytes_, peak);
+        return peak;
+    }
+
+    /// \brief 全ワーカーと思考スレッドの集計を合算する．先読みの停止中に呼び出す必要がある．
+    TelemetryCounters Engine::CollectTelemetry() const
+    {
+        return worker_pool_->CollectTelemetry() + thread_telemetry_;
+    }
+
+    dc::Move Engine::ChooseMove(dc::GameState const &game_state, std::atomic<bool> const &cancel_requested)
+    {
+        // エンドの序盤は定跡にある局面ならそのショットを返す
+        if (opening_book_)
+        {
+            if (auto const shot = opening_book_->Find(game_state, game_setting_))
+            {
+                log_ << "  opening book: hit" << std::endl;
+                return *shot;
+            }
+        }
+
+        // 数ショット先まで探索する．先読みで育てた木に近い局面があれば引き継ぐ．
+        auto const reuse = lookahead_search_->SetRoot(game_state);
+        log_ << "  lookahead: " << ToString(reuse) << " " << lookahead_search_->GetRootVisits() << " visits" << std::endl;
+        auto const should_continue = [this, &cancel_requested](size_t, std::chrono::steady_clock::duration last_batch_time)
+        {
+            return !cancel_requested && time_manager_.GetRemaining() >= last_batch_time;
+        };
+        // エンドの終盤は評価ノードにも試行を依頼する
+        bool const use_remote = remote_client_ && game_state.shot >= options_.remote_min_shot;
+        size_t const remote_received = use_remote ? remote_client_->GetReceivedCount() : 0;
+        size_t const remote_missed = use_remote ? remote_client_->GetMissedCount() : 0;
+        lookahead_search_->SetRemoteClient(use_remote ? remote_client_.get() : nullptr);
+        {
+            TelemetryPhaseTimer timer(TelemetryPhase::kLookahead);
+            simulation_count_ += lookahead_search_->Run(should_continue);
+        }
+        lookahead_search_->SetRemoteClient(nullptr);
+        if (use_remote)
+        {
+            log_ << "  remote: " << remote_client_->GetConnectedNodeCount() << " nodes, "
+                << remote_client_->GetReceivedCount() - remote_received << " received, "
+                << remote_client_->GetMissedCount() - remote_missed << " missed" << std::endl;
+        }
+
+        auto estimates = lookahead_search_->GetRootEstimates();
+        std::sort(estimates.begin(), estimates.end(), [](auto const &a, auto const &b) { return a.visits > b.visits; });
+        if (options_.log)
+        {
+            options_.log->LogSearch(LogLevel::kInfo, SearchLog{
+                static_cast<std::uint32_t>(lookahead_search_->GetRootVisits()),
+                static_cast<std::uint32_t>(lookahead_search_->GetNodeCount()),
+                static_cast<std::uint32_t>(time_manager_.GetElapsed().count()) });
+        }
+        for (size_t i = 0; i < estimates.size() && i < 5; ++i)
+        {
+            auto const &estimate = estimates[i];
+            log_ << "    " << ToString(estimate.candidate.kind) << (estimate.candidate.shot.rotation == dc::moves::Shot::Rotation::kCCW ? " ccw" : " cw ")
+                << ": " << estimate.mean << " (n=" << estimate.visits << ", outcomes=" << estimate.outcomes << ")" << std::endl;
+        }
+
+        auto const best = lookahead_search_->GetBestShot();
+        if (cancel_requested && best)
+        {
+            // 中断された手は送信されないので，精密化は行わない
+            log_ << "  cancelled" << std::endl;
+            return best->shot;
+        }
+        if (best && lookahead_search_->GetRootVisits() >= kMinLookaheadVisits)
+        {
+            return RefineShot(best->target, best->target_speed, best->shot.rotation);
+        }
+
+        // 探索が足りない場合は，最も近い相手のストーンへのヒットを選ぶ．近い局面の先読み結果があれば利用する．
+        std::optional<SearchResult> hint;
+        if (auto const pondered = ponder_cache_.FindClosest(game_state, kPonderHintTolerance))
+        {
+            log_ << "  pondered: distance " << pondered->distance << " m, " << pondered->result.trial_count << " trials" << std::endl;
+            if (pondered->distance <= kPonderReuseTolerance && pondered->result.trial_count > 0)
+            {
+                // 先読みの初速はテーブルの推定値なので，現在の局面の的のストーンに対して求め直す
+                auto const &reused = pondered->result;
+                if (reused.target)
+                {
+                    if (auto const &target = game_state.stones[reused.target->team][reused.target->stone])
+                    {
+                        return RefineShot(target->position, reused.speed, reused.shot.rotation);
+                    }
+                }
+                return reused.shot;
+            }
+            hint = pondered->result;
+        }
+
+        auto const result = [&]
+        {
+            TelemetryPhaseTimer timer(TelemetryPhase::kSearch);
+            return SearchShot(game_state, should_continue, hint);
+        }();
+
+        log_ << "  trials  : " << result.trial_count << " (" << time_manager_.GetElapsed().count() << " ms)" << std::endl;
+        for (auto const &estimate : result.estimates)
+        {
+            log_ << "    " << (estimate.shot.rotation == dc::moves::Shot::Rotation::kCCW ? "ccw" : "cw ") << " " << estimate.speed
+                << ": " << estimate.mean << " +/- " << estimate.half_width << " (n=" << estimate.count << ")"
+                << (estimate.active ? "" : " pruned") << std::endl;
+        }
+        log_ << "  cache   : " << transposition_table_.GetHitCount() << " hits, "
+            << transposition_table_.GetMissCount() << " misses" << std::endl;
+
+        if (result.target)
+        {
+            auto const &target = game_state.stones[result.target->team][result.target->stone];
+            return RefineShot(target->position, result.speed, result.shot.rotation);
+        }
+        return result.shot;
+    }
+
+    /// \brief 相手の手番の局面から，相手のショットの結果として起こりやすい局面を予測します．
+    ///
+    /// 相手のショットとして，自チームのハウス内のストーンへのヒットとティーへのドローを考えます．
+    /// 相手は狙った地点に正確に投げてくると考え，初速は ShotPrecision::kSearch の精度で反復して求めます．
+    /// ブレの無いプレイヤーでシミュレーションした結果を，起こりやすいと考えられる順に返します．
+    std::vector<dc::GameState> Engine::PredictOpponentResults(dc::GameState const &game_state)
+    {
+        using ShotRotation = dc::moves::Shot::Rotation;
+
+        constexpr size_t kMaxHitTargets = 2;
+        constexpr float kHitSpeed = 2.f;
+
+        std::array<StoneIndex, 16> sorted_indices;
+        SortStones(sorted_indices, game_state.stones);
+
+        std::vector<dc::moves::Shot> predicted_shots;
+        size_t hit_target_count = 0;
+        for (auto const idx : sorted_indices)
+        {
+            if (hit_target_count == kMaxHitTargets)
+                break;
+            auto const &stone = game_state.stones[idx.team][idx.stone];
+            if (!stone || !IsInHouse(stone->position))
+                break; // 盤面上に無いストーンはハウス外のストーンより後に並ぶ
+            if (idx.team != static_cast<size_t>(team_))
+                continue;
+            for (auto const rotation : { ShotRotation::kCCW, ShotRotation::kCW })
+            {
+                auto const solution = SolveShotVelocityFCV1(stone->position, kHitSpeed, rotation, ShotPrecision::kSearch, velocity_table_.get(), solver_simulator_.get());
+                predicted_shots.push_back({ solution.velocity, rotation });
+            }
+            ++hit_target_count;
+        }
+        for (auto const rotation : { ShotRotation::kCCW, ShotRotation::kCW })
+        {
+            auto const solution = SolveShotVelocityFCV1(kTee, 0.f, rotation, ShotPrecision::kSearch, velocity_table_.get(), solver_simulator_.get());
+            predicted_shots.push_back({ solution.velocity, rotation });
+        }
+
+        std::vector<dc::GameState> predicted_states(predicted_shots.size(), game_state);
+        worker_pool_->Run(predicted_shots.size(), [&](WorkerPool::Worker &worker, size_t i)
+        {
+            worker.simulator->Load(*worker.simulator_storage);
+            CountTelemetry(TelemetryCounter::kSimulatorLoad);
+            dc::Move temp_move = predicted_shots[i];
+            dc::ApplyMove(game_setting_, *worker.simulator, *worker.noiseless_player, predicted_states[i], temp_move, std::chrono::milliseconds(0));
+            CountTelemetry(TelemetryCounter::kApplyMove);
+        });
+        simulation_count_ += predicted_shots.size();
+
+        // 試合が終わる局面では先読みの必要がない
+        predicted_states.erase(
+            std::remove_if(predicted_states.begin(), predicted_states.end(), [](auto const &state) { return state.game_result.has_value(); }),
+            predicted_states.end());
+        return predicted_states;
+    }
+
+    void Engine::OnOpponentTurn(dc::GameState const &game_state)
+    {
+        ponder_thread_.Stop();
+        ResetArena();
+        ponder_cache_.Clear();
+
+        if (!options_.ponder)
+            return;
+
+        ponder_thread_.Start([this, game_state](std::atomic<bool> const &stop_requested)
+        {
+            auto const predicted_states = PredictOpponentResults(game_state);
+
+            // 各予測局面は探索が足りない場合の代替なので，少ない試行回数で済ませる
+            constexpr size_t kMaxTrialCount = 64;
+            for (auto const &predicted_state : predicted_states)
+            {
+                if (stop_requested)
+                    return;
+                auto const result = SearchShot(predicted_state, [&stop_requested](size_t trial_count, auto)
+                {
+                    return !stop_requested && trial_count < kMaxTrialCount;
+                }, std::nullopt);
+                ponder_cache_.Store(predicted_state, result);
+            }
+
+            // 相手の手番から探索し，次の自チームの手番に引き継ぐ
+            lookahead_search_->SetRoot(game_state);
+            simulation_count_ += lookahead_search_->Run([&stop_requested](size_t, auto)
+            {
+                return !stop_requested;
+            });
+        });
+    }
+
+    void Engine::OnGameOver(dc::GameState const &game_state)
+    {
+        ponder_thread_.Stop();
+        ResetArena();
+
+        if (options_.log)
+        {
+            options_.log->LogTelemetry(LogLevel::kInfo, game_telemetry_, true);
+        }
+
+        if (game_state.game_result->winner == team_)
+        {
+            log_ << "won the game" << std::endl;
+        }
+        else
+        {
+            log_ << "lost the game" << std::endl;
+        }
+    }
+
+    std::shared_ptr<VelocityTable const> Engine::PrepareVelocityTable(std::string const &cache_path, std::ostream *log)
+    {
+        std::ostream out(log ? log->rdbuf() : nullptr);
+        auto table = std::make_shared<VelocityTable>();
+        if (auto const cache = PrecomputeCache::Open(cache_path, VelocityTable::GetCacheKey()); cache && table->Load(cache))
+        {
+            out << "velocity table mapped from \"" << cache_path << "\" (max error: " << table->GetMaxError() << " m)" << std::endl;
+        }
+        else if (table->Build())
+        {
+            out << "velocity table built (max error: " << table->GetMaxError() << " m)" << std::endl;
+            // キャッシュファイルにある定跡は引き継ぐ
+            auto const opening_book = PrepareOpeningBook(cache_path, &out);
+            SavePrecomputeCache(cache_path, *table, opening_book->GetEntryCount() > 0 ? opening_book.get() : nullptr, &out);
+        }
+        else
+        {
+            out << "warning!: Velocity table error (" << table->GetMaxError() << " m) exceeds the limit."
+                " EstimateShotVelocityFCV1() falls back to simulation." << std::endl;
+        }
+        return table;
+    }
+
+    std::shared_ptr<OpeningBook const> Engine::PrepareOpeningBook(std::string const &cache_path, std::ostream *log)
+    {
+        std::ostream out(log ? log->rdbuf() : nullptr);
+        auto book = std::make_shared<OpeningBook>();
+        if (auto const cache = PrecomputeCache::Open(cache_path, VelocityTable::GetCacheKey()); cache && book->Load(cache))
+        {
+            out << "opening book mapped from \"" << cache_path << "\" (" << book->GetEntryCount() << " entries)" << std::endl;
+        }
+        return book;
+    }
+
+    bool Engine::BuildPrecomputeCache(std::string const &cache_path, std::ostream *log)
+    {
+        std::ostream out(log ? log->rdbuf() : nullptr);
+        auto const opening_book = PrepareOpeningBook(cache_path, &out);
+        VelocityTable table;
+        if (!table.Build())
+        {
+            out << "warning!: Velocity table error (" << table.GetMaxError() << " m) exceeds the limit." << std::endl;
+            return false;
+        }
+        out << "velocity table built (max error: " << table.GetMaxError() << " m)" << std::endl;
+        return SavePrecomputeCache(cache_path, table, opening_book->GetEntryCount() > 0 ? opening_book.get() : nullptr, &out);
+    }
+
+    bool Engine::SavePrecomputeCache(std::string const &cache_path, VelocityTable const &velocity_table, OpeningBook const *opening_book, std::ostream *log)
+    {
+        std::ostream out(log ? log->rdbuf() : nullptr);
+        PrecomputeCacheWriter writer(VelocityTable::GetCacheKey());
+        velocity_table.Store(writer);
+        if (opening_book)
+        {
+            opening_book->Store(writer);
+        }
+        if (!writer.Save(cache_path))
+        {
+            out << "warning!: Failed to save precompute cache to \"" << cache_path << "\"." << std::endl;
+            return false;
+        }
+        out << "precompute cache saved to \"" << cache_path << "\" (key: " << VelocityTable::GetCacheKey() << ")" << std::endl;
+        return true;
+    }
+
+    Engine::Statistics Engine::GetStatistics() const
+    {
+        Statistics statistics;
+        statistics.turn_count = turn_count_;
+        statistics.thinking_time = thinking_time_;
+        statistics.simulation_count = simulation_count_;
+        statistics.telemetry = game_telemetry_;
+        statistics.arena_peak_bytes = arena_peak_bytes_;
+        return statistics;
+    }
+
+} // namespace obsidian
@@ -0,0 +1,266 @@
+#ifndef AICY_OBSIDIAN_ENGINE_HPP
+#define AICY_OBSIDIAN_ENGINE_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "logger.hpp"
+#include "lookahead_search.hpp"
+#include "opening_book.hpp"
+#include "ponder.hpp"
+#include "shot_noise.hpp"
+#include "shot_sampler.hpp"
+#include "shot_velocity.hpp"
+#include "telemetry.hpp"
+#include "time_manager.hpp"
+#include "transposition_table.hpp"
+#include "worker_pool.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    class RemoteRolloutClient;
+
+    /// \brief 1試合分の思考エンジンです．
+    ///
+    /// 試合中の状態(チーム，試合設定，ワーカー，シミュレータ，置換表，探索木，先読み)をすべてこのオブジェクトが持つので，
+    /// 1プロセス内で複数の試合を独立に進めることができます．
+    /// スレッドとずれ角のテーブルは Options で渡せば複数のエンジンで共有できます．
+    /// OnInit() から OnGameOver() までの呼出しは，サーバーとの通信と同じ順序で行い，同時に呼び出してはいけません．
+    /// ただし OnMyTurn() は別スレッドで実行し，中断を要求することができます．
+    class Engine
+    {
+    public:
+        /// \brief エンジンの設定
+        struct Options
+        {
+            unsigned worker_count = 0;  ///< ワーカープールのワーカー数．0 の場合はハードウェアのスレッド数．thread_pool を指定した場合は無視する
+            std::shared_ptr<ThreadPool> thread_pool; ///< 他のエンジンと共有するスレッド．nullptr の場合はエンジン専用のスレッドを生成する
+            std::shared_ptr<VelocityTable const> velocity_table; ///< 他のエンジンと共有するずれ角のテーブル．nullptr の場合は OnInit() で用意する
+            std::shared_ptr<OpeningBook const> opening_book;     ///< 他のエンジンと共有する定跡．nullptr の場合は OnInit() でキャッシュファイルから読み込む
+            bool ponder = true;         ///< 相手の手番中に先読みを行うか
+            Logger *log = nullptr;      ///< ログの出力先．nullptr の場合は出力しない
+            std::string cache_path = "aicy_obsidian_cache.bin"; ///< 事前計算のキャッシュファイル．BuildPrecomputeCache() で作成する
+            bool common_random_numbers = true; ///< ブレのある試行で全候補に同じブレの列(CommonShotNoise)を加えるか．ブレを再現できないプレイヤーでは使わない
+            NoiseSequence noise_sequence = NoiseSequence::kSobol; ///< 共通乱数の列の種類
+            std::vector<std::string> remote_nodes; ///< 先読みの試行の一部を依頼する評価ノードの "ホスト:ポート" の一覧．空の場合はローカルのみで試行する
+            int remote_min_shot = 14;              ///< 評価ノードに試行を依頼する最初のショット番号(エンドの終盤のみ依頼する)
+        };
+
+        /// \brief 試合を通しての統計
+        struct Statistics
+        {
+            size_t turn_count = 0;                       ///< OnMyTurn() の呼出し回数
+            std::chrono::milliseconds thinking_time{0};  ///< OnMyTurn() に要した時間の合計
+            size_t simulation_count = 0;                 ///< 試行したショットの数(先読みを含む)
+            TelemetryCounters telemetry;                 ///< OnMyTurn() 中の処理の回数と段階ごとの時間の合計(先読みを含まない)
+            size_t arena_peak_bytes = 0;                 ///< 1ターンまたは1回の先読みでの探索の作業領域の使用量の最大値
+        };
+
+        Engine();
+        explicit Engine(Options const &options);
+        Engine(Engine const &) = delete;
+        Engine &operator=(Engine const &) = delete;
+        ~Engine();
+
+        /// \brief サーバーから送られてきた試合設定が引数として渡されるので，試合前の準備を行います．
+        ///
+        /// 引数 \p player_order を編集することでプレイヤーのショット順を変更することができます．各プレイヤーの情報は \p player_factories に格納されています．
+        /// 補足：プレイヤーはショットのブレをつかさどります．プレイヤー数は4で，0番目は0, 1投目，1番目は2, 3投目，2番目は4, 5投目，3番目は6, 7投目を担当します．
+        ///
+        /// この処理中の思考時間消費はありません．試合前に時間のかかる処理を行う場合この中で行うべきです．
+        ///
+        /// \param team この思考エンジンのチームID．
+        ///     Team::k0 の場合，最初のエンドの先攻です．
+        ///     Team::k1 の場合，最初のエンドの後攻です．
+        ///
+        /// \param game_setting 試合設定．
+        ///
+        /// \param simulator_factory 試合で使用されるシミュレータの情報．
+        ///     未対応のシミュレータの場合 nullptr が格納されます．
+        ///
+        /// \param player_factories 自チームのプレイヤー情報．
+        ///     未対応のプレイヤーの場合 nullptr が格納されます．
+        ///
+        /// \param player_order 出力用引数．
+        ///     プレイヤーの順番(デフォルトで0, 1, 2, 3)を変更したい場合は変更してください．
+        void OnInit(
+            dc::Team team,
+            dc::GameSetting const &game_setting,
+            std::unique_ptr<dc::ISimulatorFactory> simulator_factory,
+            std::array<std::unique_ptr<dc::IPlayerFactory>, 4> player_factories,
+            std::array<size_t, 4> &player_order);
+
+        /// \brief 自チームのターンに呼ばれます．返り値として返した行動がサーバーに送信されます．
+        ///
+        /// \param game_state 現在の試合状況．
+        ///
+        /// \return 選択する行動．この行動が自チームの行動としてサーバーに送信されます．
+        dc::Move OnMyTurn(dc::GameState const &game_state);
+
+        /// \brief 中断可能な OnMyTurn() です．
+        ///
+        /// \p cancel_requested が true になると探索を打ち切り，それまでの結果から精密化を省略した行動を返します．
+        /// 通信スレッドで思考中に次のメッセージを受信した場合など，返り値を使用しない場合に中断します．
+        ///
+        /// \param game_state 現在の試合状況．
+        ///
+        /// \param cancel_requested 中断の要求．他のスレッドから書き換えてよい．
+        ///
+        /// \return 選択する行動．
+        dc::Move OnMyTurn(dc::GameState const &game_state, std::atomic<bool> const &cancel_requested);
+
+        /// \brief 相手チームのターンに呼ばれます．
+        ///
+        /// 相手の思考中は，相手のショット結果を予測してそれぞれに対する自チームのショットを先読みし，
+        /// 残りの時間で相手の手番からの探索木を育てます．
+        /// 先読みは次の OnMyTurn (または OnGameOver) の呼出しで停止します．
+        ///
+        /// \param game_state 現在の試合状況．
+        void OnOpponentTurn(dc::GameState const &game_state);
+
+        /// \brief ゲームが正常に終了した際にはこの関数が呼ばれます．
+        ///
+        /// \param game_state 試合終了後の試合状況．
+        void OnGameOver(dc::GameState const &game_state);
+
+        /// \brief 試合を通しての統計を返します．
+        Statistics GetStatistics() const;
+
+        /// \brief ずれ角のテーブルを用意します．
+        ///
+        /// キャッシュファイル \p cache_path に使用できるテーブルがあればメモリにマップして使用し，
+        /// 無ければシミュレーションで構築してキャッシュファイルを作り直します．
+        ///
+        /// \param cache_path 事前計算のキャッシュファイル
+        ///
+        /// \param log ログの出力先．nullptr の場合は出力しない
+        ///
+        /// \return テーブル．構築に失敗した場合も IsAvailable() が false のテーブルを返す
+        static std::shared_ptr<VelocityTable const> PrepareVelocityTable(std::string const &cache_path, std::ostream *log);
+
+        /// \brief キャッシュファイルから定跡を読み込みます．
+        ///
+        /// \param cache_path 事前計算のキャッシュファイル
+        ///
+        /// \param log ログの出力先．nullptr の場合は出力しない
+        ///
+        /// \return 定跡．キャッシュファイルに定跡が無い場合は空の定跡を返す
+        static std::shared_ptr<OpeningBook const> PrepareOpeningBook(std::string const &cache_path, std::ostream *log);
+
+        /// \brief 事前計算をすべて行い，キャッシュファイルを作り直します．
+        ///
+        /// 試合の前にオフラインで実行しておくと，起動時の準備はキャッシュファイルのマップだけで済みます．
+        /// 定跡は自己対戦で構築するので，キャッシュファイルにある定跡をそのまま引き継ぎます．
+        ///
+        /// \param cache_path 事前計算のキャッシュファイル
+        ///
+        /// \param log ログの出力先．nullptr の場合は出力しない
+        ///
+        /// \return すべての事前計算に成功し，ファイルに書き出せた場合 true
+        static bool BuildPrecomputeCache(std::string const &cache_path, std::ostream *log);
+
+        /// \brief 事前計算の結果をキャッシュファイルに書き出します．
+        ///
+        /// \param cache_path 事前計算のキャッシュファイル
+        ///
+        /// \param velocity_table ずれ角のテーブル
+        ///
+        /// \param opening_book 定跡．nullptr の場合は格納しない
+        ///
+        /// \param log ログの出力先．nullptr の場合は出力しない
+        ///
+        /// \return ファイルに書き出せた場合 true
+        static bool SavePrecomputeCache(std::string const &cache_path, VelocityTable const &velocity_table, OpeningBook const *opening_book, std::ostream *log);
+
+    private:
+        /// \brief GameState::Stones のインデックス．
+        struct StoneIndex
+        {
+            size_t team;
+            size_t stone;
+        };
+
+        /// \brief 候補ショットの評価値の推定
+        struct CandidateEstimate
+        {
+            dc::moves::Shot shot;
+            float speed;       ///< 対象のストーン到達時の速度．ドローの場合は 0
+            double mean;       ///< 評価値の平均
+            double half_width; ///< 平均の95%信頼区間の半幅
+            size_t count;      ///< 試行回数
+            bool active;       ///< 除外されずに残ったか
+        };
+
+        /// \brief ショット探索の結果
+        struct SearchResult
+        {
+            dc::moves::Shot shot;
+            std::optional<StoneIndex> target; ///< ヒットの対象にした相手のストーン．ドローの場合は std::nullopt
+            float speed;                      ///< 対象のストーン到達時の速度
+            std::optional<float> boundary_speed; ///< ブレの無い試行で対象を除去できた最小の速度．見つからなかった場合は std::nullopt
+            size_t trial_count;               ///< 総試行回数
+            std::vector<CandidateEstimate> estimates;
+        };
+
+        using ContinueCondition = ShotSampler::ContinueCondition;
+
+        static void SortStones(std::array<StoneIndex, 16> &result, dc::GameState::Stones const &stones);
+
+        size_t ResetArena();
+        TelemetryCounters CollectTelemetry() const;
+        dc::Move ChooseMove(dc::GameState const &game_state, std::atomic<bool> const &cancel_requested);
+        SearchResult SearchShot(dc::GameState const &game_state, ContinueCondition const &should_continue, std::optional<SearchResult> const &hint);
+        dc::moves::Shot RefineShot(dc::Vector2 const &target, float target_speed, dc::moves::Shot::Rotation rotation);
+        std::vector<dc::GameState> PredictOpponentResults(dc::GameState const &game_state);
+
+        Options options_;
+        LogStream log_; ///< options_.log に書き込む．options_.log が nullptr の場合は何も出力しない．
+
+        dc::Team team_ = dc::Team::kInvalid;
+        dc::GameSetting game_setting_;
+        std::unique_ptr<WorkerPool> worker_pool_; ///< 各ワーカーがシミュレータとプレイヤーを持つスレッドプール
+        TimeManager time_manager_;                 ///< 思考時間の配分
+        bool batch_simulator_validated_ = false;   ///< BatchSimulatorFCV1 の結果が試合のシミュレータと一致するか
+        std::shared_ptr<VelocityTable const> velocity_table_; ///< EstimateShotVelocityFCV1() で使用するずれ角のテーブル
+        std::unique_ptr<dc::ISimulator> solver_simulator_;   ///< SolveShotVelocityFCV1() で使用する FCV1 シミュレータ．先読みスレッドとは交互に使う
+        std::shared_ptr<OpeningBook const> opening_book_;    ///< 定跡．試合のシミュレータが定跡を構築したものと異なる場合は nullptr
+        CommonShotNoise common_noise_;                       ///< ターンごとに作り直す共通乱数．先読みの停止中にのみ作り直す
+        std::mt19937_64 noise_seed_random_;                  ///< common_noise_ のシードの生成
+
+        /// \brief ブレの無いショットの結果の置換表．探索と先読みで共有する．
+        TranspositionTable transposition_table_;
+
+        /// \brief 数ショット先までの探索．ワーカープールを使用するので worker_pool_ より後に宣言する必要がある．
+        std::unique_ptr<LookaheadSearch> lookahead_search_;
+
+        /// \brief 評価ノードへの接続．options_.remote_nodes が空の場合は nullptr
+        std::unique_ptr<RemoteRolloutClient> remote_client_;
+
+        /// \brief 先読みした局面と探索結果
+        PonderCache<SearchResult> ponder_cache_;
+
+        /// \brief 先読みスレッド．ワーカープールを使用するので worker_pool_ より後に宣言する(先に破棄される)必要がある．
+        PonderThread ponder_thread_;
+
+        size_t turn_count_ = 0;
+        std::chrono::milliseconds thinking_time_{0};
+        std::atomic<size_t> simulation_count_{0}; ///< 先読みスレッドからも加算する
+        TelemetryCounters thread_telemetry_;      ///< OnMyTurn() を呼び出したスレッドでのワーカー外の処理の集計
+        TelemetryCounters game_telemetry_;        ///< 試合を通しての OnMyTurn() の集計
+        size_t arena_peak_bytes_ = 0;             ///< ResetArena() で得た作業領域の使用量の最大値
+    };
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_ENGINE_HPP
@@ -0,0 +1,168 @@
+// 思考エンジンから依頼されたロールアウトを代わりに行う評価ノードです．
+//
+// 実行例: aicy_obsidian_evaluation_node [ポート] [スレッド数]
+//
+// 思考エンジンを --remote-node <ホスト>:<ポート> を指定して起動すると，エンドの終盤のショットの探索で試行の一部をこのノードに依頼します．
+// 複数の思考エンジンから同時に接続でき，スレッドは全接続で共有します．
+
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "batch_simulator.hpp"
+#include "protocol_message.hpp"
+#include "remote_rollout.hpp"
+#include "rollout.hpp"
+#include "worker_pool.hpp"
+
+namespace dc = digitalcurling3;
+
+namespace
+{
+
+    using boost::asio::ip::tcp;
+
+    /// \brief 1回の受信で確保するバッファの大きさ
+    constexpr size_t kReadSize = 64 * 1024;
+
+    /// \brief BatchSimulatorFCV1 の停止位置のずれの許容値[m] (思考エンジンと同じ値)
+    constexpr float kBatchSimulatorTolerance = 0.01f;
+
+    /// \brief 標準出力への書込みを接続のスレッド間で排他する
+    std::mutex log_mutex;
+
+    /// \brief 完成した行を1行受信します．
+    ///
+    /// \return 改行を含まない行．接続が閉じられた場合は std::nullopt．次の呼出しまで有効
+    std::optional<std::string_view> ReadLine(tcp::socket &socket, obsidian::LineBuffer &input)
+    {
+        while (true)
+        {
+            if (auto const line = input.NextLine())
+                return line;
+            boost::system::error_code error;
+            size_t const size = socket.read_some(boost::asio::buffer(input.Prepare(kReadSize), kReadSize), error);
+            if (error)
+                return std::nullopt;
+            input.Commit(size);
+        }
+    }
+
+    /// \brief 1つの思考エンジンとの接続を，接続が閉じられるまで処理します．
+    void Serve(tcp::socket socket, std::shared_ptr<obsidian::ThreadPool> const &thread_pool)
+    {
+        obsidian::LineBuffer input;
+        auto const init_line = ReadLine(socket, input);
+        if (!init_line)
+            return;
+        auto const jinit = nlohmann::json::parse(init_line->begin(), init_line->end());
+        if (jinit.at("cmd").get<std::string>() != "init")
+            throw std::runtime_error("Unexpected cmd (expected: \"init\")");
+
+        auto const game_setting = jinit.at("game_setting").get<dc::GameSetting>();
+        auto const simulator_factory = jinit.at("simulator").get<std::unique_ptr<dc::ISimulatorFactory>>();
+        if (!simulator_factory)
+            throw std::runtime_error("Unknown simulator");
+
+        obsidian::WorkerPool pool(*simulator_factory, { nullptr, nullptr, nullptr, nullptr }, thread_pool);
+
+        // 思考エンジンが BoardSimulatorFCV1 を使う場合は，こちらでも一致を確認してから使う
+        bool fcv1_kernel = false;
+        if (jinit.value("fcv1_kernel", false) && simulator_factory->GetSimulatorId() == "fcv1")
+        {
+            fcv1_kernel = obsidian::ValidateBatchSimulatorFCV1(*simulator_factory, {}, kBatchSimulatorTolerance).passed;
+        }
+        pool.EnableSimulatorFCV1(fcv1_kernel);
+
+        std::string output;
+        obsidian::remote_message::AppendInitOk(output, pool.GetWorkerCount());
+        boost::asio::write(socket, boost::asio::buffer(output));
+        {
+            std::lock_guard lock(log_mutex);
+            std::cout << "connected: " << socket.remote_endpoint() << " (" << simulator_factory->GetSimulatorId()
+                << (fcv1_kernel ? ", fcv1 kernel" : "") << ")" << std::endl;
+        }
+
+        std::vector<dc::GameState::Stones> results;
+        size_t rollout_count = 0;
+        while (auto const line = ReadLine(socket, input))
+        {
+            auto const jin = nlohmann::json::parse(line->begin(), line->end());
+            if (jin.at("cmd").get<std::string>() != "rollout")
+                throw std::runtime_error("Unexpected cmd (expected: \"rollout\")");
+
+            auto const requests = obsidian::remote_message::ParseRollout(jin);
+            results.resize(requests.size());
+            pool.Run(requests.size(), [&](obsidian::WorkerPool::Worker &worker, size_t i)
+            {
+                results[i] = worker.VisitSimulator([&](auto &simulator)
+                {
+                    return obsidian::RunRollout(game_setting, simulator, *worker.noiseless_player, requests[i].board, requests[i].shot);
+                });
+            });
+            rollout_count += requests.size();
+
+            output.clear();
+            obsidian::remote_message::AppendResult(output, jin.at("id").get<std::uint64_t>(), results.data(), results.size());
+            boost::asio::write(socket, boost::asio::buffer(output));
+        }
+
+        std::lock_guard lock(log_mutex);
+        std::cout << "disconnected: " << rollout_count << " rollouts" << std::endl;
+    }
+
+} // unnamed namespace
+
+int main(int argc, char const *argv[])
+{
+    if (argc > 3)
+    {
+        std::cerr << "Usage: command [port] [threads]" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        auto const port = static_cast<unsigned short>(argc > 1 ? std::stoul(argv[1]) : 10100);
+        unsigned const thread_count = argc > 2 ? static_cast<unsigned>(std::stoul(argv[2])) : 0;
+        auto const thread_pool = std::make_shared<obsidian::ThreadPool>(thread_count);
+
+        boost::asio::io_context io_context;
+        tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), port));
+        std::cout << "evaluation node: port " << port << ", " << thread_pool->GetThreadCount() << " threads" << std::endl;
+
+        while (true)
+        {
+            tcp::socket socket(io_context);
+            acceptor.accept(socket);
+            socket.set_option(tcp::no_delay(true));
+
+            // 接続ごとにスレッドで処理し，試行は共有のスレッドで行う
+            std::thread([socket = std::move(socket), thread_pool]() mutable
+            {
+                try
+                {
+                    Serve(std::move(socket), thread_pool);
+                }
+                catch (std::exception &e)
+                {
+                    std::lock_guard lock(log_mutex);
+                    std::cerr << "Exception: " << e.what() << std::endl;
+                }
+            }).detach();
+        }
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef AICY_OBSIDIAN_FCV1_PHYSICS_HPP
+#define AICY_OBSIDIAN_FCV1_PHYSICS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace obsidian::fcv1
+{
+
+    /// \brief シミュレータFCV1の1フレームの秒数(SimulatorFCV1Factory のデフォルト値)
+    constexpr float kSecondsPerFrame = 0.001f;
+
+    /// \brief ストーンの半径
+    constexpr float kStoneRadius = 0.145f;
+
+    /// \brief ショット時に与えられる角速度の大きさ
+    constexpr float kShotAngularVelocity = 1.57f;
+
+    constexpr float kGravity = 9.80665f;
+    constexpr float kEpsilon = std::numeric_limits<float>::epsilon();
+
+    /// \brief 摩擦による減速の係数．減速度は (kFrictionC0 / (速さ + kFrictionC1) + kFrictionC2) * kGravity です．
+    constexpr float kFrictionC0 = 0.00200985f;
+    constexpr float kFrictionC1 = 0.06385782f;
+    constexpr float kFrictionC2 = 0.00626286f;
+
+    /// \brief カールの係数．回転角速度は kYawRateCoefficient * 速さ^kYawRateExponent です．
+    constexpr float kYawRateCoefficient = 0.00820f;
+    constexpr float kYawRateExponent = -0.8f;
+
+    /// \brief 角速度の減衰の係数．減衰量は kAngularDeceleration / max(速さ, kMinAngularSpeed) です．
+    constexpr float kAngularDeceleration = 0.025f;
+    constexpr float kMinAngularSpeed = 0.001f;
+
+    /// \brief 氷との摩擦による進行方向の加速度(負の値)
+    constexpr float LongitudinalAcceleration(float speed)
+    {
+        return -(kFrictionC0 / (speed + kFrictionC1) + kFrictionC2) * kGravity;
+    }
+
+    /// \brief 速さ \p speed のストーンが停止するまでに移動できる距離の上限．減速度は速さによらず kFrictionC2 * kGravity 以上になる．
+    constexpr float MaxTravelDistance(float speed)
+    {
+        return speed * speed / (2.f * kFrictionC2 * kGravity);
+    }
+
+    /// \brief カールによる進行方向の回転角速度
+    inline float YawRate(float speed, float angular_velocity)
+    {
+        if (std::abs(angular_velocity) <= kEpsilon)
+            return 0.f;
+        return (angular_velocity > 0.f ? 1.f : -1.f) * kYawRateCoefficient * std::pow(speed, kYawRateExponent);
+    }
+
+    /// \brief 角速度の減衰量(負の値)
+    constexpr float AngularAcceleration(float speed)
+    {
+        return -kAngularDeceleration / std::max(speed, kMinAngularSpeed);
+    }
+
+    /// \brief ストーン同士の衝突のパラメータ
+    ///
+    /// FCV1 は衝突の解決を Box2D に任せているため，ここでの値は Box2D の設定を近似したものです．
+    /// 参照シミュレータとの一致は ValidateBatchSimulatorFCV1() で確認してください．
+    struct CollisionParameters
+    {
+        float restitution = 1.f;            ///< 反発係数
+        float restitution_threshold = 1.f;  ///< この相対速度未満の衝突は反発させない(Box2D の b2_velocityThreshold)
+        float friction = 0.2f;              ///< ストーン同士の摩擦係数
+        float position_correction = 0.2f;   ///< めり込みの補正率(Box2D の b2_baumgarte)
+        float linear_slop = 0.005f;         ///< 補正しないめり込みの量(Box2D の b2_linearSlop)
+    };
+
+    /// \brief 試合のシミュレータに合わせた衝突のパラメータ
+    constexpr CollisionParameters kCollisionParameters{};
+
+} // namespace obsidian::fcv1
+
+#endif // AICY_OBSIDIAN_FCV1_PHYSICS_HPP
@@ -0,0 +1,291 @@
+#include "logger.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        /// \brief キューが空の場合に書込みスレッドが待つ時間
+        constexpr std::chrono::milliseconds kWriterIdleInterval{2};
+
+    } // unnamed namespace
+
+    Logger::Logger(std::ostream &output, LogLevel level)
+        : output_(output)
+        , level_(level)
+        , cells_(std::make_unique<Cell[]>(kQueueCapacity))
+    {
+        static_assert((kQueueCapacity & (kQueueCapacity - 1)) == 0, "kQueueCapacity must be a power of two");
+        for (size_t i = 0; i < kQueueCapacity; ++i)
+        {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        writer_thread_ = std::thread([this] { RunWriter(); });
+    }
+
+    Logger::~Logger()
+    {
+        stop_requested_ = true;
+        writer_thread_.join();
+        if (size_t const dropped = GetDroppedCount(); dropped > 0)
+        {
+            output_ << "warning!: " << dropped << " log records dropped" << std::endl;
+        }
+    }
+
+    // 以下のキューは Dmitry Vyukov の bounded MPMC queue と同じ方式．
+    // 各要素の sequence が位置と一致すれば書込み可能，位置 + 1 と一致すれば読出し可能．
+    bool Logger::TryPush(Record const &record)
+    {
+        size_t position = enqueue_position_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = cells_[position & (kQueueCapacity - 1)];
+            size_t const sequence = cell.sequence.load(std::memory_order_acquire);
+            auto const diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (diff == 0)
+            {
+                if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.record = record;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // 一杯
+            }
+            else
+            {
+                position = enqueue_position_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool Logger::TryPop(Record &record)
+    {
+        size_t position = dequeue_position_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = cells_[position & (kQueueCapacity - 1)];
+            size_t const sequence = cell.sequence.load(std::memory_order_acquire);
+            auto const diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+            if (diff == 0)
+            {
+                if (dequeue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    record = cell.record;
+                    cell.sequence.store(position + kQueueCapacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // 空
+            }
+            else
+            {
+                position = dequeue_position_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void Logger::Push(Record const &record)
+    {
+        if (!TryPush(record))
+        {
+            dropped_count_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void Logger::LogText(LogLevel level, std::string_view text)
+    {
+        if (!IsEnabled(level))
+            return;
+        Record record;
+        record.kind = Record::Kind::kText;
+        record.level = level;
+        while (!text.empty())
+        {
+            size_t const size = std::min(text.size(), kMaxTextSize);
+            std::memcpy(record.text.data(), text.data(), size);
+            record.text_size = static_cast<std::uint8_t>(size);
+            Push(record);
+            text.remove_prefix(size);
+        }
+    }
+
+    void Logger::LogShot(LogLevel level, std::uint8_t end, std::uint8_t shot)
+    {
+        if (!IsEnabled(level))
+            return;
+        Record record;
+        record.kind = Record::Kind::kShot;
+        record.level = level;
+        record.shot = Record::Shot{ end, shot };
+        Push(record);
+    }
+
+    void Logger::LogMove(LogLevel level, dc::Move const &move)
+    {
+        if (!IsEnabled(level))
+            return;
+        Record record;
+        record.kind = Record::Kind::kMove;
+        record.level = level;
+        record.move = Record::Move{ 0.f, 0.f, false, true };
+        if (std::holds_alternative<dc::moves::Shot>(move))
+        {
+            auto const &shot = std::get<dc::moves::Shot>(move);
+            record.move = Record::Move{ shot.velocity.x, shot.velocity.y, shot.rotation == dc::moves::Shot::Rotation::kCCW, false };
+        }
+        Push(record);
+    }
+
+    void Logger::LogSearch(LogLevel level, SearchLog const &search)
+    {
+        if (!IsEnabled(level))
+            return;
+        Record record;
+        record.kind = Record::Kind::kSearch;
+        record.level = level;
+        record.search = search;
+        Push(record);
+    }
+
+    void Logger::LogTelemetry(LogLevel level, TelemetryCounters const &telemetry, bool game_total)
+    {
+        if (!IsEnabled(level))
+            return;
+        Record record;
+        record.kind = Record::Kind::kTelemetry;
+        record.level = level;
+        for (size_t i = 0; i < kTelemetryCounterCount; ++i)
+        {
+            record.telemetry.counts[i] = telemetry.counts[i];
+        }
+        for (size_t i = 0; i < kTelemetryPhaseCount; ++i)
+        {
+            record.telemetry.phase_nanoseconds[i] = telemetry.phase_times[i].count();
+        }
+        record.telemetry.game_total = game_total;
+        Push(record);
+    }
+
+    void Logger::Write(Record const &record)
+    {
+        switch (record.kind)
+        {
+        case Record::Kind::kText:
+            output_.write(record.text.data(), record.text_size);
+            break;
+        case Record::Kind::kShot:
+            output_ << "[in] update (end: " << int(record.shot.end) << ", shot: " << int(record.shot.shot) << ")\n";
+            break;
+        case Record::Kind::kMove:
+            output_ << "[out] move\n";
+            if (record.move.concede)
+            {
+                output_ << "  type: concede\n";
+            }
+            else
+            {
+                output_ << "  type    : shot\n";
+                output_ << "  velocity: [" << record.move.velocity_x << ", " << record.move.velocity_y << "]\n";
+                output_ << "  rotation: " << (record.move.ccw ? "ccw" : "cw") << '\n';
+            }
+            break;
+        case Record::Kind::kSearch:
+            output_ << "  lookahead: " << record.search.visits << " visits, " << record.search.node_count
+                << " nodes (" << record.search.elapsed_ms << " ms)\n";
+            break;
+        case Record::Kind::kTelemetry:
+        {
+            TelemetryCounters telemetry;
+            for (size_t i = 0; i < kTelemetryCounterCount; ++i)
+            {
+                telemetry.counts[i] = record.telemetry.counts[i];
+            }
+            for (size_t i = 0; i < kTelemetryPhaseCount; ++i)
+            {
+                telemetry.phase_times[i] = std::chrono::nanoseconds(record.telemetry.phase_nanoseconds[i]);
+            }
+            output_ << (record.telemetry.game_total ? "telemetry (game): " : "  telemetry: ") << telemetry << '\n';
+            break;
+        }
+        }
+    }
+
+    void Logger::RunWriter()
+    {
+        Record record;
+        while (true)
+        {
+            bool written = false;
+            while (TryPop(record))
+            {
+                Write(record);
+                written = true;
+            }
+            if (written)
+            {
+                // キューを空にするたびにフラッシュする．思考中のスレッドはフラッシュを待たない
+                output_.flush();
+                continue;
+            }
+            if (stop_requested_)
+                break;
+            std::this_thread::sleep_for(kWriterIdleInterval);
+        }
+    }
+
+    LogStream::LogStream(Logger *logger, LogLevel level)
+        : std::ostream(nullptr)
+    {
+        // 出力先が無いストリームは badbit が立ち，<< は整形せずに戻る
+        if (logger && logger->IsEnabled(level))
+        {
+            buffer_ = std::make_unique<Buffer>(*logger, level);
+            rdbuf(buffer_.get());
+        }
+    }
+
+    LogStream::Buffer::Buffer(Logger &logger, LogLevel level)
+        : logger_(logger)
+        , level_(level)
+    {
+        // 最後の1文字分を overflow() 用に空けておく
+        setp(text_.data(), text_.data() + text_.size() - 1);
+    }
+
+    LogStream::Buffer::~Buffer()
+    {
+        sync();
+    }
+
+    LogStream::Buffer::int_type LogStream::Buffer::overflow(int_type ch)
+    {
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return sync() == 0 ? traits_type::not_eof(ch) : traits_type::eof();
+    }
+
+    int LogStream::Buffer::sync()
+    {
+        if (pptr() != pbase())
+        {
+            logger_.LogText(level_, std::string_view(pbase(), static_cast<size_t>(pptr() - pbase())));
+            setp(text_.data(), text_.data() + text_.size() - 1);
+        }
+        return 0;
+    }
+
+} // namespace obsidian
@@ -0,0 +1,196 @@
+#ifndef AICY_OBSIDIAN_LOGGER_HPP
+#define AICY_OBSIDIAN_LOGGER_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string_view>
+#include <thread>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "telemetry.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief ログの重要度
+    enum class LogLevel : std::uint8_t
+    {
+        kDebug,
+        kInfo,
+        kWarning,
+        kError,
+        kOff, ///< Logger の出力レベルに指定すると全てのログを無効にする
+    };
+
+    /// \brief 探索の統計のログ
+    struct SearchLog
+    {
+        std::uint32_t visits;     ///< 根の訪問回数
+        std::uint32_t node_count; ///< 探索木のノード数
+        std::uint32_t elapsed_ms; ///< ターン開始からの経過時間
+    };
+
+    /// \brief 思考や通信のスレッドから出力先への書込みを切り離すロガーです．
+    ///
+    /// ログは固定長のレコードとしてロックフリーのキューに積むだけで，文字列への整形と出力先への書込み(フラッシュを含む)は
+    /// バックグラウンドの書込みスレッドが行います．キューが一杯の場合は書き込まずに捨て，待つことはありません．
+    /// ショット，行動，探索の統計は数値のまま積み，書込みスレッドで整形します．
+    /// 無効なレベルのログは，関数の先頭の比較1回で捨てられます．
+    ///
+    /// 各関数は複数のスレッドから同時に呼び出せます．
+    class Logger
+    {
+    public:
+        /// \brief キューに積めるレコード数
+        static constexpr size_t kQueueCapacity = 4096;
+
+        /// \brief 1レコードに格納できる文字列の長さ．長い文字列は複数のレコードに分ける
+        static constexpr size_t kMaxTextSize = 232;
+
+        /// \param output 出力先．ロガーより長く存在する必要がある
+        ///
+        /// \param level 出力するログの最低の重要度
+        explicit Logger(std::ostream &output, LogLevel level = LogLevel::kInfo);
+        Logger(Logger const &) = delete;
+        Logger &operator=(Logger const &) = delete;
+
+        /// \brief キューに残ったログを全て書き込んでから終了します．
+        ~Logger();
+
+        /// \brief \p level のログが出力されるか調べます．
+        bool IsEnabled(LogLevel level) const { return level >= level_; }
+
+        /// \brief 文字列をそのまま出力します．改行は呼出し側で含めてください．
+        void LogText(LogLevel level, std::string_view text);
+
+        /// \brief update を受信した局面を出力します．
+        void LogShot(LogLevel level, std::uint8_t end, std::uint8_t shot);
+
+        /// \brief 送信する行動を出力します．
+        void LogMove(LogLevel level, dc::Move const &move);
+
+        /// \brief 探索の統計を出力します．
+        void LogSearch(LogLevel level, SearchLog const &search);
+
+        /// \brief ターンまたは試合全体の集計を出力します．
+        ///
+        /// \param game_total 試合全体の集計の場合 true
+        void LogTelemetry(LogLevel level, TelemetryCounters const &telemetry, bool game_total);
+
+        /// \brief キューが一杯で捨てたレコードの数
+        size_t GetDroppedCount() const { return dropped_count_.load(std::memory_order_relaxed); }
+
+    private:
+        struct Record
+        {
+            enum class Kind : std::uint8_t
+            {
+                kText,
+                kShot,
+                kMove,
+                kSearch,
+                kTelemetry,
+            };
+
+            struct Shot
+            {
+                std::uint8_t end;
+                std::uint8_t shot;
+            };
+
+            struct Move
+            {
+                float velocity_x;
+                float velocity_y;
+                bool ccw;
+                bool concede;
+            };
+
+            /// \brief TelemetryCounters を共用体に格納できる形にしたもの
+            struct Telemetry
+            {
+                std::uint64_t counts[kTelemetryCounterCount];
+                std::int64_t phase_nanoseconds[kTelemetryPhaseCount];
+                bool game_total;
+            };
+
+            Kind kind;
+            LogLevel level;
+            std::uint8_t text_size;
+            union
+            {
+                Shot shot;
+                Move move;
+                SearchLog search;
+                Telemetry telemetry;
+                std::array<char, kMaxTextSize> text;
+            };
+        };
+
+        /// \brief キューの要素．sequence でその位置が書込み可能か読出し可能かを表す
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            Record record;
+        };
+
+        bool TryPush(Record const &record);
+        bool TryPop(Record &record);
+        void Push(Record const &record);
+        void Write(Record const &record);
+        void RunWriter();
+
+        std::ostream &output_;
+        LogLevel const level_;
+        std::unique_ptr<Cell[]> cells_;
+        alignas(64) std::atomic<size_t> enqueue_position_{0};
+        alignas(64) std::atomic<size_t> dequeue_position_{0};
+        alignas(64) std::atomic<size_t> dropped_count_{0};
+        std::atomic<bool> stop_requested_{false};
+        std::thread writer_thread_; ///< 他のメンバより後に初期化する必要がある
+    };
+
+    /// \brief Logger に文字列のレコードとして書き込む std::ostream です．
+    ///
+    /// 既存の `<< std::endl` による出力をそのまま Logger に流すために使います．
+    /// std::endl のフラッシュはレコードをキューに積むだけで，出力先はフラッシュしません．
+    /// Logger で無効なレベルのストリームは書込み不可の状態で作るので，`<<` の整形も行いません．
+    /// 1つのストリームを同時に複数のスレッドから使ってはいけません．
+    class LogStream : public std::ostream
+    {
+    public:
+        /// \param logger 書込み先．nullptr の場合や \p level が無効な場合は何も出力しない
+        ///
+        /// \param level このストリームに書き込んだログの重要度
+        explicit LogStream(Logger *logger, LogLevel level = LogLevel::kInfo);
+
+    private:
+        class Buffer : public std::streambuf
+        {
+        public:
+            Buffer(Logger &logger, LogLevel level);
+            ~Buffer() override;
+
+        protected:
+            int_type overflow(int_type ch) override;
+            int sync() override;
+
+        private:
+            Logger &logger_;
+            LogLevel level_;
+            std::array<char, Logger::kMaxTextSize> text_;
+        };
+
+        std::unique_ptr<Buffer> buffer_;
+    };
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_LOGGER_HPP
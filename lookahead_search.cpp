@@ -0,0 +1,754 @@
+#include "lookahead_search.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include "board_evaluator.hpp"
+#include "fcv1_physics.hpp"
+#include "remote_rollout.hpp"
+#include "rollout.hpp"
+#include "shot_corridor.hpp"
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        using ShotRotation = dc::moves::Shot::Rotation;
+
+        constexpr float kStoneRadius = dc::ISimulator::kStoneRadius;
+
+        /// \brief ヒットの対象とする相手のストーンの数
+        constexpr size_t kMaxHitTargets = 4;
+
+        /// \brief フリーズの対象とする相手のストーンの数
+        constexpr size_t kMaxFreezeTargets = 2;
+
+        /// \brief ヒットの対象到達時の速度
+        constexpr float kHitSpeed = 2.5f;
+
+        /// \brief レイズの対象とする自チームのストーンの数
+        constexpr size_t kMaxRaiseTargets = 2;
+
+        /// \brief ダブルテイクアウトの候補の数
+        constexpr size_t kMaxDoubleTakeOuts = 2;
+
+        /// \brief ダブルテイクアウトの1つ目の対象到達時の速度
+        constexpr float kDoubleTakeOutSpeed = 3.f;
+
+        /// \brief 押したストーンの減速の見積もりに使う速度[m/s]
+        constexpr float kRaiseReferenceSpeed = 1.f;
+
+        /// \brief 押すストーンを送り出す方向と投げたストーンの進行方向のなす角の余弦の下限．これより薄い当たりは狙わない．
+        constexpr float kMinCutCosine = 0.5f;
+
+        /// \brief 経路が阻まれているとみなす中心間の距離．経路の近似の誤差の分だけストーンの直径より小さくする．
+        constexpr float kCorridorClearance = 2.f * kStoneRadius - 0.08f;
+
+        /// \brief フリーガードゾーン(ホグラインとティーラインの間のハウス外)にあるか
+        bool IsInFreeGuardZone(dc::Vector2 const &position, dc::GameSetting const &game_setting)
+        {
+            return IsInPlayArea(position, game_setting) && position.y < kTee.y && !IsInHouse(position);
+        }
+
+        /// \brief ストーンを押して送り出すときの，投げたストーンの接触位置
+        struct CutContact
+        {
+            dc::Vector2 position; ///< 接触時の投げたストーンの中心
+            float cosine;         ///< 送り出す方向と投げたストーンの進行方向(ほぼ奥向き)のなす角の余弦
+        };
+
+        /// \brief \p stone を \p destination へ向けて押すための接触位置を求める．当たりが薄すぎる場合は std::nullopt
+        std::optional<CutContact> GetCutContact(dc::Vector2 const &stone, dc::Vector2 const &destination)
+        {
+            dc::Vector2 const offset = destination - stone;
+            float const distance = offset.Length();
+            if (distance <= 0.f)
+                return std::nullopt;
+            dc::Vector2 const direction = offset / distance;
+            if (direction.y < kMinCutCosine)
+                return std::nullopt;
+            return CutContact{ stone - direction * (2.f * kStoneRadius), direction.y };
+        }
+
+        bool IsEndFinished(BoardSnapshot const &board)
+        {
+            return board.shot >= dc::GameState::kShotPerEnd;
+        }
+
+        /// \brief 盤面の次のショットを投げるプレイヤーの番号．相手のショットも自チームのプレイヤーで近似する．
+        size_t GetPlayerIndex(BoardSnapshot const &board)
+        {
+            return std::min<size_t>(board.shot / 4, 3);
+        }
+
+        /// \brief 盤面 \p before から \p after までに動いたか，除外されたか，追加されたストーンのビットマスク
+        std::uint16_t GetMovedStones(BoardSnapshot const &before, BoardSnapshot const &after)
+        {
+            std::uint16_t moved = before.exists ^ after.exists;
+            for (size_t i = 0; i < BoardSnapshot::kStoneCount; ++i)
+            {
+                if (before.HasStone(i) && after.HasStone(i)
+                    && (before.stones[i].x != after.stones[i].x || before.stones[i].y != after.stones[i].y))
+                {
+                    moved |= static_cast<std::uint16_t>(1u << i);
+                }
+            }
+            return moved;
+        }
+
+        /// \brief 2つの盤面のストーン位置のずれ．存在するストーンが異なる場合は無限大．
+        float GetBoardDistance(BoardSnapshot const &a, BoardSnapshot const &b)
+        {
+            if (a.exists != b.exists)
+                return std::numeric_limits<float>::infinity();
+            float distance = 0.f;
+            for (size_t i = 0; i < BoardSnapshot::kStoneCount; ++i)
+            {
+                if (a.HasStone(i))
+                {
+                    distance = std::max(distance, std::hypot(a.stones[i].x - b.stones[i].x, a.stones[i].y - b.stones[i].y));
+                }
+            }
+            return distance;
+        }
+
+    } // unnamed namespace
+
+    char const *ToString(CandidateKind kind)
+    {
+        switch (kind)
+        {
+        case CandidateKind::kDraw:
+            return "draw";
+        case CandidateKind::kGuard:
+            return "guard";
+        case CandidateKind::kHit:
+            return "hit";
+        case CandidateKind::kFreeze:
+            return "freeze";
+        case CandidateKind::kRaise:
+            return "raise";
+        case CandidateKind::kDoubleTakeOut:
+            return "double";
+        }
+        return "unknown";
+    }
+
+    std::vector<CandidateShot> GenerateCandidateShots(BoardSnapshot const &board, VelocityTable const *table)
+    {
+        StoneOrder order;
+        order.Build(board);
+        return GenerateCandidateShots(board, order, table);
+    }
+
+    std::vector<CandidateShot> GenerateCandidateShots(BoardSnapshot const &board, StoneOrder const &order, VelocityTable const *table)
+    {
+        std::vector<CandidateShot> candidates;
+
+        // 経路が他のストーンに阻まれる候補はシミュレーションせずに除く
+        // ignored_mask は経路上にあってよいストーン(対象)，end_trim は対象と接触する位置から目標地点までの長さ
+        auto add = [&](dc::Vector2 const &target, float speed, CandidateKind kind, std::uint16_t ignored_mask, float end_trim)
+        {
+            for (auto const rotation : { ShotRotation::kCCW, ShotRotation::kCW })
+            {
+                auto const velocity = EstimateShotVelocityFCV1(target, speed, rotation, table);
+                if (ShotCorridor(velocity, target).IsBlocked(board, ignored_mask, kCorridorClearance, end_trim))
+                    continue;
+                candidates.push_back({ dc::moves::Shot{ velocity, rotation }, kind, target, speed });
+            }
+        };
+
+        auto const tee = kTee;
+
+        // ティーと，ハウス内の前後左右と斜め前
+        for (auto const &offset : {
+            dc::Vector2(0.f, 0.f), dc::Vector2(-0.6f, 0.f), dc::Vector2(0.6f, 0.f), dc::Vector2(0.f, -0.9f), dc::Vector2(0.f, 0.6f),
+            dc::Vector2(-0.6f, -0.6f), dc::Vector2(0.6f, -0.6f) })
+        {
+            add(tee + offset, 0.f, CandidateKind::kDraw, 0, 0.f);
+        }
+
+        // センターガードとコーナーガード
+        for (auto const &offset : { dc::Vector2(0.f, -3.f), dc::Vector2(-0.9f, -2.6f), dc::Vector2(0.9f, -2.6f) })
+        {
+            add(tee + offset, 0.f, CandidateKind::kGuard, 0, 0.f);
+        }
+
+        // ストーンをティーに近い順に対象とする
+        size_t const own_team = static_cast<size_t>(board.GetNextTeam());
+        size_t const opponent_team = 1 - own_team;
+        auto position_of = [&board](size_t index) { return dc::Vector2(board.stones[index].x, board.stones[index].y); };
+        auto bit = [](size_t index) { return static_cast<std::uint16_t>(1u << index); };
+
+        std::array<size_t, kMaxHitTargets> hit_targets{};
+        size_t hit_count = 0;
+        size_t freeze_count = 0;
+        size_t raise_count = 0;
+        for (size_t rank = 0; rank < order.GetCount(); ++rank)
+        {
+            size_t const index = order[rank];
+            auto const stone = position_of(index);
+            if (index / kStonesPerTeam == opponent_team)
+            {
+                if (hit_count < kMaxHitTargets)
+                {
+                    add(stone, kHitSpeed, CandidateKind::kHit, bit(index), 2.f * kStoneRadius);
+                    hit_targets[hit_count++] = index;
+                }
+                if (freeze_count < kMaxFreezeTargets && rank < order.GetHouseCount())
+                {
+                    // 投げる側から見て対象の直前に止める
+                    add(dc::Vector2(stone.x, stone.y - 2.f * kStoneRadius - 0.02f), 0.f, CandidateKind::kFreeze, bit(index), 0.f);
+                    ++freeze_count;
+                }
+            }
+            else if (raise_count < kMaxRaiseTargets && stone.y < tee.y && std::abs(stone.x - tee.x) < dc::coordinate::kHouseRadius)
+            {
+                // ハウスの手前の自チームのストーンを押してティーへ運ぶ
+                auto const contact = GetCutContact(stone, tee);
+                if (contact)
+                {
+                    float const travel = (tee - stone).Length();
+                    float const speed = std::sqrt(2.f * -fcv1::LongitudinalAcceleration(kRaiseReferenceSpeed) * travel) / contact->cosine;
+                    add(contact->position, speed, CandidateKind::kRaise, bit(index), 0.f);
+                    ++raise_count;
+                }
+            }
+        }
+
+        // ティーに近い相手のストーンを，もう1つの相手のストーンへ向けて弾き出す
+        size_t double_count = 0;
+        for (size_t i = 0; i < hit_count && double_count < kMaxDoubleTakeOuts; ++i)
+        {
+            for (size_t j = 0; j < hit_count && double_count < kMaxDoubleTakeOuts; ++j)
+            {
+                if (i == j)
+                    continue;
+                auto const first = position_of(hit_targets[i]);
+                auto const second = position_of(hit_targets[j]);
+                auto const contact = GetCutContact(first, second);
+                if (!contact)
+                    continue;
+
+                // 弾いたストーンの通り道に他のストーンがあれば2つ目には届かない
+                bool blocked = false;
+                for (size_t k = 0; k < BoardSnapshot::kStoneCount && !blocked; ++k)
+                {
+                    if (k != hit_targets[i] && k != hit_targets[j] && board.HasStone(k))
+                        blocked = GetSegmentDistance(position_of(k), first, second) < kCorridorClearance;
+                }
+                if (blocked)
+                    continue;
+
+                add(contact->position, kDoubleTakeOutSpeed, CandidateKind::kDoubleTakeOut, bit(hit_targets[i]), 0.f);
+                ++double_count;
+            }
+        }
+
+        return candidates;
+    }
+
+    struct LookaheadSearch::ChanceNode
+    {
+        CandidateShot candidate;
+        std::vector<std::unique_ptr<DecisionNode>> outcomes;
+        double value_sum = 0.; ///< team_ から見た評価値の合計
+        size_t visits = 0;
+        size_t pending = 0;    ///< 評価待ちの試行の数(仮想損失)
+    };
+
+    struct LookaheadSearch::DecisionNode
+    {
+        BoardSnapshot board;
+        StoneOrder order;         ///< board のストーンのティーからの距離順．試行結果のノードは親の順序から動いたストーンだけ更新する
+        double static_value = 0.; ///< 盤面の静的な評価値
+        std::vector<ChanceNode> children;
+        bool expanded = false;
+        size_t visits = 0;
+    };
+
+    /// \brief 1回の試行．探索木のたどった経路と試行の結果を保持する．経路はバッチの作業領域に置く．
+    struct LookaheadSearch::Job
+    {
+        explicit Job(Arena &arena)
+            : path(ArenaAllocator<ChanceNode *>(arena))
+            , nodes(ArenaAllocator<DecisionNode *>(arena))
+        {
+        }
+
+        ArenaVector<ChanceNode *> path; ///< 根から順に選んだ確率ノード．末尾が試行する候補
+        ArenaVector<DecisionNode *> nodes; ///< path の各要素の親
+        size_t sample = 0;                 ///< 試行する確率ノードでの試行結果の通し番号(GetCommonNoiseShot() を参照)
+        BoardSnapshot result;
+        double value = 0.;
+    };
+
+    LookaheadSearch::LookaheadSearch(
+        WorkerPool &worker_pool,
+        dc::GameSetting const &game_setting,
+        dc::Team team,
+        VelocityTable const *table,
+        Options const &options)
+        : worker_pool_(worker_pool)
+        , game_setting_(game_setting)
+        , team_(team)
+        , table_(table)
+        , options_(options)
+    {
+        if (options_.batch_size == 0)
+        {
+            options_.batch_size = worker_pool_.GetWorkerCount() * 4;
+        }
+    }
+
+    LookaheadSearch::~LookaheadSearch() = default;
+
+    char const *ToString(LookaheadSearch::RootReuse reuse)
+    {
+        switch (reuse)
+        {
+        case LookaheadSearch::RootReuse::kNone:
+            return "new";
+        case LookaheadSearch::RootReuse::kSubtree:
+            return "reused";
+        case LookaheadSearch::RootReuse::kStatistics:
+            return "warm-started";
+        }
+        return "unknown";
+    }
+
+    LookaheadSearch::RootReuse LookaheadSearch::SetRoot(dc::GameState const &game_state)
+    {
+        auto const board = BoardSnapshot::FromGameState(game_state);
+        auto &arena = worker_pool_.GetCallerArena();
+        ArenaScope scratch_scope(arena);
+
+        // 同じエンドの同じショット番号のノードから最も近いものを探す
+        // 評価値を引き継ぐのは展開済みのノードのみ
+        std::unique_ptr<DecisionNode> *closest = nullptr;
+        std::unique_ptr<DecisionNode> *closest_expanded = nullptr;
+        float closest_distance = std::numeric_limits<float>::infinity();
+        float closest_expanded_distance = options_.warm_start_tolerance;
+        if (root_ && root_->board.end == board.end && root_->board.shot <= board.shot)
+        {
+            using NodeSlots = ArenaVector<std::unique_ptr<DecisionNode> *>;
+            NodeSlots frontier({ &root_ }, NodeSlots::allocator_type(arena));
+            while (!frontier.empty())
+            {
+                NodeSlots next{ NodeSlots::allocator_type(arena) };
+                for (auto *slot : frontier)
+                {
+                    auto &node = **slot;
+                    if (node.board.shot == board.shot)
+                    {
+                        float const distance = GetBoardDistance(node.board, board);
+                        if (distance < closest_distance)
+                        {
+                            closest = slot;
+                            closest_distance = distance;
+                        }
+                        if (node.expanded && distance <= closest_expanded_distance)
+                        {
+                            closest_expanded = slot;
+                            closest_expanded_distance = distance;
+                        }
+                        continue;
+                    }
+                    for (auto &child : node.children)
+                    {
+                        for (auto &outcome : child.outcomes)
+                            next.push_back(&outcome);
+                    }
+                }
+                frontier = std::move(next);
+            }
+        }
+
+        RootReuse reuse = RootReuse::kNone;
+        if (closest && closest_distance <= options_.reuse_tolerance)
+        {
+            if (closest != &root_)
+                root_ = std::move(*closest);
+            reuse = RootReuse::kSubtree;
+        }
+        else if (closest_expanded)
+        {
+            // 木の残りを破棄する前に，引き継ぐノードを取り出しておく
+            auto const source = std::move(*closest_expanded);
+            root_ = std::make_unique<DecisionNode>();
+            root_->board = board;
+            root_->order.Build(board); // InheritStatistics() で展開する
+            InheritStatistics(*source);
+            reuse = RootReuse::kStatistics;
+        }
+        else
+        {
+            root_ = std::make_unique<DecisionNode>();
+        }
+        root_->board = board;
+        root_->order.Build(board);
+        root_->static_value = EvaluateBoard(board, team_);
+
+        // 引き継いだ部分木のノード数を数え直す
+        node_count_ = 0;
+        ArenaVector<DecisionNode const *> stack({ root_.get() }, ArenaAllocator<DecisionNode const *>(arena));
+        while (!stack.empty())
+        {
+            auto const *node = stack.back();
+            stack.pop_back();
+            ++node_count_;
+            for (auto const &child : node->children)
+            {
+                for (auto const &outcome : child.outcomes)
+                    stack.push_back(outcome.get());
+            }
+        }
+        return reuse;
+    }
+
+    size_t LookaheadSearch::Run(ContinueCondition const &should_continue)
+    {
+        size_t trial_count = 0;
+        std::chrono::steady_clock::duration last_batch_time{};
+        auto &arena = worker_pool_.GetCallerArena();
+        while (root_ && should_continue(root_->visits, last_batch_time))
+        {
+            auto const batch_start = std::chrono::steady_clock::now();
+
+            // バッチの試行の経路と葉の盤面は，バッチの終わりにまとめて破棄する
+            ArenaScope batch_scope(arena);
+            // 評価ノードがあれば，そのワーカー数に比例してバッチを大きくする
+            size_t const remote_workers = remote_ ? remote_->GetIdleWorkerCount() : 0;
+            size_t const batch_size = options_.batch_size + options_.batch_size * remote_workers / worker_pool_.GetWorkerCount();
+            ArenaVector<Job> jobs{ ArenaAllocator<Job>(arena) };
+            jobs.reserve(batch_size);
+            CollectJobs(jobs, arena, batch_size);
+            if (jobs.empty())
+                break; // これ以上広げられない
+
+            try
+            {
+                if (remote_workers > 0)
+                {
+                    RunRemoteJobs(jobs, arena);
+                }
+                else
+                {
+                    worker_pool_.Run(jobs.size(), [this, &jobs](WorkerPool::Worker &worker, size_t i)
+                    {
+                        RunJob(worker, jobs[i]);
+                    });
+                }
+            }
+            catch (...)
+            {
+                // 仮想損失が残った木は使えない
+                root_.reset();
+                node_count_ = 0;
+                throw;
+            }
+
+            // 葉の盤面はまとめて評価する
+            ArenaVector<BoardSnapshot> leaf_boards{ ArenaAllocator<BoardSnapshot>(arena) };
+            leaf_boards.reserve(jobs.size());
+            for (auto const &job : jobs)
+                leaf_boards.push_back(job.result);
+            ArenaVector<float> leaf_values(leaf_boards.size(), 0.f, ArenaAllocator<float>(arena));
+            EvaluateBoards(leaf_boards.data(), leaf_boards.size(), team_, leaf_values.data());
+            for (size_t i = 0; i < jobs.size(); ++i)
+                jobs[i].value = leaf_values[i];
+
+            for (auto &job : jobs)
+            {
+                auto &chance = *job.path.back();
+                auto const &parent = *job.nodes.back();
+                auto outcome = std::make_unique<DecisionNode>();
+                outcome->board = job.result;
+                outcome->order = parent.order;
+                outcome->order.Update(job.result, GetMovedStones(parent.board, job.result));
+                outcome->static_value = job.value;
+                outcome->visits = 1;
+                chance.outcomes.push_back(std::move(outcome));
+                ++node_count_;
+
+                for (size_t i = 0; i < job.path.size(); ++i)
+                {
+                    --job.path[i]->pending;
+                    ++job.path[i]->visits;
+                    job.path[i]->value_sum += job.value;
+                    ++job.nodes[i]->visits;
+                }
+            }
+
+            trial_count += jobs.size();
+            last_batch_time = std::chrono::steady_clock::now() - batch_start;
+        }
+        return trial_count;
+    }
+
+    void LookaheadSearch::CollectJobs(ArenaVector<Job> &jobs, Arena &arena, size_t batch_size)
+    {
+        // 末端に達して試行を作れない経路もあるので，たどる回数には上限を設ける
+        size_t const max_descents = batch_size * 4;
+        for (size_t descent = 0; descent < max_descents && jobs.size() < batch_size; ++descent)
+        {
+            Job job(arena);
+            DecisionNode *node = root_.get();
+            for (unsigned depth = 0;; ++depth)
+            {
+                if (depth >= options_.max_depth || IsEndFinished(node->board))
+                {
+                    // 末端は静的な評価値をそのまま反映する
+                    for (size_t i = 0; i < job.path.size(); ++i)
+                    {
+                        ++job.path[i]->visits;
+                        job.path[i]->value_sum += node->static_value;
+                        ++job.nodes[i]->visits;
+                    }
+                    break;
+                }
+
+                if (!node->expanded)
+                    Expand(*node);
+                if (node->children.empty())
+                    break;
+
+                auto &chance = Select(*node);
+                job.path.push_back(&chance);
+                job.nodes.push_back(node);
+
+                // 確率ノードの試行結果は訪問回数の平方根に比例して増やす
+                size_t const allowed = std::min(options_.max_outcomes, 1 + static_cast<size_t>(std::sqrt(static_cast<double>(chance.visits))));
+                if (chance.outcomes.size() + chance.pending < allowed && node_count_ + jobs.size() < options_.max_nodes)
+                {
+                    job.sample = chance.outcomes.size() + chance.pending;
+                    for (auto *c : job.path)
+                        ++c->pending;
+                    jobs.push_back(std::move(job));
+                    break;
+                }
+                if (chance.outcomes.empty())
+                    break; // 最初の試行の評価待ち
+
+                // 訪問回数の最も少ない試行結果へ進む
+                node = std::min_element(chance.outcomes.begin(), chance.outcomes.end(),
+                    [](auto const &a, auto const &b) { return a->visits < b->visits; })->get();
+            }
+        }
+    }
+
+    void LookaheadSearch::Expand(DecisionNode &node)
+    {
+        for (auto const &candidate : GenerateCandidateShots(node.board, node.order, table_))
+        {
+            node.children.push_back(ChanceNode{ candidate, {}, 0., 0, 0 });
+        }
+        node.expanded = true;
+    }
+
+    /// \brief 根を展開し，近い局面のノード \p source の候補ショットの評価値を引き継ぐ．
+    ///
+    /// 種類と回転方向が同じで目標地点が最も近い候補の平均を，最大 Options::warm_start_visits 回分の訪問として与える．
+    /// 試行結果は局面ごとに異なるので引き継がない．根自身の訪問回数は 0 のままにする．
+    void LookaheadSearch::InheritStatistics(DecisionNode const &source)
+    {
+        Expand(*root_);
+        for (auto &child : root_->children)
+        {
+            ChanceNode const *match = nullptr;
+            float match_distance = options_.warm_start_tolerance;
+            for (auto const &old_child : source.children)
+            {
+                if (old_child.visits == 0 || old_child.candidate.kind != child.candidate.kind
+                    || old_child.candidate.shot.rotation != child.candidate.shot.rotation)
+                    continue;
+                float const distance = (old_child.candidate.target - child.candidate.target).Length();
+                if (distance <= match_distance)
+                {
+                    match = &old_child;
+                    match_distance = distance;
+                }
+            }
+            if (match)
+            {
+                child.visits = std::min(match->visits, options_.warm_start_visits);
+                child.value_sum = match->value_sum / match->visits * child.visits;
+            }
+        }
+    }
+
+    LookaheadSearch::ChanceNode &LookaheadSearch::Select(DecisionNode &node) const
+    {
+        // 相手の手番では team_ から見た評価値を最小化する
+        double const sign = node.board.GetNextTeam() == team_ ? 1. : -1.;
+
+        size_t total = 0;
+        for (auto const &child : node.children)
+        {
+            total += child.visits + child.pending;
+        }
+        double const log_total = std::log(static_cast<double>(std::max<size_t>(total, 1)));
+
+        ChanceNode *best = nullptr;
+        double best_score = -std::numeric_limits<double>::infinity();
+        for (auto &child : node.children)
+        {
+            size_t const n = child.visits + child.pending;
+            if (n == 0)
+                return child; // 未訪問の候補を優先する
+            double const mean = (sign * child.value_sum - options_.virtual_loss * child.pending) / n;
+            double const score = mean + options_.exploration * std::sqrt(log_total / n);
+            if (score > best_score)
+            {
+                best_score = score;
+                best = &child;
+            }
+        }
+        return *best;
+    }
+
+    /// \brief 試行に共通乱数のブレを加えたショットを返す．共通乱数を使わない場合は std::nullopt
+    ///
+    /// 兄弟の候補と同じ番号の試行結果に同じブレを加える．相手のショットのブレも自チームのプレイヤーで近似する．
+    /// 列はショット番号ごとに max_outcomes 個ずつずらして使い，同じ経路の続くショットに同じブレが繰り返されないようにする．
+    /// 根からの深さではなくショット番号でずらすので，SetRoot() で引き継いだ部分木でも同じ試行結果には同じブレが対応する．
+    std::optional<dc::moves::Shot> LookaheadSearch::GetCommonNoiseShot(Job const &job) const
+    {
+        auto const &board = job.nodes.back()->board;
+        auto const &noise_model = worker_pool_.GetNoiseModel(GetPlayerIndex(board));
+        if (!options_.common_noise || !noise_model)
+            return std::nullopt;
+        size_t const index = job.sample + board.shot * options_.max_outcomes;
+        return noise_model->Apply(job.path.back()->candidate.shot, (*options_.common_noise)[index]);
+    }
+
+    void LookaheadSearch::RunJob(WorkerPool::Worker &worker, Job &job) const
+    {
+        auto const &board = job.nodes.back()->board;
+        auto const common_noise_shot = GetCommonNoiseShot(job);
+        auto const &shot = common_noise_shot ? *common_noise_shot : job.path.back()->candidate.shot;
+        dc::IPlayer &player = common_noise_shot ? *worker.noiseless_player : *worker.players[GetPlayerIndex(board)];
+        auto stones = worker.VisitSimulator([&](auto &simulator)
+        {
+            return RunRollout(game_setting_, simulator, player, board, shot);
+        });
+        FinishJob(job, std::move(stones));
+    }
+
+    /// \brief 試行の結果のストーン配置 \p stones から，試行後の盤面を求める．
+    void LookaheadSearch::FinishJob(Job &job, dc::GameState::Stones stones) const
+    {
+        auto const &board = job.nodes.back()->board;
+
+        // フリーガードゾーンの相手のストーンを除去した場合は，ショット前の配置に戻る
+        if (game_setting_.five_rock_rule && board.shot < 5)
+        {
+            size_t const guarded_team = static_cast<size_t>(dc::GetOpponentTeam(board.GetNextTeam()));
+            for (size_t i = 0; i < kStonesPerTeam; ++i)
+            {
+                size_t const index = ToAllStonesIndex(guarded_team, i);
+                if (board.HasStone(index) && !stones[guarded_team][i]
+                    && IsInFreeGuardZone(dc::Vector2(board.stones[index].x, board.stones[index].y), game_setting_))
+                {
+                    stones = board.ToGameStones();
+                    break;
+                }
+            }
+        }
+
+        job.result = board;
+        job.result.SetStones(stones);
+        ++job.result.shot;
+    }
+
+    /// \brief バッチの試行の一部を評価ノードに依頼し，残りをローカルで行う．
+    ///
+    /// ローカルで行う試行の数は評価ノードを使わない場合のバッチと同じにし，残りのうち共通乱数のブレを再現できる試行を依頼する．
+    /// 締切までに返らなかった試行はローカルで行い直す．
+    void LookaheadSearch::RunRemoteJobs(ArenaVector<Job> &jobs, Arena &arena)
+    {
+        ArenaVector<size_t> local_jobs{ ArenaAllocator<size_t>(arena) };
+        ArenaVector<size_t> remote_jobs{ ArenaAllocator<size_t>(arena) };
+        ArenaVector<RemoteRolloutRequest> requests{ ArenaAllocator<RemoteRolloutRequest>(arena) };
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            auto const shot = i >= options_.batch_size ? GetCommonNoiseShot(jobs[i]) : std::nullopt;
+            if (shot)
+            {
+                requests.push_back(RemoteRolloutRequest{ jobs[i].nodes.back()->board, *shot });
+                remote_jobs.push_back(i);
+            }
+            else
+            {
+                local_jobs.push_back(i);
+            }
+        }
+        if (!requests.empty() && !remote_->Submit(requests.data(), requests.size()))
+        {
+            // 依頼を受けられる評価ノードが無くなった
+            local_jobs.insert(local_jobs.end(), remote_jobs.begin(), remote_jobs.end());
+            remote_jobs.clear();
+        }
+
+        auto run_local = [this, &jobs](ArenaVector<size_t> const &indices)
+        {
+            worker_pool_.Run(indices.size(), [this, &jobs, &indices](WorkerPool::Worker &worker, size_t i)
+            {
+                RunJob(worker, jobs[indices[i]]);
+            });
+        };
+        run_local(local_jobs);
+        if (remote_jobs.empty())
+            return;
+
+        ArenaVector<std::optional<dc::GameState::Stones>> results(remote_jobs.size(), std::nullopt, ArenaAllocator<std::optional<dc::GameState::Stones>>(arena));
+        remote_->Collect(results.data(), std::chrono::steady_clock::now() + options_.remote_grace);
+        ArenaVector<size_t> missed_jobs{ ArenaAllocator<size_t>(arena) };
+        for (size_t k = 0; k < remote_jobs.size(); ++k)
+        {
+            if (results[k])
+            {
+                FinishJob(jobs[remote_jobs[k]], std::move(*results[k]));
+            }
+            else
+            {
+                missed_jobs.push_back(remote_jobs[k]);
+            }
+        }
+        run_local(missed_jobs);
+    }
+
+    std::optional<CandidateShot> LookaheadSearch::GetBestShot() const
+    {
+        if (!root_ || root_->children.empty())
+            return std::nullopt;
+        auto const &best = *std::max_element(root_->children.begin(), root_->children.end(),
+            [](auto const &a, auto const &b) { return a.visits < b.visits; });
+        if (best.visits == 0)
+            return std::nullopt;
+        return best.candidate;
+    }
+
+    std::vector<LookaheadSearch::Estimate> LookaheadSearch::GetRootEstimates() const
+    {
+        std::vector<Estimate> estimates;
+        if (!root_)
+            return estimates;
+        for (auto const &child : root_->children)
+        {
+            double const mean = child.visits > 0 ? child.value_sum / child.visits : 0.;
+            estimates.push_back({ child.candidate, mean, child.visits, child.outcomes.size() });
+        }
+        return estimates;
+    }
+
+    size_t LookaheadSearch::GetRootVisits() const
+    {
+        return root_ ? root_->visits : 0;
+    }
+
+} // namespace obsidian
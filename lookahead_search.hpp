@@ -0,0 +1,188 @@
+#ifndef AICY_OBSIDIAN_LOOKAHEAD_SEARCH_HPP
+#define AICY_OBSIDIAN_LOOKAHEAD_SEARCH_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "arena.hpp"
+#include "board_snapshot.hpp"
+#include "shot_noise.hpp"
+#include "shot_velocity.hpp"
+#include "stone_order.hpp"
+#include "worker_pool.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    class RemoteRolloutClient;
+
+    /// \brief 候補ショットの種類
+    enum class CandidateKind
+    {
+        kDraw,   ///< ハウス内へのドロー
+        kGuard,  ///< ハウス手前へのガード
+        kHit,    ///< 相手のストーンへのヒット
+        kFreeze, ///< 相手のストーンの直前に止めるドロー
+        kRaise,  ///< ハウス手前の自チームのストーンをティーへ押し込むショット
+        kDoubleTakeOut, ///< 相手のストーンを弾いてもう1つの相手のストーンに当てるショット
+    };
+
+    char const *ToString(CandidateKind kind);
+
+    /// \brief 候補ショット
+    struct CandidateShot
+    {
+        dc::moves::Shot shot;
+        CandidateKind kind;
+        dc::Vector2 target; ///< 目標地点
+        float target_speed; ///< 目標地点到達時の速度
+    };
+
+    /// \brief 盤面に対する候補ショット(ドロー，ガード，ヒット，フリーズ，レイズ，ダブルテイクアウト)を生成します．
+    ///
+    /// ヒットとフリーズの対象は手番のチームから見た相手のストーンのうちティーに近いもの，レイズの対象はハウス手前の自チームのストーンです．
+    /// 各ショットは両方の回転方向を含みますが，ShotCorridor で近似した経路が他のストーンに阻まれる候補は含みません．
+    std::vector<CandidateShot> GenerateCandidateShots(BoardSnapshot const &board, VelocityTable const *table);
+
+    /// \brief GenerateCandidateShots() と同じですが，\p board のストーンの距離順として作成済みの \p order を使います．
+    std::vector<CandidateShot> GenerateCandidateShots(BoardSnapshot const &board, StoneOrder const &order, VelocityTable const *table);
+
+    /// \brief エンド内の数ショット先までを読む探索です．
+    ///
+    /// 手番のノードでは UCB で候補ショットを選び(相手の手番では評価値を最小化し)，
+    /// ショットのブレは確率ノードとして扱います．確率ノードの子(ブレを加えた試行の結果)は訪問回数に応じて増やし，
+    /// 評価値は子の平均(期待値)になります．末端の局面は EvaluateBoard() による静的評価で見積もります．
+    ///
+    /// 試行はまとめてワーカープールで並列に行い，同じ葉に集中しないよう評価待ちの候補には仮想損失を与えます．
+    /// SetRoot() で実際の局面に近いノードが木の中にあれば，その部分木を次の探索に引き継ぎます．
+    /// 部分木を引き継げるほど近くなくても，ある程度近いノードがあれば，その候補ショットの評価値を少ない訪問回数分の事前の推定として引き継ぎます．
+    ///
+    /// スレッドセーフではありません．同時に呼び出すことができるのは1スレッドのみです．
+    class LookaheadSearch
+    {
+    public:
+        /// \brief 探索を続けるかの判定
+        ///
+        /// 引数は根の総訪問回数と直前の1バッチの所要時間です．
+        using ContinueCondition = std::function<bool(size_t total_visits, std::chrono::steady_clock::duration last_batch_time)>;
+
+        struct Options
+        {
+            unsigned max_depth = 3;      ///< 先読みするショット数
+            size_t batch_size = 0;       ///< 1バッチの試行数(0 の場合ワーカー数の4倍)
+            size_t max_outcomes = 4;     ///< 1つの確率ノードが持つ試行結果の最大数
+            double exploration = 1.;     ///< UCB の探索係数[点]
+            double virtual_loss = 1.;    ///< 評価待ちの試行1回あたりの仮想損失[点]
+            size_t max_nodes = 1 << 18;  ///< 木のノード数の上限
+            float reuse_tolerance = 0.02f; ///< 部分木を引き継ぐストーン位置のずれの許容値[m]
+            float warm_start_tolerance = 0.3f; ///< 候補ショットの評価値を引き継ぐストーン位置のずれの許容値[m]
+            size_t warm_start_visits = 4;      ///< 引き継いだ評価値に与える訪問回数の上限
+            CommonShotNoise const *common_noise = nullptr; ///< 確率ノードの k 番目の試行結果に加えるブレの列．ショット番号ごとにずらして使う．nullptr の場合はワーカーのプレイヤーのブレを使う
+            std::chrono::milliseconds remote_grace{ 20 }; ///< ローカルの試行を終えてから評価ノードの結果を待つ時間の上限
+        };
+
+        /// \brief SetRoot() で既存の木から引き継いだもの
+        enum class RootReuse
+        {
+            kNone,       ///< 何も引き継がなかった
+            kSubtree,    ///< 近いノードの部分木をそのまま引き継いだ
+            kStatistics, ///< ある程度近いノードの候補ショットの評価値を引き継いだ
+        };
+
+        /// \brief 1つの候補ショットの探索結果
+        struct Estimate
+        {
+            CandidateShot candidate;
+            double mean;     ///< 探索したチームから見た評価値の平均[点]
+            size_t visits;
+            size_t outcomes; ///< 試行結果の数
+        };
+
+        /// \param worker_pool 試行に使用するワーカープール
+        ///
+        /// \param game_setting 試合設定
+        ///
+        /// \param team 評価値の基準となるチーム(自チーム)
+        ///
+        /// \param table 候補ショットの初速の計算に使用するテーブル(nullptr 可)
+        LookaheadSearch(
+            WorkerPool &worker_pool,
+            dc::GameSetting const &game_setting,
+            dc::Team team,
+            VelocityTable const *table,
+            Options const &options);
+
+        LookaheadSearch(WorkerPool &worker_pool, dc::GameSetting const &game_setting, dc::Team team, VelocityTable const *table)
+            : LookaheadSearch(worker_pool, game_setting, team, table, Options())
+        {
+        }
+
+        ~LookaheadSearch();
+
+        LookaheadSearch(LookaheadSearch const &) = delete;
+        LookaheadSearch &operator=(LookaheadSearch const &) = delete;
+
+        /// \brief 探索の根を局面 \p game_state にします．
+        ///
+        /// 同じエンドの同じショット番号のノードのうち，存在するストーンが同じで最も近いものを探します．
+        /// 部分木を引き継がない場合，根の訪問回数は 0 から数え直します．
+        ///
+        /// \return 既存の木から引き継いだもの
+        RootReuse SetRoot(dc::GameState const &game_state);
+
+        /// \brief \p should_continue が false を返すまで探索します．SetRoot() を先に呼ぶ必要があります．
+        ///
+        /// \return この呼出しで行った試行の回数
+        size_t Run(ContinueCondition const &should_continue);
+
+        /// \brief 根で最も多く訪問した候補ショットを返します．
+        std::optional<CandidateShot> GetBestShot() const;
+
+        /// \brief 根の候補ショットごとの探索結果を返します．
+        std::vector<Estimate> GetRootEstimates() const;
+
+        /// \brief 試行の一部を依頼する評価ノードのクライアントを設定します．nullptr の場合は全ての試行をローカルで行います．
+        ///
+        /// 評価ノードには共通乱数のブレを加えた試行のみを依頼し，そのワーカー数に応じてバッチを大きくします．
+        /// 締切までに返らなかった試行はローカルで行い直します．
+        void SetRemoteClient(RemoteRolloutClient *remote) { remote_ = remote; }
+
+        size_t GetRootVisits() const;
+        size_t GetNodeCount() const { return node_count_; }
+
+    private:
+        struct DecisionNode;
+        struct ChanceNode;
+        struct Job;
+
+        void Expand(DecisionNode &node);
+        void InheritStatistics(DecisionNode const &source);
+        ChanceNode &Select(DecisionNode &node) const;
+        void CollectJobs(ArenaVector<Job> &jobs, Arena &arena, size_t batch_size);
+        std::optional<dc::moves::Shot> GetCommonNoiseShot(Job const &job) const;
+        void RunJob(WorkerPool::Worker &worker, Job &job) const;
+        void FinishJob(Job &job, dc::GameState::Stones stones) const;
+        void RunRemoteJobs(ArenaVector<Job> &jobs, Arena &arena);
+
+        WorkerPool &worker_pool_;
+        dc::GameSetting game_setting_;
+        dc::Team team_;
+        VelocityTable const *table_;
+        Options options_;
+        RemoteRolloutClient *remote_ = nullptr;
+
+        std::unique_ptr<DecisionNode> root_;
+        size_t node_count_ = 0;
+    };
+
+    char const *ToString(LookaheadSearch::RootReuse reuse);
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_LOOKAHEAD_SEARCH_HPP
@@ -1,429 +1,243 @@
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
 #include <stdexcept>
 #include <iostream>
+#include <string>
+#include <string_view>
 #include <thread>
+#include <vector>
 #include <boost/asio.hpp>
 #include "digitalcurling3/digitalcurling3.hpp"
+#include "engine.hpp"
+#include "logger.hpp"
+#include "protocol_message.hpp"
 
 namespace dc = digitalcurling3;
 
 namespace
 {
 
-    /// \brief ティーの位置
-    constexpr dc::Vector2 kTee(
-        dc::coordinate::GetCenterLineX(dc::coordinate::Id::kShot0),
-        dc::coordinate::GetTeeLineY(true, dc::coordinate::Id::kShot0));
+    using boost::asio::ip::tcp;
+    using nlohmann::json;
 
-    /// \brief GameState::Stones のインデックス．
-    struct StoneIndex
-    {
-        size_t team;
-        size_t stone;
-    };
+    // TODO AIの名前を変更する場合はここを変更してください．
+    constexpr auto kName = "AIcyObsidian";
 
-    /// \brief ティー(ハウスの中心)からの距離でストーンをソートする．
-    ///
-    /// \param result 出力先パラメータ．ソート結果のインデックスが格納される．
+    constexpr int kSupportedProtocolVersionMajor = 1;
+
+    /// \brief サーバーとの1試合分の通信です．
     ///
-    /// \param stones ストーンの配置
-    void SortStones(std::array<StoneIndex, 16> &result, dc::GameState::Stones const &stones)
+    /// io_context 上の非同期処理でソケットを常に読み続け，OnMyTurn() は思考スレッドで実行します．
+    /// 思考中に次のメッセージ(時間切れ後の update や game_over)を受信した場合は，思考を中断してから処理します．
+    /// エンジンの呼出しは思考スレッドの終了を待ってから行うので，同時に呼び出されることはありません．
+    class MatchSession
     {
-        for (size_t i = 0; i < 16; ++i)
+    public:
+        /// \param engine_options 思考エンジンの設定．log にはセッションと同じロガーを指定する
+        MatchSession(boost::asio::io_context &io_context, obsidian::Engine::Options const &engine_options, obsidian::Logger &logger)
+            : io_context_(io_context)
+            , socket_(io_context)
+            , engine_(engine_options)
+            , logger_(logger)
+            , log_(&logger)
         {
-            result[i].team = i / 8;
-            result[i].stone = i % 8;
         }
 
-        for (size_t i = 1; i < 16; ++i)
-        {
-            for (size_t j = i; j > 0; --j)
-            {
-                auto const &stone_a = stones[result[j - 1].team][result[j - 1].stone];
-                auto const &stone_b = stones[result[j].team][result[j].stone];
+        MatchSession(MatchSession const &) = delete;
+        MatchSession &operator=(MatchSession const &) = delete;
 
-                if (!stone_a || (stone_b && (stone_a->position - kTee).Length() > (stone_b->position - kTee).Length()))
-                {
-                    std::swap(result[j - 1], result[j]);
-                }
-            }
+        ~MatchSession()
+        {
+            CancelThinking();
         }
-    }
-
-    /// \brief ストーンがハウス内にあるかを調べる．
-    ///
-    /// \return ストーンがハウス内にある場合 true ，そうでない場合 false
-    bool IsInHouse(std::optional<dc::Transform> const &stone)
-    {
-        if (!stone)
-            return false; // 盤面上にストーンが存在しない場合は false
-        return (stone->position - kTee).Length() < dc::coordinate::kHouseRadius + dc::ISimulator::kStoneRadius;
-    }
-
-    /// \brief シミュレータFCV1において，指定地点を指定速度で通過するショットの初速を逆算します．
-    ///
-    /// 使用上の注意：
-    /// - この関数はシミュレータFCV1に特化した関数です．他のシミュレータには対応していません．
-    ///   したがって，この関数を使用した場合必然的にシミュレータFCV1に特化した思考エンジンになります．
-    ///  （余談：複数のシミュレータに対応したショット速度を逆算する関数をライブラリから提供しさえすれば，
-    ///   その関数を使用することで思考エンジンが特定のシミュレータに特化するといったことは無くなります．
-    ///   ただ，今後どのようなシミュレータを追加するか現状では何とも言えなく，
-    ///   どのようにショット速度を逆算すべきかも何とも言えないので，現状そのような関数はライブラリでは提供していません）
-    /// - 関数内でシミュレータFCV1を使用して1ショット分シミュレーションを行っています．ですので，この関数の実行は高速とは言えません．
-    /// - この関数は解析的にもとめたものでなく，シミュレーション結果から回帰分析で求めた関数です．したがって，特に飛距離にはある程度誤差が存在します．
-    ///
-    /// \param target_position 目標地点
-    ///
-    /// \param target_speed 目標地点到達時の速度．
-    ///     0 にすればドローショット(石を停止させるショット)，0 より大きくすればヒットショット(石を他の石にぶつけるショット)になる．
-    ///
-    /// \param rotation ショットの回転方向
-    ///
-    /// \return 推測されたストーンの初速ベクトル
-    dc::Vector2 EstimateShotVelocityFCV1(dc::Vector2 const &target_position, float target_speed, dc::moves::Shot::Rotation rotation)
-    {
-        assert(target_speed >= 0.f);
-        assert(target_speed <= 4.f);
-
-        // 初速度の大きさを逆算する
-        // 逆算には専用の関数を用いる．
 
-        float const v0_speed = [&target_position, target_speed]
+        /// \brief 引数のホスト，ポートに接続し，メッセージの受信を開始します．
+        void Start(char const *host, char const *port)
         {
-            auto const target_r = target_position.Length();
-            assert(target_r > 0.f);
-
-            if (target_speed <= 0.05f)
-            {
-                float constexpr kC0[] = {0.0005048122574925176, 0.2756242531609261};
-                float constexpr kC1[] = {0.00046669575066030805, -29.898958358378636, -0.0014030973174948508};
-                float constexpr kC2[] = {0.13968687866736632, 0.41120940058777616};
-
-                float const c0 = kC0[0] * target_r + kC0[1];
-                float const c1 = -kC1[0] * std::log(target_r + kC1[1]) + kC1[2];
-                float const c2 = kC2[0] * target_r + kC2[1];
-
-                return std::sqrt(c0 * target_speed * target_speed + c1 * target_speed + c2);
-            }
-            else if (target_speed <= 1.f)
-            {
-                float constexpr kC0[] = {-0.0014309170115803444, 0.9858457898438147};
-                float constexpr kC1[] = {-0.0008339331735471273, -29.86751291726946, -0.19811799977982522};
-                float constexpr kC2[] = {0.13967323742978, 0.42816312110477517};
-
-                float const c0 = kC0[0] * target_r + kC0[1];
-                float const c1 = -kC1[0] * std::log(target_r + kC1[1]) + kC1[2];
-                float const c2 = kC2[0] * target_r + kC2[1];
-
-                return std::sqrt(c0 * target_speed * target_speed + c1 * target_speed + c2);
-            }
-            else
-            {
-                float constexpr kC0[] = {1.0833113118071224e-06, -0.00012132851917870833, 0.004578093297561233, 0.9767006869364527};
-                float constexpr kC1[] = {0.07950648211492622, -8.228225657195706, -0.05601306077702578};
-                float constexpr kC2[] = {0.14140440186382008, 0.3875782508767419};
-
-                float const c0 = kC0[0] * target_r * target_r * target_r + kC0[1] * target_r * target_r + kC0[2] * target_r + kC0[3];
-                float const c1 = -kC1[0] * std::log(target_r + kC1[1]) + kC1[2];
-                float const c2 = kC2[0] * target_r + kC2[1];
-
-                return std::sqrt(c0 * target_speed * target_speed + c1 * target_speed + c2);
-            }
-        }();
-
-        assert(target_speed < v0_speed);
-
-        // 一度シミュレーションを行い，発射方向を決定する
+            tcp::resolver resolver(io_context_);
+            boost::asio::connect(socket_, resolver.resolve(host, port));
+            ReadNextLine();
+        }
 
-        dc::Vector2 const delta = [rotation, v0_speed, target_speed]
+    private:
+        /// \brief 受信を待っているメッセージ
+        enum class Phase
         {
-            float const rotation_factor = rotation == dc::moves::Shot::Rotation::kCCW ? 1.f : -1.f;
-
-            // シミュレータは FCV1 シミュレータを使用する．
-            thread_local std::unique_ptr<dc::ISimulator> s_simulator;
-            if (s_simulator == nullptr)
-            {
-                s_simulator = dc::simulators::SimulatorFCV1Factory().CreateSimulator();
-            }
+            kDc,
+            kIsReady,
+            kNewGame,
+            kUpdate,
+            kGameOver,
+            kFinished,
+        };
 
-            dc::ISimulator::AllStones init_stones;
-            init_stones[0].emplace(dc::Vector2(), 0.f, dc::Vector2(0.f, v0_speed), 1.57f * rotation_factor);
-            s_simulator->SetStones(init_stones);
+        /// \brief 1回の受信で確保するバッファの大きさ
+        static constexpr size_t kReadSize = 64 * 1024;
 
-            while (!s_simulator->AreAllStonesStopped())
-            {
-                auto const &stones = s_simulator->GetStones();
-                auto const speed = stones[0]->linear_velocity.Length();
-                if (speed <= target_speed)
+        /// \brief ソケットから受信し，完成した行を順に HandleLine() に渡す．試合が終わるまで繰り返す．
+        void ReadNextLine()
+        {
+            socket_.async_read_some(boost::asio::buffer(input_buffer_.Prepare(kReadSize), kReadSize),
+                [this](boost::system::error_code const &error, size_t size)
                 {
-                    return stones[0]->position;
-                }
-                s_simulator->Step();
-            }
-
-            return s_simulator->GetStones()[0]->position;
-        }();
-
-        float const delta_angle = std::atan2(delta.x, delta.y); // 注: delta.x, delta.y の順番で良い
-        float const target_angle = std::atan2(target_position.y, target_position.x);
-        float const v0_angle = target_angle + delta_angle; // 発射方向
-
-        return dc::Vector2(v0_speed * std::cos(v0_angle), v0_speed * std::sin(v0_angle));
-    }
-
-    // グローバル変数
-
-    dc::Team g_team; /// 自分のチーム
-    dc::GameSetting g_game_setting;
-    std::unique_ptr<dc::ISimulator> g_simulator;
-    std::unique_ptr<dc::ISimulatorStorage> g_simulator_storage;
-    std::array<std::unique_ptr<dc::IPlayer>, 4> g_players;
-
-    /// \brief サーバーから送られてきた試合設定が引数として渡されるので，試合前の準備を行います．
-    ///
-    /// 引数 \p player_order を編集することでプレイヤーのショット順を変更することができます．各プレイヤーの情報は \p player_factories に格納されています．
-    /// 補足：プレイヤーはショットのブレをつかさどります．プレイヤー数は4で，0番目は0, 1投目，1番目は2, 3投目，2番目は4, 5投目，3番目は6, 7投目を担当します．
-    ///
-    /// この処理中の思考時間消費はありません．試合前に時間のかかる処理を行う場合この中で行うべきです．
-    ///
-    /// \param team この思考エンジンのチームID．
-    ///     Team::k0 の場合，最初のエンドの先攻です．
-    ///     Team::k1 の場合，最初のエンドの後攻です．
-    ///
-    /// \param game_setting 試合設定．
-    ///     この参照はOnInitの呼出し後は無効になります．OnInitの呼出し後にも参照したい場合はコピーを作成してください．
-    ///
-    /// \param simulator_factory 試合で使用されるシミュレータの情報．
-    ///     未対応のシミュレータの場合 nullptr が格納されます．
-    ///
-    /// \param player_factories 自チームのプレイヤー情報．
-    ///     未対応のプレイヤーの場合 nullptr が格納されます．
-    ///
-    /// \param player_order 出力用引数．
-    ///     プレイヤーの順番(デフォルトで0, 1, 2, 3)を変更したい場合は変更してください．
-    void OnInit(
-        dc::Team team,
-        dc::GameSetting const &game_setting,
-        std::unique_ptr<dc::ISimulatorFactory> simulator_factory,
-        std::array<std::unique_ptr<dc::IPlayerFactory>, 4> player_factories,
-        std::array<size_t, 4> &player_order)
-    {
-        // TODO AIを作る際はここを編集してくださいif (simulator_factory == nullptr || simulator_factory->GetSimulatorId() != "fcv1") {
-        std::cout << "warning!: Unsupported simulator!"
-            " EstimateShotVelocityFCV1() is only available for \"fcv1\" simulator." << std::endl;
-        g_team = team;
-        g_game_setting = game_setting;
-        if (simulator_factory) {
-            g_simulator = simulator_factory->CreateSimulator();
-        }
-        else {
-            g_simulator = dc::simulators::SimulatorFCV1Factory().CreateSimulator();
-        }
-        g_simulator_storage = g_simulator->CreateStorage();
-
-        // プレイヤーを生成する
-        // 非対応の場合は NormalDistプレイヤーを使用する．
-        assert(g_players.size() == player_factories.size());
-        for (size_t i = 0; i < g_players.size(); ++i) {
-            auto const& player_factory = player_factories[player_order[i]];
-            if (player_factory) {
-                g_players[i] = player_factory->CreatePlayer();
-            }
-            else {
-                g_players[i] = dc::players::PlayerNormalDistFactory().CreatePlayer();
-            }
+                    if (error)
+                    {
+                        throw boost::system::system_error(error);
+                    }
+                    // 1回の受信に複数行や行の途中が含まれることがあるため，完成した行だけを1行ずつ取り出す
+                    input_buffer_.Commit(size);
+                    while (phase_ != Phase::kFinished)
+                    {
+                        auto const line = input_buffer_.NextLine();
+                        if (!line)
+                            break;
+                        HandleLine(*line);
+                    }
+                    if (phase_ != Phase::kFinished)
+                    {
+                        ReadNextLine();
+                    }
+                });
         }
-    }
 
-    /// \brief 自チームのターンに呼ばれます．返り値として返した行動がサーバーに送信されます．
-    ///
-    /// \param game_state 現在の試合状況．
-    ///     この参照は関数の呼出し後に無効になりますので，関数呼出し後に参照したい場合はコピーを作成してください．
-    ///
-    /// \return 選択する行動．この行動が自チームの行動としてサーバーに送信されます．
-    dc::Move OnMyTurn(dc::GameState const &game_state)
-    {
-        using ShotRotation = dc::moves::Shot::Rotation;
-
-        std::array<StoneIndex, 16> sorted_indices;
-        SortStones(sorted_indices, game_state.stones);
-
-        auto & current_player = *g_players[game_state.shot / 4];
-        g_simulator->Save(*g_simulator_storage);
-        for (auto const idx : sorted_indices)
+        /// \brief 送信するメッセージのバッファを用意する．送信済みのバッファがあれば再利用する．
+        std::string AcquireOutputBuffer()
         {
-            if (idx.team == static_cast<size_t>(g_team))
-                continue;
-            auto const stone = game_state.stones[idx.team][idx.stone];
-            if (!stone.has_value()) break;
-
-            float speed = 0.5f;
-            for (; speed < 3.5f; speed += 0.5f)
-            {
-                dc::GameState temp_game_state = game_state;
-                dc::Move temp_move = dc::moves::Shot{ EstimateShotVelocityFCV1(stone->position, speed, ShotRotation::kCCW), ShotRotation::kCCW };
-                g_simulator->Load(*g_simulator_storage);
-                dc::ApplyMove(g_game_setting, *g_simulator, current_player, temp_game_state, temp_move, std::chrono::milliseconds(0));
-                int shot = game_state.shot;
-                if (temp_game_state.stones[shot % 2][shot / 2] && !temp_game_state.stones[idx.team][idx.stone])
-                    break;
-            }
+            if (spare_output_buffers_.empty())
+                return std::string();
+            std::string buffer = std::move(spare_output_buffers_.back());
+            spare_output_buffers_.pop_back();
+            buffer.clear();
+            return buffer;
+        }
 
-            std::array<int, 2> points = { 0, 0 };
-            std::array<dc::moves::Shot, 2> candidate_shots = {{
-                {EstimateShotVelocityFCV1(stone->position, speed, ShotRotation::kCCW), ShotRotation::kCCW},
-                {EstimateShotVelocityFCV1(stone->position, speed, ShotRotation::kCW), ShotRotation::kCW},
-            }};
-            for (int i = 0; i < 3; i++)
+        /// \brief メッセージを送信キューに追加する．送信は追加した順に行う．
+        void Send(std::string message)
+        {
+            output_queue_.push_back(std::move(message));
+            if (output_queue_.size() == 1)
             {
-                for (int j = 0; j < candidate_shots.size(); j++)
-                {
-                    g_simulator->Load(*g_simulator_storage);
-                    dc::Move temp_move = candidate_shots[j];
-                    dc::GameState temp_game_state = game_state;
-                    dc::ApplyMove(g_game_setting, *g_simulator, current_player, temp_game_state, temp_move, std::chrono::milliseconds(0));
-                    int shot = game_state.shot;
-                    if (temp_game_state.stones[shot % 2][shot / 2].has_value())
-                        points[j] += 1;
-                    if (!temp_game_state.stones[idx.team][idx.stone].has_value())
-                        points[j] += 1;
-                }
+                WriteNext();
             }
-            if (points[0] > points[1]) return candidate_shots[0];
-            else return candidate_shots[1];
         }
 
-        auto const v0 = EstimateShotVelocityFCV1(kTee, 0.f, ShotRotation::kCCW);
-        return dc::moves::Shot{v0, ShotRotation::kCCW};
-    }
-
-    /// \brief 相手チームのターンに呼ばれます．AIを作る際にこの関数の中身を記述する必要は無いかもしれません．
-    ///
-    /// ひとつ前の手番で自分が行った行動の結果を見ることができます．
-    ///
-    /// \param game_state 現在の試合状況．
-    ///     この参照は関数の呼出し後に無効になりますので，関数呼出し後に参照したい場合はコピーを作成してください．
-    void OnOpponentTurn(dc::GameState const &game_state)
-    {
-        // TODO AIを作る際はここを編集してください
-    }
-
-    /// \brief ゲームが正常に終了した際にはこの関数が呼ばれます．
-    ///
-    /// \param game_state 試合終了後の試合状況．
-    ///     この参照は関数の呼出し後に無効になりますので，関数呼出し後に参照したい場合はコピーを作成してください．
-    void OnGameOver(dc::GameState const &game_state)
-    {
-        // TODO AIを作る際はここを編集してください
-
-        if (game_state.game_result->winner == g_team)
-        {
-            std::cout << "won the game" << std::endl;
-        }
-        else
+        void Send(json const &jout)
         {
-            std::cout << "lost the game" << std::endl;
+            Send(jout.dump() + '\n');
         }
-    }
-
-} // unnamed namespace
 
-int main(int argc, char const *argv[])
-{
-    using boost::asio::ip::tcp;
-    using nlohmann::json;
-
-    // TODO AIの名前を変更する場合はここを変更してください．
-    constexpr auto kName = "AIcyObsidian";
-
-    constexpr int kSupportedProtocolVersionMajor = 1;
-
-    try
-    {
-        if (argc != 3)
+        void WriteNext()
         {
-            std::cerr << "Usage: command <host> <port>" << std::endl;
-            return 1;
+            boost::asio::async_write(socket_, boost::asio::buffer(output_queue_.front()),
+                [this](boost::system::error_code const &error, size_t)
+                {
+                    if (error)
+                    {
+                        throw boost::system::system_error(error);
+                    }
+                    spare_output_buffers_.push_back(std::move(output_queue_.front()));
+                    output_queue_.erase(output_queue_.begin());
+                    if (!output_queue_.empty())
+                    {
+                        WriteNext();
+                    }
+                });
         }
 
-        boost::asio::io_context io_context;
-
-        tcp::socket socket(io_context);
-        tcp::resolver resolver(io_context);
-        boost::asio::connect(socket, resolver.resolve(argv[1], argv[2])); // 引数のホスト，ポートに接続します．
-
-        // ソケットから1行読む関数です．バッファが空の場合，新しい行が来るまでスレッドをブロックします．
-        auto read_next_line = [&socket, input_buffer = std::string()]() mutable
-        {
-            // read_untilの結果，input_bufferに複数行入ることがあるため，1行ずつ取り出す処理を行っている
-            if (input_buffer.empty())
-            {
-                boost::asio::read_until(socket, boost::asio::dynamic_buffer(input_buffer), '\n');
-            }
-            auto new_line_pos = input_buffer.find_first_of('\n');
-            auto line = input_buffer.substr(0, new_line_pos + 1);
-            input_buffer.erase(0, new_line_pos + 1);
-            return line;
-        };
-
         // コマンドが予期したものかチェックする関数です．
-        auto check_command = [](nlohmann::json const &jin, std::string_view expected_cmd)
+        static void CheckCommand(std::string_view actual_cmd, std::string_view expected_cmd)
         {
-            auto const actual_cmd = jin.at("cmd").get<std::string>();
             if (actual_cmd != expected_cmd)
             {
                 std::ostringstream buf;
                 buf << "Unexpected cmd (expected: \"" << expected_cmd << "\", actual: \"" << actual_cmd << "\")";
                 throw std::runtime_error(buf.str());
             }
-        };
-
-        dc::Team team = dc::Team::kInvalid;
+        }
 
-        // [in] dc
+        void HandleLine(std::string_view line)
         {
-            auto const line = read_next_line();
-            auto const jin = json::parse(line);
+            auto const jin = obsidian::ParseMessage(line);
+            auto const cmd = jin.at("cmd").get<std::string>();
 
-            check_command(jin, "dc");
+            // 思考中に届いたメッセージは，思考の結果より優先する
+            CancelThinking();
+
+            // 相手の切断などで update を待たずに試合が終わる場合がある
+            if (cmd == "game_over" && (phase_ == Phase::kUpdate || phase_ == Phase::kGameOver))
+            {
+                OnGameOver();
+                return;
+            }
 
+            switch (phase_)
+            {
+            case Phase::kDc:
+                CheckCommand(cmd, "dc");
+                OnDc(jin);
+                phase_ = Phase::kIsReady;
+                break;
+            case Phase::kIsReady:
+                CheckCommand(cmd, "is_ready");
+                OnIsReady(jin);
+                phase_ = Phase::kNewGame;
+                break;
+            case Phase::kNewGame:
+                CheckCommand(cmd, "new_game");
+                log_ << "[in] new_game" << std::endl;
+                log_ << "  team 0: " << jin.at("name").at("team0") << std::endl;
+                log_ << "  team 1: " << jin.at("name").at("team1") << std::endl;
+                phase_ = Phase::kUpdate;
+                break;
+            case Phase::kUpdate:
+                CheckCommand(cmd, "update");
+                OnUpdate(jin);
+                break;
+            default:
+                CheckCommand(cmd, "game_over");
+                break;
+            }
+        }
+
+        // [in] dc
+        void OnDc(json const &jin)
+        {
             auto const &jin_version = jin.at("version");
             if (jin_version.at("major").get<int>() != kSupportedProtocolVersionMajor)
             {
                 throw std::runtime_error("Unexpected protocol version");
             }
 
-            std::cout << "[in] dc" << std::endl;
-            std::cout << "  game_id  : " << jin.at("game_id").get<std::string>() << std::endl;
-            std::cout << "  date_time: " << jin.at("date_time").get<std::string>() << std::endl;
-        }
+            log_ << "[in] dc" << std::endl;
+            log_ << "  game_id  : " << jin.at("game_id").get<std::string>() << std::endl;
+            log_ << "  date_time: " << jin.at("date_time").get<std::string>() << std::endl;
 
-        // [out] dc_ok
-        {
+            // [out] dc_ok
             json const jout = {
                 {"cmd", "dc_ok"},
                 {"name", kName}};
-            auto const output_message = jout.dump() + '\n';
-            boost::asio::write(socket, boost::asio::buffer(output_message));
+            Send(jout);
 
-            std::cout << "[out] dc_ok" << std::endl;
-            std::cout << "  name: " << kName << std::endl;
+            log_ << "[out] dc_ok" << std::endl;
+            log_ << "  name: " << kName << std::endl;
         }
 
         // [in] is_ready
+        void OnIsReady(json const &jin)
         {
-            auto const line = read_next_line();
-            auto const jin = json::parse(line);
-
-            check_command(jin, "is_ready");
-
             if (jin.at("game").at("rule").get<std::string>() != "normal")
             {
                 throw std::runtime_error("Unexpected rule");
             }
 
-            team = jin.at("team").get<dc::Team>();
+            team_ = jin.at("team").get<dc::Team>();
 
             auto const game_setting = jin.at("game").at("setting").get<dc::GameSetting>();
 
@@ -435,10 +249,10 @@ int main(int argc, char const *argv[])
             }
             catch (std::exception &e)
             {
-                std::cout << "Exception: " << e.what() << std::endl;
+                log_ << "Exception: " << e.what() << std::endl;
             }
 
-            auto const &jin_player_factories = jin.at("game").at("players").at(dc::ToString(team));
+            auto const &jin_player_factories = jin.at("game").at("players").at(dc::ToString(team_));
             std::array<std::unique_ptr<dc::IPlayerFactory>, 4> player_factories;
             for (size_t i = 0; i < 4; ++i)
             {
@@ -449,101 +263,258 @@ int main(int argc, char const *argv[])
                 }
                 catch (std::exception &e)
                 {
-                    std::cout << "Exception: " << e.what() << std::endl;
+                    log_ << "Exception: " << e.what() << std::endl;
                 }
                 player_factories[i] = std::move(player_factory);
             }
 
-            std::cout << "[in] is_ready" << std::endl;
+            log_ << "[in] is_ready" << std::endl;
 
             // [out] ready_ok
 
+            // 試合前の準備で思考時間は消費しないので，ここでは通信スレッドで実行する
             std::array<size_t, 4> player_order{0, 1, 2, 3};
-            OnInit(team, game_setting, std::move(simulator_factory), std::move(player_factories), player_order);
+            engine_.OnInit(team_, game_setting, std::move(simulator_factory), std::move(player_factories), player_order);
 
             json const jout = {
                 {"cmd", "ready_ok"},
                 {"player_order", player_order}};
-            auto const output_message = jout.dump() + '\n';
-            boost::asio::write(socket, boost::asio::buffer(output_message));
+            Send(jout);
 
-            std::cout << "[out] ready_ok" << std::endl;
-            std::cout << "  player order: " << jout.at("player_order").dump() << std::endl;
+            log_ << "[out] ready_ok" << std::endl;
+            log_ << "  player order: " << jout.at("player_order").dump() << std::endl;
         }
 
-        // [in] new_game
+        // [in] update
+        void OnUpdate(json const &jin)
         {
-            auto const line = read_next_line();
-            auto const jin = json::parse(line);
+            game_state_ = jin.at("state").get<dc::GameState>();
 
-            check_command(jin, "new_game");
+            logger_.LogShot(obsidian::LogLevel::kInfo, game_state_.end, game_state_.shot);
 
-            std::cout << "[in] new_game" << std::endl;
-            std::cout << "  team 0: " << jin.at("name").at("team0") << std::endl;
-            std::cout << "  team 1: " << jin.at("name").at("team1") << std::endl;
-        }
+            // if game was over
+            if (game_state_.game_result)
+            {
+                phase_ = Phase::kGameOver;
+                return;
+            }
 
-        dc::GameState game_state;
+            if (game_state_.GetNextTeam() == team_)
+            { // my turn
+                StartThinking();
+            }
+            else
+            { // opponent turn
+                engine_.OnOpponentTurn(game_state_);
+            }
+        }
 
-        while (true)
+        // [in] game_over
+        void OnGameOver()
         {
-            // [in] update
-            auto const line = read_next_line();
-            auto const jin = json::parse(line);
-
-            check_command(jin, "update");
-
-            game_state = jin.at("state").get<dc::GameState>();
+            log_ << "[in] game_over" << std::endl;
 
-            std::cout << "[in] update (end: " << int(game_state.end) << ", shot: " << int(game_state.shot) << ")" << std::endl;
-
-            // if game was over
-            if (game_state.game_result)
+            // 終了．
+            if (game_state_.game_result)
             {
-                break;
+                engine_.OnGameOver(game_state_);
             }
+            phase_ = Phase::kFinished;
+        }
 
-            if (game_state.GetNextTeam() == team)
-            { // my turn
-                // [out] move
-                auto move = OnMyTurn(game_state);
-                json jout = {
-                    {"cmd", "move"},
-                    {"move", move}};
-                auto const output_message = jout.dump() + '\n';
-                boost::asio::write(socket, boost::asio::buffer(output_message));
-
-                std::cout << "[out] move" << std::endl;
-                if (std::holds_alternative<dc::moves::Shot>(move))
+        /// \brief 思考スレッドで OnMyTurn() を開始する．結果は通信スレッドに戻して送信する．
+        void StartThinking()
+        {
+            think_cancel_requested_ = false;
+            think_thread_ = std::thread([this, turn = ++turn_id_, game_state = game_state_]
+            {
+                std::optional<dc::Move> move;
+                std::exception_ptr error;
+                try
                 {
-                    dc::moves::Shot const &shot = std::get<dc::moves::Shot>(move);
-                    std::cout << "  type    : shot" << std::endl;
-                    std::cout << "  velocity: [" << shot.velocity.x << ", " << shot.velocity.y << "]" << std::endl;
-                    std::cout << "  rotation: " << (shot.rotation == dc::moves::Shot::Rotation::kCCW ? "ccw" : "cw") << std::endl;
+                    move = engine_.OnMyTurn(game_state, think_cancel_requested_);
                 }
-                else if (std::holds_alternative<dc::moves::Concede>(move))
+                catch (...)
                 {
-                    std::cout << "  type: concede" << std::endl;
+                    error = std::current_exception();
                 }
+                boost::asio::post(io_context_, [this, turn, move, error]
+                {
+                    // 中断した思考の結果は破棄する
+                    if (turn != turn_id_ || !think_thread_.joinable())
+                        return;
+                    think_thread_.join();
+                    if (error)
+                    {
+                        std::rethrow_exception(error);
+                    }
+                    SendMove(*move);
+                });
+            });
+        }
+
+        /// \brief 思考中であれば中断し，思考スレッドの終了を待つ．
+        void CancelThinking()
+        {
+            if (think_thread_.joinable())
+            {
+                think_cancel_requested_ = true;
+                think_thread_.join();
+                log_ << "  thinking cancelled" << std::endl;
+            }
+        }
+
+        // [out] move
+        void SendMove(dc::Move const &move)
+        {
+            auto message = AcquireOutputBuffer();
+            obsidian::AppendMoveMessage(message, move);
+            Send(std::move(message));
+
+            logger_.LogMove(obsidian::LogLevel::kInfo, move);
+        }
+
+        boost::asio::io_context &io_context_;
+        tcp::socket socket_;
+        obsidian::LineBuffer input_buffer_;
+        std::vector<std::string> output_queue_;          ///< 送信中と送信待ちのメッセージ．先頭が送信中
+        std::vector<std::string> spare_output_buffers_;  ///< 送信済みのメッセージのバッファ．容量を再利用する
+
+        obsidian::Engine engine_; ///< 試合の状態はすべてエンジンが持つ
+        obsidian::Logger &logger_;
+        obsidian::LogStream log_;
+
+        Phase phase_ = Phase::kDc;
+        dc::Team team_ = dc::Team::kInvalid;
+        dc::GameState game_state_;
+
+        std::thread think_thread_;
+        std::atomic<bool> think_cancel_requested_{false};
+        size_t turn_id_ = 0; ///< 思考を開始するたびに増やし，中断した思考の結果を識別する
+    };
+
+    /// \brief --log-level に指定された重要度の名前を LogLevel にします．
+    ///
+    /// \return 未知の名前の場合は std::nullopt
+    std::optional<obsidian::LogLevel> ParseLogLevel(std::string_view name)
+    {
+        if (name == "debug")
+            return obsidian::LogLevel::kDebug;
+        if (name == "info")
+            return obsidian::LogLevel::kInfo;
+        if (name == "warning")
+            return obsidian::LogLevel::kWarning;
+        if (name == "error")
+            return obsidian::LogLevel::kError;
+        if (name == "off")
+            return obsidian::LogLevel::kOff;
+        return std::nullopt;
+    }
+
+    /// \brief サーバーに接続して1試合を行います．
+    ///
+    /// \param host 接続先のホスト
+    ///
+    /// \param port 接続先のポート
+    ///
+    /// \param engine_options 思考エンジンの設定．複数の試合を同時に行う場合はスレッドとテーブルを共有する．
+    ///
+    /// \param log 通信と思考のログの出力先．書込みはバックグラウンドのスレッドで行う
+    ///
+    /// \param log_level 出力するログの最低の重要度
+    void PlayMatch(char const *host, char const *port, obsidian::Engine::Options const &engine_options, std::ostream &log, obsidian::LogLevel log_level)
+    {
+        // ロガーはエンジンより後に破棄する必要がある
+        obsidian::Logger logger(log, log_level);
+        auto session_engine_options = engine_options;
+        session_engine_options.log = &logger;
+
+        boost::asio::io_context io_context;
+        MatchSession session(io_context, session_engine_options, logger);
+        session.Start(host, port);
+        io_context.run();
+    }
+
+} // unnamed namespace
+
+int main(int argc, char const *argv[])
+{
+    try
+    {
+        // 事前計算のキャッシュをオフラインで作り直す
+        if (argc >= 2 && std::string_view(argv[1]) == "build-cache")
+        {
+            std::string const cache_path = argc >= 3 ? argv[2] : obsidian::Engine::Options().cache_path;
+            return obsidian::Engine::BuildPrecomputeCache(cache_path, &std::cout) ? 0 : 1;
+        }
+
+        // --remote-node <ホスト>:<ポート> は先読みの試行の一部を依頼する評価ノード(複数指定可)
+        // --log-level <重要度> は出力するログの最低の重要度(debug, info, warning, error, off)
+        obsidian::Engine::Options engine_options;
+        obsidian::LogLevel log_level = obsidian::LogLevel::kInfo;
+        bool valid_options = true;
+        std::vector<char const *> args;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string_view const arg(argv[i]);
+            if (arg == "--remote-node" && i + 1 < argc)
+            {
+                engine_options.remote_nodes.emplace_back(argv[++i]);
+            }
+            else if (arg == "--log-level" && i + 1 < argc)
+            {
+                auto const level = ParseLogLevel(argv[++i]);
+                valid_options = valid_options && level.has_value();
+                log_level = level.value_or(log_level);
             }
             else
-            { // opponent turn
-                OnOpponentTurn(game_state);
+            {
+                args.push_back(argv[i]);
             }
         }
 
-        // [in] game_over
+        if (!valid_options || (args.size() != 2 && args.size() != 3))
         {
-            auto const line = read_next_line();
-            auto const jin = json::parse(line);
-
-            check_command(jin, "game_over");
+            std::cerr << "Usage: command [--remote-node <host>:<port>]... [--log-level debug|info|warning|error|off] <host> <port> [matches]" << std::endl;
+            std::cerr << "       command build-cache [cache path]" << std::endl;
+            return 1;
+        }
 
-            std::cout << "[in] game_over" << std::endl;
+        size_t const match_count = args.size() == 3 ? std::stoul(args[2]) : 1;
+        if (match_count <= 1)
+        {
+            PlayMatch(args[0], args[1], engine_options, std::cout, log_level);
+            return 0;
         }
 
-        // 終了．
-        OnGameOver(game_state);
+        // 複数の試合を同時に行う場合は，スレッドとずれ角のテーブルと定跡を全試合で共有し，ログは試合ごとのファイルに出力する
+        auto shared_options = engine_options;
+        shared_options.thread_pool = std::make_shared<obsidian::ThreadPool>();
+        shared_options.velocity_table = obsidian::Engine::PrepareVelocityTable(shared_options.cache_path, &std::cout);
+        shared_options.opening_book = obsidian::Engine::PrepareOpeningBook(shared_options.cache_path, &std::cout);
+        std::cout << "matches: " << match_count << ", " << shared_options.thread_pool->GetThreadCount() << " shared threads" << std::endl;
+
+        std::vector<std::thread> matches;
+        for (size_t i = 0; i < match_count; ++i)
+        {
+            matches.emplace_back([&args, &shared_options, log_level, i]
+            {
+                std::ofstream log("match_" + std::to_string(i) + ".log");
+                try
+                {
+                    PlayMatch(args[0], args[1], shared_options, log, log_level);
+                }
+                catch (std::exception &e)
+                {
+                    log << "Exception: " << e.what() << std::endl;
+                    std::cerr << "match " << i << ": Exception: " << e.what() << std::endl;
+                }
+            });
+        }
+        for (auto &match : matches)
+        {
+            match.join();
+        }
     }
     catch (std::exception &e)
     {
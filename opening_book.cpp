@@ -0,0 +1,193 @@
+#include "opening_book.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        struct OpeningBookSectionHeader
+        {
+            std::uint32_t entry_count;
+            std::uint32_t max_shot;
+            float cell_size;
+            std::uint32_t reserved;
+        };
+
+        /// \brief キャッシュの区画のデータ形式のバージョン
+        constexpr std::uint32_t kSectionVersion = 1;
+
+        /// \brief splitmix64 の混合関数
+        std::uint64_t Mix(std::uint64_t value)
+        {
+            value += 0x9e3779b97f4a7c15ull;
+            value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+            value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+            return value ^ (value >> 31);
+        }
+
+        std::uint32_t QuantizeCell(float value)
+        {
+            return static_cast<std::uint32_t>(static_cast<std::int32_t>(std::floor(value / OpeningBook::kCellSize)));
+        }
+
+        /// \brief 手番のチームから見た点差を -2 から 2 に丸める．
+        int GetScoreBucket(dc::GameState const &game_state, dc::Team team)
+        {
+            auto const opponent = team == dc::Team::k0 ? dc::Team::k1 : dc::Team::k0;
+            int const diff = static_cast<int>(game_state.GetTotalScore(team)) - static_cast<int>(game_state.GetTotalScore(opponent));
+            return std::clamp(diff, -2, 2);
+        }
+
+    } // unnamed namespace
+
+    std::uint64_t OpeningBook::ComputeKey(dc::GameState const &game_state, dc::GameSetting const &game_setting)
+    {
+        auto const team = game_state.GetNextTeam();
+        bool const last_end = game_state.end + 1 >= game_setting.max_end;
+        std::uint64_t key = Mix(
+            static_cast<std::uint64_t>(game_state.shot)
+            | static_cast<std::uint64_t>(game_state.hammer == team) << 8
+            | static_cast<std::uint64_t>(GetScoreBucket(game_state, team) + 2) << 16
+            | static_cast<std::uint64_t>(last_end) << 24
+            | static_cast<std::uint64_t>(game_setting.five_rock_rule) << 32);
+        for (size_t t = 0; t < 2; ++t)
+        {
+            for (size_t i = 0; i < game_state.stones[t].size(); ++i)
+            {
+                auto const &stone = game_state.stones[t][i];
+                if (!stone)
+                    continue;
+                std::uint64_t const cell = static_cast<std::uint64_t>(QuantizeCell(stone->position.x)) << 32 | QuantizeCell(stone->position.y);
+                key ^= Mix(Mix(t * game_state.stones[t].size() + i) ^ cell);
+            }
+        }
+        return key;
+    }
+
+    std::optional<dc::moves::Shot> OpeningBook::Find(dc::GameState const &game_state, dc::GameSetting const &game_setting, float tolerance) const
+    {
+        if (!IsBookShot(game_state))
+            return std::nullopt;
+
+        std::uint64_t const key = ComputeKey(game_state, game_setting);
+        auto const entries = GetEntries();
+        auto const first = std::lower_bound(entries, entries + GetEntryCount(), key,
+            [](Entry const &e, std::uint64_t k) { return e.key < k; });
+        auto const last = std::upper_bound(first, entries + GetEntryCount(), key,
+            [](std::uint64_t k, Entry const &e) { return k < e.key; });
+
+        Entry const *closest = nullptr;
+        float closest_distance = std::numeric_limits<float>::infinity();
+        for (auto it = first; it != last; ++it)
+        {
+            float distance = 0.f;
+            for (size_t t = 0; t < 2 && distance <= tolerance; ++t)
+            {
+                for (size_t i = 0; i < game_state.stones[t].size(); ++i)
+                {
+                    auto const &stone = game_state.stones[t][i];
+                    float const *position = it->positions[t * game_state.stones[t].size() + i];
+                    if (stone.has_value() == std::isnan(position[0]))
+                    {
+                        distance = std::numeric_limits<float>::infinity(); // 盤面上のストーンの組が異なる
+                        break;
+                    }
+                    if (stone)
+                    {
+                        distance = std::max(distance, std::hypot(stone->position.x - position[0], stone->position.y - position[1]));
+                    }
+                }
+            }
+            if (distance <= tolerance && distance < closest_distance)
+            {
+                closest = it;
+                closest_distance = distance;
+            }
+        }
+
+        if (!closest)
+            return std::nullopt;
+        return dc::moves::Shot{ dc::Vector2(closest->velocity_x, closest->velocity_y),
+            closest->rotation == 0 ? dc::moves::Shot::Rotation::kCCW : dc::moves::Shot::Rotation::kCW };
+    }
+
+    void OpeningBook::Add(dc::GameState const &game_state, dc::GameSetting const &game_setting, dc::moves::Shot const &shot, std::uint32_t visits)
+    {
+        if (cache_)
+        {
+            entries_.assign(cached_entries_, cached_entries_ + cached_entry_count_);
+            cache_.reset();
+            cached_entries_ = nullptr;
+            cached_entry_count_ = 0;
+        }
+
+        Entry entry;
+        entry.key = ComputeKey(game_state, game_setting);
+        for (size_t t = 0; t < 2; ++t)
+        {
+            for (size_t i = 0; i < game_state.stones[t].size(); ++i)
+            {
+                auto const &stone = game_state.stones[t][i];
+                float *position = entry.positions[t * game_state.stones[t].size() + i];
+                position[0] = stone ? stone->position.x : std::numeric_limits<float>::quiet_NaN();
+                position[1] = stone ? stone->position.y : std::numeric_limits<float>::quiet_NaN();
+            }
+        }
+        entry.velocity_x = shot.velocity.x;
+        entry.velocity_y = shot.velocity.y;
+        entry.rotation = shot.rotation == dc::moves::Shot::Rotation::kCCW ? 0 : 1;
+        entry.visits = visits;
+
+        auto const position = std::upper_bound(entries_.begin(), entries_.end(), entry.key,
+            [](std::uint64_t key, Entry const &e) { return key < e.key; });
+        entries_.insert(position, entry);
+    }
+
+    bool OpeningBook::Load(std::shared_ptr<PrecomputeCache const> const &cache)
+    {
+        auto const section = cache->FindSection(CacheSection::kOpeningBook, kSectionVersion);
+        if (!section || section->size < sizeof(OpeningBookSectionHeader))
+            return false;
+
+        OpeningBookSectionHeader header;
+        std::memcpy(&header, section->data, sizeof(header));
+        if (header.max_shot != kMaxShot
+            || header.cell_size != kCellSize
+            || section->size != sizeof(header) + header.entry_count * sizeof(Entry))
+        {
+            return false; // キーの作り方が異なる定跡は使用しない
+        }
+
+        // 区画は64バイト境界に揃っているので，ヘッダの直後のエントリはそのまま参照できる
+        entries_.clear();
+        cache_ = cache;
+        cached_entries_ = reinterpret_cast<Entry const *>(static_cast<char const *>(section->data) + sizeof(header));
+        cached_entry_count_ = header.entry_count;
+        return true;
+    }
+
+    void OpeningBook::Store(PrecomputeCacheWriter &writer) const
+    {
+        OpeningBookSectionHeader header;
+        size_t const entry_count = GetEntryCount();
+        header.entry_count = static_cast<std::uint32_t>(entry_count);
+        header.max_shot = kMaxShot;
+        header.cell_size = kCellSize;
+        header.reserved = 0;
+
+        std::vector<char> data(sizeof(header) + entry_count * sizeof(Entry));
+        std::memcpy(data.data(), &header, sizeof(header));
+        if (entry_count > 0)
+        {
+            std::memcpy(data.data() + sizeof(header), GetEntries(), entry_count * sizeof(Entry));
+        }
+        writer.AddSection(CacheSection::kOpeningBook, kSectionVersion, data.data(), data.size());
+    }
+
+} // namespace obsidian
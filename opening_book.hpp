@@ -0,0 +1,87 @@
+#ifndef AICY_OBSIDIAN_OPENING_BOOK_HPP
+#define AICY_OBSIDIAN_OPENING_BOOK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "precompute_cache.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief エンドの序盤のショットについて，事前に深く探索した結果を局面から引く定跡です．
+    ///
+    /// 局面のキーは手番のチームから見たハンマーの有無，点差(-2 から 2 に丸める)，最終エンドか，ショット番号，
+    /// フリーガードゾーンのルールと，盤面上のストーンを kCellSize 四方の格子で量子化した位置のハッシュです．
+    /// 各エントリは探索した局面のストーン位置も保持し，Find() はキーが一致したエントリのうち
+    /// ストーン位置のずれが許容値以内で最も近いものだけを返します．
+    ///
+    /// エントリはキーの順に並べて二分探索で引きます．キャッシュから読み込んだ場合はキャッシュの領域を直接参照します．
+    /// 構築は自己対戦の実行ファイル(aicy_obsidian_self_play build-book)で行います．
+    class OpeningBook
+    {
+    public:
+        /// \brief 定跡の対象とするエンド内のショット数(0 から kMaxShot - 1 投目)
+        static constexpr std::uint8_t kMaxShot = 4;
+
+        /// \brief ストーン位置の量子化の単位[m]
+        static constexpr float kCellSize = 0.25f;
+
+        /// \brief Find() で採用するストーン位置のずれの許容値のデフォルト値[m]
+        static constexpr float kDefaultTolerance = 0.1f;
+
+        /// \brief 局面が定跡の対象か調べます．
+        static bool IsBookShot(dc::GameState const &game_state) { return game_state.shot < kMaxShot && !game_state.IsGameOver(); }
+
+        /// \brief 局面のキーを計算します．
+        static std::uint64_t ComputeKey(dc::GameState const &game_state, dc::GameSetting const &game_setting);
+
+        /// \brief 局面に対する定跡のショットを探します．
+        ///
+        /// \return 定跡の対象外の局面，または許容値以内のエントリが無い場合 std::nullopt
+        std::optional<dc::moves::Shot> Find(dc::GameState const &game_state, dc::GameSetting const &game_setting, float tolerance = kDefaultTolerance) const;
+
+        /// \brief エントリを追加します．キャッシュから読み込んだ定跡の場合は，読み込んだエントリをコピーしてから追加します．
+        ///
+        /// \param visits ショットを決めた探索の訪問回数
+        void Add(dc::GameState const &game_state, dc::GameSetting const &game_setting, dc::moves::Shot const &shot, std::uint32_t visits);
+
+        /// \brief エントリ数
+        size_t GetEntryCount() const { return cache_ ? cached_entry_count_ : entries_.size(); }
+
+        /// \brief キャッシュから定跡を読み込みます．エントリはコピーせずにキャッシュの領域を参照します．
+        ///
+        /// \return キャッシュに定跡が格納されていた場合 true
+        bool Load(std::shared_ptr<PrecomputeCache const> const &cache);
+
+        /// \brief キャッシュに定跡を追加します．
+        void Store(PrecomputeCacheWriter &writer) const;
+
+    private:
+        /// \brief キャッシュにそのまま格納するエントリ
+        struct Entry
+        {
+            std::uint64_t key;
+            float positions[dc::ISimulator::kStoneMax][2]; ///< ISimulator::AllStones の順のストーン位置．盤面上に無い場合は NaN
+            float velocity_x;
+            float velocity_y;
+            std::uint32_t rotation; ///< 0: kCCW, 1: kCW
+            std::uint32_t visits;
+        };
+
+        Entry const *GetEntries() const { return cache_ ? cached_entries_ : entries_.data(); }
+
+        std::vector<Entry> entries_;                   ///< キーの昇順．キャッシュを参照している場合は空
+        std::shared_ptr<PrecomputeCache const> cache_; ///< Load() で読み込んだキャッシュ
+        Entry const *cached_entries_ = nullptr;        ///< cache_ 内のエントリ．並びは entries_ と同じ
+        size_t cached_entry_count_ = 0;
+    };
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_OPENING_BOOK_HPP
@@ -0,0 +1,59 @@
+#include "ponder.hpp"
+
+namespace obsidian
+{
+
+    float GetStonesDistance(dc::GameState::Stones const &a, dc::GameState::Stones const &b)
+    {
+        float distance = 0.f;
+        for (size_t team = 0; team < 2; ++team)
+        {
+            for (size_t i = 0; i < a[team].size(); ++i)
+            {
+                auto const &stone_a = a[team][i];
+                auto const &stone_b = b[team][i];
+                if (stone_a.has_value() != stone_b.has_value())
+                    return std::numeric_limits<float>::infinity();
+                if (stone_a)
+                {
+                    distance = std::max(distance, (stone_a->position - stone_b->position).Length());
+                }
+            }
+        }
+        return distance;
+    }
+
+    void PonderThread::Start(Task task)
+    {
+        Stop();
+        stop_requested_ = false;
+        thread_ = std::thread([this, task = std::move(task)]
+        {
+            // 先読みの失敗は本来の思考には影響させない
+            try
+            {
+                task(stop_requested_);
+            }
+            catch (std::exception &e)
+            {
+                LogStream error_log(log_, LogLevel::kError);
+                error_log << "Ponder exception: " << e.what() << std::endl;
+            }
+            catch (...)
+            {
+                LogStream error_log(log_, LogLevel::kError);
+                error_log << "Ponder exception: unknown" << std::endl;
+            }
+        });
+    }
+
+    void PonderThread::Stop()
+    {
+        if (thread_.joinable())
+        {
+            stop_requested_ = true;
+            thread_.join();
+        }
+    }
+
+} // namespace obsidian
@@ -0,0 +1,138 @@
+#ifndef AICY_OBSIDIAN_PONDER_HPP
+#define AICY_OBSIDIAN_PONDER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "logger.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief 2つのストーン配置の最大のずれを求めます．
+    ///
+    /// \return 盤面上に存在するストーンの組が異なる場合は無限大，そうでない場合は各ストーンの位置のずれの最大値
+    float GetStonesDistance(dc::GameState::Stones const &a, dc::GameState::Stones const &b);
+
+    /// \brief 先読みした局面とその探索結果を保持するキャッシュです．
+    ///
+    /// 局面はエンド・ショット番号とストーン配置で識別し，検索時は指定した許容誤差内で最も近い局面を返します．
+    /// 1回の先読みで格納する局面は高々数個なので，線形探索で十分です．
+    ///
+    /// \tparam Result 探索結果の型
+    template <class Result>
+    class PonderCache
+    {
+    public:
+        /// \brief 検索結果
+        struct Match
+        {
+            Result result;
+            float distance; ///< 格納された局面とのストーン位置のずれの最大値
+        };
+
+        /// \brief 局面の探索結果を格納します．同じ局面が格納済みの場合は上書きします．
+        void Store(dc::GameState const &game_state, Result const &result)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto &entry : entries_)
+            {
+                if (entry.end == game_state.end && entry.shot == game_state.shot && GetStonesDistance(entry.stones, game_state.stones) == 0.f)
+                {
+                    entry.result = result;
+                    return;
+                }
+            }
+            entries_.push_back(Entry{game_state.end, game_state.shot, game_state.stones, result});
+        }
+
+        /// \brief 指定局面に最も近い局面の探索結果を返します．
+        ///
+        /// \param tolerance ストーン位置のずれの許容値
+        ///
+        /// \return 許容値以内の局面が無い場合は std::nullopt
+        std::optional<Match> FindClosest(dc::GameState const &game_state, float tolerance) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::optional<Match> closest;
+            for (auto const &entry : entries_)
+            {
+                if (entry.end != game_state.end || entry.shot != game_state.shot)
+                    continue;
+                float const distance = GetStonesDistance(entry.stones, game_state.stones);
+                if (distance <= tolerance && (!closest || distance < closest->distance))
+                {
+                    closest = Match{entry.result, distance};
+                }
+            }
+            return closest;
+        }
+
+        /// \brief 指定局面の探索結果を返します．
+        std::optional<Result> Find(dc::GameState const &game_state) const
+        {
+            if (auto const match = FindClosest(game_state, 0.f))
+                return match->result;
+            return std::nullopt;
+        }
+
+        void Clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_.clear();
+        }
+
+    private:
+        struct Entry
+        {
+            std::uint8_t end;
+            std::uint8_t shot;
+            dc::GameState::Stones stones;
+            Result result;
+        };
+
+        mutable std::mutex mutex_;
+        std::vector<Entry> entries_;
+    };
+
+    /// \brief 相手の手番中に先読みを行うバックグラウンドスレッドです．
+    class PonderThread
+    {
+    public:
+        /// \brief 先読み処理．引数の値が true になったら速やかに終了する必要がある．
+        using Task = std::function<void(std::atomic<bool> const &stop_requested)>;
+
+        /// \param log 先読み中の例外の出力先．nullptr の場合は何も出力しない
+        explicit PonderThread(Logger *log = nullptr) : log_(log) {}
+        PonderThread(PonderThread const &) = delete;
+        PonderThread &operator=(PonderThread const &) = delete;
+
+        ~PonderThread() { Stop(); }
+
+        /// \brief 先読みを開始します．実行中の先読みがあれば停止してから開始します．
+        void Start(Task task);
+
+        /// \brief 先読みの停止を要求し，終了を待ちます．
+        void Stop();
+
+        /// \brief 先読みを実行中か調べます．
+        bool IsRunning() const { return thread_.joinable(); }
+
+    private:
+        Logger *log_;
+        std::thread thread_;
+        std::atomic<bool> stop_requested_{false};
+    };
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_PONDER_HPP
@@ -0,0 +1,249 @@
+#include "precompute_cache.hpp"
+
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define AICY_OBSIDIAN_HAS_MMAP 1
+#endif
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        constexpr char kCacheMagic[8] = {'A', 'O', 'P', 'C', 'A', 'C', 'H', 'E'};
+
+        /// \brief ファイル全体の形式のバージョン．区画のデータ形式は区画ごとのバージョンで管理する
+        constexpr std::uint32_t kCacheFormatVersion = 1;
+
+        /// \brief 区画のデータの境界
+        constexpr size_t kSectionAlignment = 64;
+
+        struct CacheFileHeader
+        {
+            char magic[8];
+            std::uint32_t format_version;
+            std::uint32_t section_count;
+            std::uint64_t key_size;  ///< ヘッダの直後に続くキーの長さ
+            std::uint64_t file_size; ///< 途中で切れたファイルの検出に使う
+        };
+
+        /// \brief 区画の表の要素．キーの直後(8バイト境界)に section_count 個並ぶ
+        struct CacheSectionEntry
+        {
+            std::uint32_t section;
+            std::uint32_t version;
+            std::uint64_t offset;
+            std::uint64_t size;
+        };
+
+        constexpr size_t AlignUp(size_t value, size_t alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        size_t GetSectionTableOffset(size_t key_size)
+        {
+            return AlignUp(sizeof(CacheFileHeader) + key_size, alignof(CacheSectionEntry));
+        }
+
+        /// \brief \p path と同じディレクトリに他と重ならない名前の一時ファイルを作成し，\p image を書き込む．
+        ///
+        /// \param temp_path 作成した一時ファイルのパス．書き込みに失敗した場合は一時ファイルを削除する．
+        bool WriteTemporaryFile(std::string const &path, std::vector<std::byte> const &image, std::string &temp_path)
+        {
+#if defined(AICY_OBSIDIAN_HAS_MMAP)
+            std::string name = path + ".tmp.XXXXXX";
+            int const fd = ::mkstemp(name.data());
+            if (fd < 0)
+                return false;
+            temp_path = name;
+            ::fchmod(fd, 0644); // mkstemp() は所有者のみ読み書きできるファイルを作る
+
+            size_t written = 0;
+            while (written < image.size())
+            {
+                auto const result = ::write(fd, image.data() + written, image.size() - written);
+                if (result <= 0)
+                    break;
+                written += static_cast<size_t>(result);
+            }
+            bool const ok = ::close(fd) == 0 && written == image.size();
+#else
+            std::random_device random;
+            char suffix[17];
+            std::snprintf(suffix, sizeof(suffix), "%08x%08x", random(), random());
+            temp_path = path + ".tmp." + suffix;
+
+            bool ok;
+            {
+                std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+                ok = static_cast<bool>(file.write(reinterpret_cast<char const *>(image.data()), static_cast<std::streamsize>(image.size())));
+            }
+#endif
+            if (!ok)
+            {
+                std::remove(temp_path.c_str());
+            }
+            return ok;
+        }
+
+    } // unnamed namespace
+
+    std::string MakeCacheKey(dc::ISimulatorFactory const &simulator_factory)
+    {
+        std::string key = simulator_factory.GetSimulatorId();
+        if (auto const fcv1 = dynamic_cast<dc::simulators::SimulatorFCV1Factory const *>(&simulator_factory))
+        {
+            // 往復変換で元の値に戻る最短の表記にする
+            char buf[32];
+            auto const result = std::to_chars(buf, buf + sizeof(buf), fcv1->seconds_per_frame);
+            key += " seconds_per_frame=";
+            key.append(buf, result.ptr);
+        }
+        return key;
+    }
+
+    PrecomputeCache::~PrecomputeCache()
+    {
+#if defined(AICY_OBSIDIAN_HAS_MMAP)
+        if (mapped_)
+        {
+            munmap(const_cast<std::byte *>(data_), size_);
+        }
+#endif
+    }
+
+    std::shared_ptr<PrecomputeCache const> PrecomputeCache::Open(std::string const &path, std::string_view key)
+    {
+        std::shared_ptr<PrecomputeCache> cache(new PrecomputeCache());
+
+#if defined(AICY_OBSIDIAN_HAS_MMAP)
+        int const fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0)
+        {
+            close(fd);
+            return nullptr;
+        }
+        void *const address = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd); // マップはファイルを閉じても有効
+        if (address == MAP_FAILED)
+            return nullptr;
+        cache->data_ = static_cast<std::byte const *>(address);
+        cache->size_ = static_cast<size_t>(st.st_size);
+        cache->mapped_ = true;
+#else
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return nullptr;
+        cache->buffer_.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        if (!file.read(reinterpret_cast<char *>(cache->buffer_.data()), static_cast<std::streamsize>(cache->buffer_.size())))
+            return nullptr;
+        cache->data_ = cache->buffer_.data();
+        cache->size_ = cache->buffer_.size();
+#endif
+
+        CacheFileHeader header;
+        if (cache->size_ < sizeof(header))
+            return nullptr;
+        std::memcpy(&header, cache->data_, sizeof(header));
+        if (std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0
+            || header.format_version != kCacheFormatVersion
+            || header.file_size != cache->size_
+            || header.key_size != key.size()
+            || GetSectionTableOffset(key.size()) + header.section_count * sizeof(CacheSectionEntry) > cache->size_
+            || std::memcmp(cache->data_ + sizeof(header), key.data(), key.size()) != 0)
+        {
+            return nullptr; // 別のシミュレータや古い形式のキャッシュは使用しない
+        }
+        return cache;
+    }
+
+    std::optional<PrecomputeCache::Section> PrecomputeCache::FindSection(CacheSection section, std::uint32_t version) const
+    {
+        CacheFileHeader header;
+        std::memcpy(&header, data_, sizeof(header));
+        auto const entries = reinterpret_cast<CacheSectionEntry const *>(data_ + GetSectionTableOffset(header.key_size));
+        for (std::uint32_t i = 0; i < header.section_count; ++i)
+        {
+            auto const &entry = entries[i];
+            if (entry.section != static_cast<std::uint32_t>(section) || entry.version != version)
+                continue;
+            if (entry.offset > size_ || entry.size > size_ - entry.offset)
+                return std::nullopt;
+            return Section{ data_ + entry.offset, static_cast<size_t>(entry.size) };
+        }
+        return std::nullopt;
+    }
+
+    PrecomputeCacheWriter::PrecomputeCacheWriter(std::string key)
+        : key_(std::move(key))
+    {
+    }
+
+    void PrecomputeCacheWriter::AddSection(CacheSection section, std::uint32_t version, void const *data, size_t size)
+    {
+        auto const first = static_cast<std::byte const *>(data);
+        sections_.push_back(PendingSection{ section, version, std::vector<std::byte>(first, first + size) });
+    }
+
+    bool PrecomputeCacheWriter::Save(std::string const &path) const
+    {
+        // 配置を決める
+        size_t const table_offset = GetSectionTableOffset(key_.size());
+        size_t offset = AlignUp(table_offset + sections_.size() * sizeof(CacheSectionEntry), kSectionAlignment);
+        std::vector<CacheSectionEntry> entries;
+        for (auto const &section : sections_)
+        {
+            entries.push_back(CacheSectionEntry{ static_cast<std::uint32_t>(section.section), section.version, offset, section.data.size() });
+            offset = AlignUp(offset + section.data.size(), kSectionAlignment);
+        }
+
+        CacheFileHeader header;
+        std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+        header.format_version = kCacheFormatVersion;
+        header.section_count = static_cast<std::uint32_t>(sections_.size());
+        header.key_size = key_.size();
+        header.file_size = offset;
+
+        std::vector<std::byte> image(offset);
+        std::memcpy(image.data(), &header, sizeof(header));
+        std::memcpy(image.data() + sizeof(header), key_.data(), key_.size());
+        std::memcpy(image.data() + table_offset, entries.data(), entries.size() * sizeof(CacheSectionEntry));
+        for (size_t i = 0; i < sections_.size(); ++i)
+        {
+            std::memcpy(image.data() + entries[i].offset, sections_[i].data.data(), sections_[i].data.size());
+        }
+
+        // 同時に起動した他のプロセスも同じキャッシュを書き出しうるので，一時ファイルはプロセスごとに別にする
+        std::string temp_path;
+        if (!WriteTemporaryFile(path, image, temp_path))
+            return false;
+        if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+        {
+            // 置き換え先が存在すると rename できない環境向け
+            std::remove(path.c_str());
+            if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+            {
+                std::remove(temp_path.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+
+} // namespace obsidian
@@ -0,0 +1,104 @@
+#ifndef AICY_OBSIDIAN_PRECOMPUTE_CACHE_HPP
+#define AICY_OBSIDIAN_PRECOMPUTE_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief キャッシュに格納する事前計算の種類
+    enum class CacheSection : std::uint32_t
+    {
+        kVelocityTable = 1, ///< VelocityTable
+        kOpeningBook = 2,   ///< OpeningBook
+    };
+
+    /// \brief シミュレータの ID とパラメータからキャッシュのキーを作成します．
+    ///
+    /// 同じキーのシミュレータであれば，事前計算の結果が一致します．
+    std::string MakeCacheKey(dc::ISimulatorFactory const &simulator_factory);
+
+    /// \brief 事前計算の結果を格納したキャッシュファイルを読込み専用でメモリにマップしたものです．
+    ///
+    /// ファイルはヘッダ(マジック，形式のバージョン，キー)，区画の表，64バイト境界に揃えた各区画のデータからなります．
+    /// 区画のデータはマップした領域をそのまま参照するので，読込み時のコピーは無く，
+    /// 同じファイルを開いた複数のプロセスは同じページを共有します．
+    /// mmap の無い環境ではファイル全体をメモリに読み込みます．
+    class PrecomputeCache
+    {
+    public:
+        /// \brief 区画のデータ
+        struct Section
+        {
+            void const *data; ///< 64バイト境界に揃っている
+            size_t size;
+        };
+
+        PrecomputeCache(PrecomputeCache const &) = delete;
+        PrecomputeCache &operator=(PrecomputeCache const &) = delete;
+        ~PrecomputeCache();
+
+        /// \brief キャッシュファイルを開きます．
+        ///
+        /// \param path ファイルのパス
+        ///
+        /// \param key MakeCacheKey() で作成したキー
+        ///
+        /// \return ファイルが無い場合，形式やキーが異なる場合は nullptr
+        static std::shared_ptr<PrecomputeCache const> Open(std::string const &path, std::string_view key);
+
+        /// \brief 区画を探します．
+        ///
+        /// \param version 区画のデータ形式のバージョン．異なる場合は見つからなかったものとする
+        std::optional<Section> FindSection(CacheSection section, std::uint32_t version) const;
+
+    private:
+        PrecomputeCache() = default;
+
+        std::byte const *data_ = nullptr;
+        size_t size_ = 0;
+        bool mapped_ = false;              ///< data_ が mmap した領域の場合 true
+        std::vector<std::byte> buffer_;    ///< mmap できない場合の読込み先
+    };
+
+    /// \brief キャッシュファイルを作成します．
+    class PrecomputeCacheWriter
+    {
+    public:
+        /// \param key MakeCacheKey() で作成したキー
+        explicit PrecomputeCacheWriter(std::string key);
+
+        /// \brief 区画を追加します．\p data はコピーします．
+        void AddSection(CacheSection section, std::uint32_t version, void const *data, size_t size);
+
+        /// \brief ファイルに書き出します．
+        ///
+        /// 一時ファイルに書き出してから置き換えるので，古いファイルをマップしているプロセスには影響しません．
+        ///
+        /// \return 書き出しに成功した場合 true
+        bool Save(std::string const &path) const;
+
+    private:
+        struct PendingSection
+        {
+            CacheSection section;
+            std::uint32_t version;
+            std::vector<std::byte> data;
+        };
+
+        std::string key_;
+        std::vector<PendingSection> sections_;
+    };
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_PRECOMPUTE_CACHE_HPP
@@ -0,0 +1,91 @@
+#include "protocol_message.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        /// \brief 読み捨てるキー
+        constexpr std::string_view kTrajectoryKey = "trajectory";
+
+    } // unnamed namespace
+
+    void AppendFloat(std::string &output, float value)
+    {
+        char buf[32];
+        auto const result = std::to_chars(buf, buf + sizeof(buf), value);
+        output.append(buf, result.ptr);
+    }
+
+    char *LineBuffer::Prepare(size_t size)
+    {
+        if (begin_ == end_)
+        {
+            begin_ = scan_ = end_ = 0;
+        }
+        else if (buffer_.size() - end_ < size && begin_ > 0)
+        {
+            // 未完成の行だけを先頭に詰める
+            std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+            scan_ -= begin_;
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if (buffer_.size() - end_ < size)
+        {
+            buffer_.resize(std::max(end_ + size, buffer_.size() * 2));
+        }
+        return buffer_.data() + end_;
+    }
+
+    std::optional<std::string_view> LineBuffer::NextLine()
+    {
+        auto const first = buffer_.data() + scan_;
+        auto const last = buffer_.data() + end_;
+        auto const new_line = std::find(first, last, '\n');
+        if (new_line == last)
+        {
+            scan_ = end_;
+            return std::nullopt;
+        }
+        std::string_view const line(buffer_.data() + begin_, static_cast<size_t>(new_line - (buffer_.data() + begin_)));
+        begin_ = scan_ = static_cast<size_t>(new_line - buffer_.data()) + 1;
+        return line;
+    }
+
+    nlohmann::json ParseMessage(std::string_view line)
+    {
+        return nlohmann::json::parse(line.begin(), line.end(),
+            [](int, nlohmann::json::parse_event_t event, nlohmann::json &parsed)
+            {
+                // キーで false を返すと，そのキーの値は DOM に追加されない
+                return event != nlohmann::json::parse_event_t::key || parsed != kTrajectoryKey;
+            });
+    }
+
+    void AppendMoveMessage(std::string &output, dc::Move const &move)
+    {
+        output += R"({"cmd":"move","move":)";
+        if (std::holds_alternative<dc::moves::Shot>(move))
+        {
+            auto const &shot = std::get<dc::moves::Shot>(move);
+            output += R"({"type":"shot","velocity":{"x":)";
+            AppendFloat(output, shot.velocity.x);
+            output += R"(,"y":)";
+            AppendFloat(output, shot.velocity.y);
+            output += R"(},"rotation":)";
+            output += shot.rotation == dc::moves::Shot::Rotation::kCCW ? R"("ccw"})" : R"("cw"})";
+        }
+        else
+        {
+            output += R"({"type":"concede"})";
+        }
+        output += "}\n";
+    }
+
+} // namespace obsidian
@@ -0,0 +1,61 @@
+#ifndef AICY_OBSIDIAN_PROTOCOL_MESSAGE_HPP
+#define AICY_OBSIDIAN_PROTOCOL_MESSAGE_HPP
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief 受信データを改行で区切って取り出すバッファです．
+    ///
+    /// 受信データは1つの連続した領域に追記し，取り出した行はその領域を指す string_view で返すので，行ごとのコピーや
+    /// 先頭からの削除による詰め直しは起きません．詰め直しは追記する空きが足りない場合に，未完成の行の分だけ行います．
+    class LineBuffer
+    {
+    public:
+        /// \brief 受信データの書込み先を \p size バイト以上確保して返します．書き込んだら Commit() を呼んでください．
+        ///
+        /// これまでに NextLine() で返した行は無効になります．
+        char *Prepare(size_t size);
+
+        /// \brief Prepare() で確保した領域の先頭 \p size バイトを受信データとして確定します．
+        void Commit(size_t size) { end_ += size; }
+
+        /// \brief 完成した行を1行取り出します．
+        ///
+        /// \return 改行を含まない行．完成した行が無い場合は std::nullopt．次の Prepare() まで有効
+        std::optional<std::string_view> NextLine();
+
+    private:
+        std::vector<char> buffer_;
+        size_t begin_ = 0; ///< 取り出していないデータの先頭
+        size_t scan_ = 0;  ///< 改行を探し終えた位置
+        size_t end_ = 0;   ///< 受信データの末尾
+    };
+
+    /// \brief 受信した1行をパースします．
+    ///
+    /// update メッセージの last_move.trajectory (ショット中の全ストーンの軌跡)は試合の進行に不要で，
+    /// メッセージの大部分を占めるため，パース中に読み捨てて DOM を構築しません．
+    nlohmann::json ParseMessage(std::string_view line);
+
+    /// \brief \p value を往復変換で元の値に戻る最短の10進表記で \p output の末尾に書き込みます．
+    ///
+    /// サーバーへの move メッセージと評価ノードとのメッセージで，同じ float が同じ表記になるように共通で使用します．
+    void AppendFloat(std::string &output, float value);
+
+    /// \brief move メッセージ(末尾の改行を含む)を \p output の末尾に書き込みます．
+    ///
+    /// json の DOM を経由せずに直接書き込むので，容量の足りている \p output を再利用すればメモリ確保は起きません．
+    void AppendMoveMessage(std::string &output, dc::Move const &move);
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_PROTOCOL_MESSAGE_HPP
@@ -0,0 +1,483 @@
+#include "remote_rollout.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <boost/asio.hpp>
+#include "protocol_message.hpp"
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        using boost::asio::ip::tcp;
+
+        /// \brief 1回の受信で確保するバッファの大きさ
+        constexpr size_t kReadSize = 64 * 1024;
+
+        void AppendInteger(std::string &output, std::uint64_t value)
+        {
+            char buf[32];
+            auto const result = std::to_chars(buf, buf + sizeof(buf), value);
+            output.append(buf, result.ptr);
+        }
+
+        /// \brief 存在するストーンのビットマスクと，存在するストーンの x, y, angle を順に書き込む．
+        void AppendStones(std::string &output, std::uint16_t exists, BoardSnapshot::Stone const *stones)
+        {
+            AppendInteger(output, exists);
+            for (size_t i = 0; i < BoardSnapshot::kStoneCount; ++i)
+            {
+                if ((exists >> i & 1) == 0)
+                    continue;
+                output += ',';
+                AppendFloat(output, stones[i].x);
+                output += ',';
+                AppendFloat(output, stones[i].y);
+                output += ',';
+                AppendFloat(output, stones[i].angle);
+            }
+        }
+
+        /// \brief AppendStones() で書き込んだ配列の \p offset 以降を読み込む．
+        std::uint16_t ParseStones(nlohmann::json const &values, size_t offset, BoardSnapshot::Stone *stones)
+        {
+            auto const exists = values.at(offset).get<std::uint16_t>();
+            size_t k = offset + 1;
+            for (size_t i = 0; i < BoardSnapshot::kStoneCount; ++i)
+            {
+                if ((exists >> i & 1) == 0)
+                {
+                    stones[i] = BoardSnapshot::Stone{ 0.f, 0.f, 0.f };
+                    continue;
+                }
+                stones[i].x = values.at(k).get<float>();
+                stones[i].y = values.at(k + 1).get<float>();
+                stones[i].angle = values.at(k + 2).get<float>();
+                k += 3;
+            }
+            return exists;
+        }
+
+    } // unnamed namespace
+
+    namespace remote_message
+    {
+
+        void AppendInit(std::string &output, dc::GameSetting const &game_setting, dc::ISimulatorFactory const &simulator_factory, bool use_fcv1_kernel)
+        {
+            auto const factory = simulator_factory.Clone();
+            nlohmann::json const jout = {
+                {"cmd", "init"},
+                {"game_setting", game_setting},
+                {"simulator", factory},
+                {"fcv1_kernel", use_fcv1_kernel}};
+            output += jout.dump();
+            output += '\n';
+        }
+
+        void AppendInitOk(std::string &output, size_t worker_count)
+        {
+            output += R"({"cmd":"init_ok","workers":)";
+            AppendInteger(output, worker_count);
+            output += "}\n";
+        }
+
+        void AppendRollout(std::string &output, std::uint64_t id, RemoteRolloutRequest const *requests, size_t count)
+        {
+            // 試行は [ショット番号, ハンマー, ビットマスク, ストーン..., vx, vy, 回転方向(0: ccw, 1: cw)]
+            output += R"({"cmd":"rollout","id":)";
+            AppendInteger(output, id);
+            output += R"(,"jobs":[)";
+            for (size_t i = 0; i < count; ++i)
+            {
+                auto const &request = requests[i];
+                output += i == 0 ? "[" : ",[";
+                AppendInteger(output, request.board.shot);
+                output += ',';
+                AppendInteger(output, request.board.hammer);
+                output += ',';
+                AppendStones(output, request.board.exists, request.board.stones.data());
+                output += ',';
+                AppendFloat(output, request.shot.velocity.x);
+                output += ',';
+                AppendFloat(output, request.shot.velocity.y);
+                output += request.shot.rotation == dc::moves::Shot::Rotation::kCCW ? ",0]" : ",1]";
+            }
+            output += "]}\n";
+        }
+
+        void AppendResult(std::string &output, std::uint64_t id, dc::GameState::Stones const *results, size_t count)
+        {
+            // 結果は [ビットマスク, ストーン...]．インデックスは ISimulator::AllStones と同じ
+            output += R"({"cmd":"result","id":)";
+            AppendInteger(output, id);
+            output += R"(,"stones":[)";
+            for (size_t i = 0; i < count; ++i)
+            {
+                BoardSnapshot board{};
+                board.SetStones(results[i]);
+                output += i == 0 ? "[" : ",[";
+                AppendStones(output, board.exists, board.stones.data());
+                output += ']';
+            }
+            output += "]}\n";
+        }
+
+        std::vector<RemoteRolloutRequest> ParseRollout(nlohmann::json const &message)
+        {
+            std::vector<RemoteRolloutRequest> requests;
+            for (auto const &job : message.at("jobs"))
+            {
+                auto &request = requests.emplace_back();
+                request.board.shot = job.at(0).get<std::uint8_t>();
+                request.board.hammer = job.at(1).get<std::uint8_t>();
+                request.board.exists = ParseStones(job, 2, request.board.stones.data());
+                size_t const n = job.size();
+                request.shot.velocity = dc::Vector2(job.at(n - 3).get<float>(), job.at(n - 2).get<float>());
+                request.shot.rotation = job.at(n - 1).get<int>() == 0 ? dc::moves::Shot::Rotation::kCCW : dc::moves::Shot::Rotation::kCW;
+            }
+            return requests;
+        }
+
+        std::vector<dc::GameState::Stones> ParseResult(nlohmann::json const &message)
+        {
+            std::vector<dc::GameState::Stones> results;
+            for (auto const &values : message.at("stones"))
+            {
+                BoardSnapshot board{};
+                board.exists = ParseStones(values, 0, board.stones.data());
+                results.push_back(board.ToGameStones());
+            }
+            return results;
+        }
+
+    } // namespace remote_message
+
+    /// \brief 1つの評価ノードとの接続．ソケットと送受信のバッファは通信スレッドのみが操作する．
+    struct RemoteRolloutClient::Node
+    {
+        Node(boost::asio::io_context &io_context, std::string endpoint)
+            : endpoint(std::move(endpoint))
+            , resolver(io_context)
+            , socket(io_context)
+        {
+        }
+
+        std::string endpoint;
+        tcp::resolver resolver;
+        tcp::socket socket;
+        LineBuffer input;
+        std::vector<std::string> output_queue;
+
+        // 以下は State::mutex で保護する
+        bool connected = false;                ///< init_ok を受信した
+        bool failed = false;                   ///< 接続や通信に失敗した
+        size_t worker_count = 0;
+        std::optional<std::uint64_t> pending_id; ///< 結果を待っている rollout の id
+        size_t first = 0;                      ///< 依頼した試行の Submit() の引数での位置
+        size_t count = 0;                      ///< 依頼した試行の数
+    };
+
+    struct RemoteRolloutClient::State
+    {
+        boost::asio::io_context io_context;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_guard{ boost::asio::make_work_guard(io_context) };
+        std::vector<std::unique_ptr<Node>> nodes;
+        std::thread thread;
+
+        mutable std::mutex mutex;
+        std::condition_variable condition;
+        std::uint64_t next_id = 1;
+        std::uint64_t current_id = 0; ///< 回収を待っている Submit() の id．0 の場合は無し
+        std::vector<std::optional<dc::GameState::Stones>> results;
+        size_t outstanding = 0;       ///< current_id の結果を返していない評価ノードの数
+        size_t received_count = 0;
+        size_t missed_count = 0;
+
+        void Connect(Node &node, std::string init_message)
+        {
+            auto const host_port = SplitEndpoint(node.endpoint);
+            if (!host_port)
+            {
+                Fail(node);
+                return;
+            }
+            node.resolver.async_resolve(host_port->first, host_port->second,
+                [this, &node, init_message = std::move(init_message)](boost::system::error_code const &error, tcp::resolver::results_type const &endpoints) mutable
+                {
+                    if (error)
+                    {
+                        Fail(node);
+                        return;
+                    }
+                    boost::asio::async_connect(node.socket, endpoints,
+                        [this, &node, init_message = std::move(init_message)](boost::system::error_code const &error, tcp::endpoint const &) mutable
+                        {
+                            if (error)
+                            {
+                                Fail(node);
+                                return;
+                            }
+                            boost::system::error_code ignored;
+                            node.socket.set_option(tcp::no_delay(true), ignored);
+                            Send(node, std::move(init_message));
+                            Read(node);
+                        });
+                });
+        }
+
+        void Read(Node &node)
+        {
+            node.socket.async_read_some(boost::asio::buffer(node.input.Prepare(kReadSize), kReadSize),
+                [this, &node](boost::system::error_code const &error, size_t size)
+                {
+                    if (error)
+                    {
+                        Fail(node);
+                        return;
+                    }
+                    node.input.Commit(size);
+                    while (auto const line = node.input.NextLine())
+                    {
+                        if (!HandleLine(node, *line))
+                        {
+                            Fail(node);
+                            return;
+                        }
+                    }
+                    Read(node);
+                });
+        }
+
+        void Send(Node &node, std::string message)
+        {
+            node.output_queue.push_back(std::move(message));
+            if (node.output_queue.size() == 1)
+            {
+                WriteNext(node);
+            }
+        }
+
+        void WriteNext(Node &node)
+        {
+            boost::asio::async_write(node.socket, boost::asio::buffer(node.output_queue.front()),
+                [this, &node](boost::system::error_code const &error, size_t)
+                {
+                    if (error)
+                    {
+                        Fail(node);
+                        return;
+                    }
+                    node.output_queue.erase(node.output_queue.begin());
+                    if (!node.output_queue.empty())
+                    {
+                        WriteNext(node);
+                    }
+                });
+        }
+
+        /// \brief 受信した1行を処理する．不正なメッセージの場合 false を返す．
+        bool HandleLine(Node &node, std::string_view line)
+        {
+            try
+            {
+                auto const jin = nlohmann::json::parse(line.begin(), line.end());
+                auto const cmd = jin.at("cmd").get<std::string>();
+                if (cmd == "init_ok")
+                {
+                    std::lock_guard lock(mutex);
+                    node.worker_count = std::max<size_t>(jin.at("workers").get<size_t>(), 1);
+                    node.connected = true;
+                    return true;
+                }
+                if (cmd != "result")
+                    return false;
+
+                auto const id = jin.at("id").get<std::uint64_t>();
+                auto const stones = remote_message::ParseResult(jin);
+                std::lock_guard lock(mutex);
+                if (node.pending_id != id)
+                    return true; // 捨てた依頼の結果
+                node.pending_id.reset();
+                if (id == current_id)
+                {
+                    for (size_t i = 0; i < node.count && i < stones.size(); ++i)
+                    {
+                        results[node.first + i] = stones[i];
+                    }
+                    --outstanding;
+                    condition.notify_all();
+                }
+                return true;
+            }
+            catch (std::exception &)
+            {
+                return false;
+            }
+        }
+
+        /// \brief 評価ノードを以降使用しないようにする．待っている結果は返らなかったものとする．
+        void Fail(Node &node)
+        {
+            {
+                std::lock_guard lock(mutex);
+                if (node.failed)
+                    return;
+                node.failed = true;
+                node.connected = false;
+                if (node.pending_id && *node.pending_id == current_id)
+                {
+                    --outstanding;
+                    condition.notify_all();
+                }
+                node.pending_id.reset();
+            }
+            boost::system::error_code ignored;
+            node.socket.close(ignored);
+        }
+    };
+
+    RemoteRolloutClient::RemoteRolloutClient(
+        std::vector<std::string> const &endpoints,
+        dc::GameSetting const &game_setting,
+        dc::ISimulatorFactory const &simulator_factory,
+        bool use_fcv1_kernel)
+        : state_(std::make_unique<State>())
+    {
+        std::string init_message;
+        remote_message::AppendInit(init_message, game_setting, simulator_factory, use_fcv1_kernel);
+        for (auto const &endpoint : endpoints)
+        {
+            auto &node = *state_->nodes.emplace_back(std::make_unique<Node>(state_->io_context, endpoint));
+            boost::asio::post(state_->io_context, [state = state_.get(), &node, init_message]() mutable
+            {
+                state->Connect(node, std::move(init_message));
+            });
+        }
+        state_->thread = std::thread([state = state_.get()]
+        {
+            state->io_context.run();
+        });
+    }
+
+    RemoteRolloutClient::~RemoteRolloutClient()
+    {
+        // 通信スレッドを止めてからソケットを破棄する
+        state_->work_guard.reset();
+        state_->io_context.stop();
+        state_->thread.join();
+    }
+
+    size_t RemoteRolloutClient::GetIdleWorkerCount() const
+    {
+        std::lock_guard lock(state_->mutex);
+        size_t count = 0;
+        for (auto const &node : state_->nodes)
+        {
+            if (node->connected && !node->pending_id)
+                count += node->worker_count;
+        }
+        return count;
+    }
+
+    size_t RemoteRolloutClient::GetConnectedNodeCount() const
+    {
+        std::lock_guard lock(state_->mutex);
+        return static_cast<size_t>(std::count_if(state_->nodes.begin(), state_->nodes.end(), [](auto const &node) { return node->connected; }));
+    }
+
+    bool RemoteRolloutClient::Submit(RemoteRolloutRequest const *requests, size_t count)
+    {
+        std::lock_guard lock(state_->mutex);
+        std::vector<Node *> idle_nodes;
+        size_t total_workers = 0;
+        for (auto const &node : state_->nodes)
+        {
+            if (node->connected && !node->pending_id)
+            {
+                idle_nodes.push_back(node.get());
+                total_workers += node->worker_count;
+            }
+        }
+        if (idle_nodes.empty() || count == 0)
+            return false;
+
+        // ワーカー数に比例して連続した範囲を割り当てる
+        std::uint64_t const id = state_->next_id++;
+        state_->current_id = id;
+        state_->results.assign(count, std::nullopt);
+        state_->outstanding = 0;
+        size_t cumulative_workers = 0;
+        for (auto *node : idle_nodes)
+        {
+            size_t const first = count * cumulative_workers / total_workers;
+            cumulative_workers += node->worker_count;
+            size_t const last = count * cumulative_workers / total_workers;
+            if (first == last)
+                continue;
+
+            node->pending_id = id;
+            node->first = first;
+            node->count = last - first;
+            ++state_->outstanding;
+
+            std::string message;
+            remote_message::AppendRollout(message, id, requests + first, last - first);
+            boost::asio::post(state_->io_context, [state = state_.get(), node, message = std::move(message)]() mutable
+            {
+                state->Send(*node, std::move(message));
+            });
+        }
+        return true;
+    }
+
+    size_t RemoteRolloutClient::Collect(std::optional<dc::GameState::Stones> *results, std::chrono::steady_clock::time_point deadline)
+    {
+        std::unique_lock lock(state_->mutex);
+        if (state_->current_id == 0)
+            return 0;
+        state_->condition.wait_until(lock, deadline, [this] { return state_->outstanding == 0; });
+
+        size_t received = 0;
+        for (size_t i = 0; i < state_->results.size(); ++i)
+        {
+            results[i] = state_->results[i];
+            if (results[i])
+                ++received;
+        }
+        state_->received_count += received;
+        state_->missed_count += state_->results.size() - received;
+
+        // 締切に間に合わなかった結果は捨てる．その評価ノードは結果を返すまで依頼を受けない
+        state_->current_id = 0;
+        state_->outstanding = 0;
+        state_->results.clear();
+        return received;
+    }
+
+    size_t RemoteRolloutClient::GetReceivedCount() const
+    {
+        std::lock_guard lock(state_->mutex);
+        return state_->received_count;
+    }
+
+    size_t RemoteRolloutClient::GetMissedCount() const
+    {
+        std::lock_guard lock(state_->mutex);
+        return state_->missed_count;
+    }
+
+    std::optional<std::pair<std::string, std::string>> SplitEndpoint(std::string_view endpoint)
+    {
+        auto const colon = endpoint.rfind(':');
+        if (colon == std::string_view::npos || colon == 0 || colon + 1 == endpoint.size())
+            return std::nullopt;
+        return std::make_pair(std::string(endpoint.substr(0, colon)), std::string(endpoint.substr(colon + 1)));
+    }
+
+} // namespace obsidian
@@ -0,0 +1,131 @@
+#ifndef AICY_OBSIDIAN_REMOTE_ROLLOUT_HPP
+#define AICY_OBSIDIAN_REMOTE_ROLLOUT_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "board_snapshot.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief 評価ノードに依頼する1回のロールアウトです．
+    ///
+    /// ショットのブレは依頼側で加えておき，評価ノードはブレの無いプレイヤーで投げます．
+    /// 共通乱数(CommonShotNoise)の k 番目のブレを加えたショットを送るので，乱数の種を送る場合と同じく結果は依頼側で再現できます．
+    struct RemoteRolloutRequest
+    {
+        BoardSnapshot board;
+        dc::moves::Shot shot;
+    };
+
+    /// \brief 評価ノードとの通信のメッセージです．
+    ///
+    /// 1行1メッセージの JSON で，サーバーとの通信と同じく改行で区切ります．
+    /// 接続後に依頼側が init を送ると，評価ノードはワーカー数を含む init_ok を返します．
+    /// その後は依頼側の rollout に対して，評価ノードが同じ id の result を返します．
+    /// rollout の各試行と result の各結果は，数値の配列に詰めて送ります．
+    namespace remote_message
+    {
+        /// \brief init メッセージ(末尾の改行を含む)を \p output の末尾に書き込みます．
+        ///
+        /// \param use_fcv1_kernel 評価ノードでも BoardSimulatorFCV1 を使用するか(依頼側と同じシミュレータで試行するため)
+        void AppendInit(std::string &output, dc::GameSetting const &game_setting, dc::ISimulatorFactory const &simulator_factory, bool use_fcv1_kernel);
+
+        /// \brief init_ok メッセージ(末尾の改行を含む)を \p output の末尾に書き込みます．
+        void AppendInitOk(std::string &output, size_t worker_count);
+
+        /// \brief rollout メッセージ(末尾の改行を含む)を \p output の末尾に書き込みます．
+        void AppendRollout(std::string &output, std::uint64_t id, RemoteRolloutRequest const *requests, size_t count);
+
+        /// \brief result メッセージ(末尾の改行を含む)を \p output の末尾に書き込みます．
+        void AppendResult(std::string &output, std::uint64_t id, dc::GameState::Stones const *results, size_t count);
+
+        /// \brief rollout メッセージの試行を取り出します．
+        std::vector<RemoteRolloutRequest> ParseRollout(nlohmann::json const &message);
+
+        /// \brief result メッセージの結果を取り出します．
+        std::vector<dc::GameState::Stones> ParseResult(nlohmann::json const &message);
+    } // namespace remote_message
+
+    /// \brief 評価ノードにロールアウトを依頼するクライアントです．
+    ///
+    /// 評価ノード(aicy_obsidian_evaluation_node)への接続と通信は専用のスレッドの io_context 上で非同期に行うので，
+    /// Submit() で依頼してから Collect() で回収するまでの間，呼出し元はローカルの試行を進められます．
+    /// 接続や通信に失敗した評価ノードはそれ以降使用しません．締切までに返らなかった結果は捨てるので，
+    /// 呼出し元はその分をローカルで試行し直してください．
+    ///
+    /// Submit() と Collect() は同時に1スレッドからのみ呼び出せます．
+    class RemoteRolloutClient
+    {
+    public:
+        /// \brief 評価ノードへの接続を開始します．接続の完了は待ちません．
+        ///
+        /// \param endpoints 評価ノードの "ホスト:ポート" の一覧
+        ///
+        /// \param game_setting 試合設定
+        ///
+        /// \param simulator_factory 試合で使用されるシミュレータの情報．評価ノードでも同じシミュレータを使用する
+        ///
+        /// \param use_fcv1_kernel 評価ノードでも BoardSimulatorFCV1 を使用するか
+        RemoteRolloutClient(
+            std::vector<std::string> const &endpoints,
+            dc::GameSetting const &game_setting,
+            dc::ISimulatorFactory const &simulator_factory,
+            bool use_fcv1_kernel);
+
+        RemoteRolloutClient(RemoteRolloutClient const &) = delete;
+        RemoteRolloutClient &operator=(RemoteRolloutClient const &) = delete;
+
+        ~RemoteRolloutClient();
+
+        /// \brief 依頼を受けられる(接続済みで前回の依頼の結果を返し終えた)評価ノードのワーカー数の合計
+        size_t GetIdleWorkerCount() const;
+
+        /// \brief 接続済みの評価ノードの数
+        size_t GetConnectedNodeCount() const;
+
+        /// \brief 依頼を受けられる評価ノードに，ワーカー数に比例して試行を分けて送ります．
+        ///
+        /// 前回の Submit() の結果で回収していないものは捨てます．
+        ///
+        /// \return 送った場合 true．依頼を受けられる評価ノードが無い場合は何もせず false
+        bool Submit(RemoteRolloutRequest const *requests, size_t count);
+
+        /// \brief 直前の Submit() の結果が全て返るか，\p deadline を過ぎるまで待ちます．
+        ///
+        /// \param results Submit() の試行と同じ順に結果を書き込む．締切までに返らなかった試行は std::nullopt
+        ///
+        /// \return 返った結果の数
+        size_t Collect(std::optional<dc::GameState::Stones> *results, std::chrono::steady_clock::time_point deadline);
+
+        /// \brief これまでに回収した結果の数
+        size_t GetReceivedCount() const;
+
+        /// \brief これまでに締切に間に合わなかった，または評価ノードの失敗で返らなかった試行の数
+        size_t GetMissedCount() const;
+
+    private:
+        struct Node;
+        struct State;
+
+        std::unique_ptr<State> state_;
+    };
+
+    /// \brief "ホスト:ポート" をホストとポートに分けます．
+    ///
+    /// \return ホストとポート．ポートが無い場合は std::nullopt
+    std::optional<std::pair<std::string, std::string>> SplitEndpoint(std::string_view endpoint);
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_REMOTE_ROLLOUT_HPP
@@ -0,0 +1,163 @@
+#include "rollout.hpp"
+
+#include <array>
+#include <cmath>
+#include "fcv1_physics.hpp"
+#include "telemetry.hpp"
+
+namespace obsidian
+{
+
+    bool IsInPlayArea(dc::Vector2 const &position, dc::GameSetting const &game_setting)
+    {
+        auto const limits = detail::GetPlayAreaLimits(game_setting);
+        return std::abs(position.x) <= limits.side
+            && position.y <= limits.back
+            && position.y >= limits.hog;
+    }
+
+    namespace detail
+    {
+
+        PlayAreaLimits GetPlayAreaLimits(dc::GameSetting const &game_setting)
+        {
+            float const radius = dc::ISimulator::kStoneRadius;
+            return PlayAreaLimits{
+                game_setting.sheet_width * 0.5f - radius,
+                dc::coordinate::GetBackLineY(true, dc::coordinate::Id::kShot0) + radius,
+                dc::coordinate::GetHogLineY(true, dc::coordinate::Id::kShot0) + radius,
+            };
+        }
+
+        void PlaceShot(dc::IPlayer &player, BoardSnapshot const &board, dc::moves::Shot const &shot, dc::ISimulator::AllStones &stones)
+        {
+            board.ToAllStones(stones);
+
+            auto const played_shot = player.Play(shot);
+            float const angular_velocity = (played_shot.rotation == dc::moves::Shot::Rotation::kCCW ? 1.f : -1.f) * fcv1::kShotAngularVelocity;
+            stones[board.GetShotStoneIndex()].emplace(dc::Vector2(), 0.f, played_shot.velocity, angular_velocity);
+        }
+
+        bool RemoveOutOfPlayStones(dc::ISimulator::AllStones &stones, PlayAreaLimits const &limits)
+        {
+            bool removed = false;
+            for (auto &stone : stones)
+            {
+                if (stone && (std::abs(stone->position.x) > limits.side || stone->position.y > limits.back))
+                {
+                    stone.reset();
+                    removed = true;
+                }
+            }
+            return removed;
+        }
+
+        /// \brief どのストーンもプレーエリアの内外を変えられなくなったか調べる．
+        ///
+        /// 動いているストーンそれぞれの移動距離の上限が，プレーエリアの境界までの距離と，他のストーンと接触するまでの距離の
+        /// いずれよりも短ければ，以降の除外は起こらない．
+        bool IsSettled(dc::ISimulator::AllStones const &stones, PlayAreaLimits const &limits)
+        {
+            float const radius = dc::ISimulator::kStoneRadius;
+
+            std::array<float, dc::ISimulator::kStoneMax> travels{};
+            for (size_t i = 0; i < stones.size(); ++i)
+            {
+                if (stones[i])
+                {
+                    travels[i] = fcv1::MaxTravelDistance(stones[i]->linear_velocity.Length());
+                }
+            }
+
+            for (size_t i = 0; i < stones.size(); ++i)
+            {
+                if (!stones[i] || travels[i] <= 0.f)
+                    continue;
+
+                auto const &position = stones[i]->position;
+                if (limits.side - std::abs(position.x) <= travels[i]
+                    || limits.back - position.y <= travels[i]
+                    || std::abs(position.y - limits.hog) <= travels[i])
+                {
+                    return false;
+                }
+
+                for (size_t j = 0; j < stones.size(); ++j)
+                {
+                    if (j == i || !stones[j])
+                        continue;
+                    float const gap = (stones[j]->position - position).Length() - 2.f * radius;
+                    if (gap <= travels[i] + travels[j])
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        dc::GameState::Stones ToGameStones(dc::ISimulator::AllStones const &stones, float min_y)
+        {
+            dc::GameState::Stones result;
+            for (size_t team = 0; team < 2; ++team)
+            {
+                for (size_t i = 0; i < kStonesPerTeam; ++i)
+                {
+                    auto const &stone = stones[ToAllStonesIndex(team, i)];
+                    if (stone && stone->position.y >= min_y)
+                    {
+                        result[team][i].emplace(stone->position, stone->angle);
+                    }
+                }
+            }
+            return result;
+        }
+
+    } // namespace detail
+
+    RolloutResult RunEarlyExitRollout(
+        dc::GameSetting const &game_setting,
+        dc::ISimulator &simulator,
+        dc::IPlayer &player,
+        BoardSnapshot const &board,
+        dc::moves::Shot const &shot,
+        RolloutPredicate const &predicate)
+    {
+        return RunEarlyExitRollout<dc::ISimulator>(game_setting, simulator, player, board, shot, predicate);
+    }
+
+    dc::GameState::Stones RunRollout(
+        dc::GameSetting const &game_setting,
+        dc::ISimulator &simulator,
+        dc::IPlayer &player,
+        BoardSnapshot const &board,
+        dc::moves::Shot const &shot)
+    {
+        return RunRollout<dc::ISimulator>(game_setting, simulator, player, board, shot);
+    }
+
+    RolloutPredicate MakeTakeOutPredicate(size_t shooter_team, size_t shooter_stone, size_t target_team, size_t target_stone)
+    {
+        return [=](dc::GameState::Stones const &stones, bool settled) -> std::optional<double>
+        {
+            if (!stones[shooter_team][shooter_stone])
+                return 0.; // 除外されたストーンは戻らない
+            if (settled)
+                return stones[target_team][target_stone] ? 0. : 1.;
+            return std::nullopt;
+        };
+    }
+
+    RolloutPredicate MakeTakeOutScorePredicate(size_t shooter_team, size_t shooter_stone, size_t target_team, size_t target_stone)
+    {
+        return [=](dc::GameState::Stones const &stones, bool settled) -> std::optional<double>
+        {
+            bool const shooter_remains = stones[shooter_team][shooter_stone].has_value();
+            bool const target_remains = stones[target_team][target_stone].has_value();
+            if (settled)
+                return (shooter_remains ? 1. : 0.) + (target_remains ? 0. : 1.);
+            if (!shooter_remains && !target_remains)
+                return 1.;
+            return std::nullopt;
+        };
+    }
+
+} // namespace obsidian
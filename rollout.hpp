@@ -0,0 +1,229 @@
+#ifndef AICY_OBSIDIAN_ROLLOUT_HPP
+#define AICY_OBSIDIAN_ROLLOUT_HPP
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "board_snapshot.hpp"
+#include "telemetry.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief 1チームのストーン数
+    constexpr size_t kStonesPerTeam = 8;
+
+    /// \brief GameState::Stones のインデックスを ISimulator::AllStones のインデックスに変換します．
+    constexpr size_t ToAllStonesIndex(size_t team, size_t stone)
+    {
+        return team * kStonesPerTeam + stone;
+    }
+
+    /// \brief ストーンがプレーエリア内にあるか調べます．
+    ///
+    /// ストーン全体がホグラインを越えていて，サイドラインに触れておらず，バックラインを完全には越えていない場合にプレーエリア内とします．
+    bool IsInPlayArea(dc::Vector2 const &position, dc::GameSetting const &game_setting);
+
+    /// \brief ロールアウトの判定関数
+    ///
+    /// \param stones 現時点でプレーエリアから除外されていないストーン．
+    ///     \p settled が false の場合，投げたストーンはホグラインの手前でも除外されていない．
+    ///
+    /// \param settled true の場合，以降どのストーンもプレーエリアの内外が変わらない(盤上に残るストーンの組が確定している)．
+    ///
+    /// \return 評価値が確定した場合その値，未確定の場合 std::nullopt．\p settled が true の場合は値を返す必要がある．
+    using RolloutPredicate = std::function<std::optional<double>(dc::GameState::Stones const &stones, bool settled)>;
+
+    /// \brief 早期終了付きロールアウトの結果
+    struct RolloutResult
+    {
+        dc::GameState::Stones stones; ///< 終了時点でプレーエリアから除外されていないストーン(早期終了した場合は移動途中の位置)
+        double value;                 ///< 判定関数の返した評価値
+        bool exited_early;            ///< 全ストーンの停止前に判定が確定して終了したか
+        size_t steps;                 ///< シミュレーションしたフレーム数
+    };
+
+    namespace detail
+    {
+        /// \brief 判定関数と IsSettled() を呼ぶ間隔[フレーム]．プレーエリア外のストーンの除外は毎フレーム行う
+        constexpr size_t kCheckInterval = 10;
+
+        /// \brief プレーエリアの境界をストーンの中心の座標で表したもの
+        struct PlayAreaLimits
+        {
+            float side; ///< x座標の絶対値の上限
+            float back; ///< y座標の上限
+            float hog;  ///< y座標の下限
+        };
+
+        PlayAreaLimits GetPlayAreaLimits(dc::GameSetting const &game_setting);
+
+        /// \brief \p board のストーンを \p stones に配置し，ブレを加えたショットのストーンを加える．
+        void PlaceShot(dc::IPlayer &player, BoardSnapshot const &board, dc::moves::Shot const &shot, dc::ISimulator::AllStones &stones);
+
+        /// \brief サイドラインやバックラインを越えたストーンを除外する．除外したストーンがあれば true を返す．
+        bool RemoveOutOfPlayStones(dc::ISimulator::AllStones &stones, PlayAreaLimits const &limits);
+
+        /// \brief どのストーンもプレーエリアの内外を変えられなくなったか調べる．
+        bool IsSettled(dc::ISimulator::AllStones const &stones, PlayAreaLimits const &limits);
+
+        /// \brief シミュレータのストーンを GameState::Stones に変換する．y座標が \p min_y より小さいストーンは除外する．
+        dc::GameState::Stones ToGameStones(dc::ISimulator::AllStones const &stones, float min_y);
+
+        /// \brief シミュレータが BoardSimulatorFCV1 と同じ RemoveStonesOutside(), IsSettled(), GetStones(GameState::Stones &, float) を持つか
+        template <class Simulator, class = void>
+        struct HasPlayAreaHooks : std::false_type {};
+
+        template <class Simulator>
+        struct HasPlayAreaHooks<Simulator, std::void_t<decltype(std::declval<Simulator &>().RemoveStonesOutside(0.f, 0.f))>> : std::true_type {};
+    } // namespace detail
+
+    /// \brief 判定の結果が確定した時点でシミュレーションを打ち切るロールアウトを行います．
+    ///
+    /// dc::ApplyMove() と同様にプレイヤーのブレを加えてショットを行いますが，全ストーンの停止を待たず，
+    /// 判定関数が値を返した時点，またはどのストーンも速度が足りずプレーエリアの内外を変えられなくなった時点で終了します．
+    /// フリーガードゾーンのルールは考慮しないので，ルールが適用されうるショットでは dc::ApplyMove() を使用してください．
+    ///
+    /// \param game_setting 試合設定
+    ///
+    /// \param simulator 使用するシミュレータ．dc::ISimulator の SetStones(), GetStones(), Step(), AreAllStonesStopped() と同じ関数を持つ型であればよく，
+    ///     BoardSimulatorFCV1 を指定すると仮想関数を介さずにシミュレーションする．
+    ///     BoardSimulatorFCV1 のようにプレーエリアの判定を行う関数を持つ場合は，途中で dc::ISimulator::AllStones に変換せずにそれらを使う．
+    ///
+    /// \param player ブレを加えるプレイヤー
+    ///
+    /// \param board ショット前の盤面．シミュレータの状態は SetStones() で置き換えるので Load() は不要．
+    ///
+    /// \param shot ショット
+    ///
+    /// \param predicate 判定関数
+    template <class Simulator>
+    RolloutResult RunEarlyExitRollout(
+        dc::GameSetting const &game_setting,
+        Simulator &simulator,
+        dc::IPlayer &player,
+        BoardSnapshot const &board,
+        dc::moves::Shot const &shot,
+        RolloutPredicate const &predicate)
+    {
+        // ApplyMove と同様にストーンを配置してブレを加えたショットを行う
+        dc::ISimulator::AllStones stones;
+        detail::PlaceShot(player, board, shot, stones);
+        simulator.SetStones(stones);
+
+        constexpr bool kHasPlayAreaHooks = detail::HasPlayAreaHooks<Simulator>::value;
+        auto const limits = detail::GetPlayAreaLimits(game_setting);
+        for (size_t steps = 0;; ++steps)
+        {
+            // 境界を越えたストーンは次のフレームの衝突に関わらないよう毎フレーム除外する
+            if constexpr (kHasPlayAreaHooks)
+            {
+                simulator.RemoveStonesOutside(limits.side, limits.back);
+            }
+            else
+            {
+                stones = simulator.GetStones();
+                if (detail::RemoveOutOfPlayStones(stones, limits))
+                {
+                    simulator.SetStones(stones);
+                }
+            }
+
+            bool const stopped = simulator.AreAllStonesStopped();
+            if (!stopped && steps % detail::kCheckInterval != 0)
+            {
+                simulator.Step();
+                continue;
+            }
+
+            // 投げたストーンは確定するまでホグラインの手前でも除外しない
+            bool settled;
+            dc::GameState::Stones game_stones;
+            if constexpr (kHasPlayAreaHooks)
+            {
+                settled = stopped || simulator.IsSettled(limits.side, limits.back, limits.hog);
+                simulator.GetStones(game_stones, settled ? limits.hog : -std::numeric_limits<float>::infinity());
+            }
+            else
+            {
+                settled = stopped || detail::IsSettled(stones, limits);
+                game_stones = detail::ToGameStones(stones, settled ? limits.hog : -std::numeric_limits<float>::infinity());
+            }
+            auto const decided = predicate(game_stones, settled);
+            if (decided || stopped)
+            {
+                CountTelemetry(TelemetryCounter::kRollout);
+                CountTelemetry(TelemetryCounter::kSimulatorStep, steps);
+                return RolloutResult{ std::move(game_stones), decided.value_or(0.), decided && !stopped, steps };
+            }
+
+            simulator.Step();
+        }
+    }
+
+    /// \brief 仮想関数を介して任意のシミュレータで早期終了付きロールアウトを行います．
+    RolloutResult RunEarlyExitRollout(
+        dc::GameSetting const &game_setting,
+        dc::ISimulator &simulator,
+        dc::IPlayer &player,
+        BoardSnapshot const &board,
+        dc::moves::Shot const &shot,
+        RolloutPredicate const &predicate);
+
+    /// \brief 試合状況から早期終了付きロールアウトを行います．
+    inline RolloutResult RunEarlyExitRollout(
+        dc::GameSetting const &game_setting,
+        dc::ISimulator &simulator,
+        dc::IPlayer &player,
+        dc::GameState const &game_state,
+        dc::moves::Shot const &shot,
+        RolloutPredicate const &predicate)
+    {
+        return RunEarlyExitRollout(game_setting, simulator, player, BoardSnapshot::FromGameState(game_state), shot, predicate);
+    }
+
+    /// \brief 全ストーンが停止するまでショットをシミュレーションし，プレーエリアに残ったストーンを返します．
+    ///
+    /// dc::ApplyMove() と異なり，エンドの最後のショットでもストーンを消去せず，得点の計算も行いません．
+    /// フリーガードゾーンのルールは考慮しません．
+    template <class Simulator>
+    dc::GameState::Stones RunRollout(
+        dc::GameSetting const &game_setting,
+        Simulator &simulator,
+        dc::IPlayer &player,
+        BoardSnapshot const &board,
+        dc::moves::Shot const &shot)
+    {
+        // 値を返さない判定関数では全ストーンの停止まで進む
+        auto const result = RunEarlyExitRollout(game_setting, simulator, player, board, shot,
+            [](dc::GameState::Stones const &, bool) -> std::optional<double> { return std::nullopt; });
+        return result.stones;
+    }
+
+    /// \brief 仮想関数を介して任意のシミュレータでロールアウトを行います．
+    dc::GameState::Stones RunRollout(
+        dc::GameSetting const &game_setting,
+        dc::ISimulator &simulator,
+        dc::IPlayer &player,
+        BoardSnapshot const &board,
+        dc::moves::Shot const &shot);
+
+    /// \brief 投げたストーンが残り，かつ対象のストーンを除去できた場合に1，それ以外で0を返す判定関数を生成します．
+    ///
+    /// 投げたストーンが除外された時点で0が確定します．
+    RolloutPredicate MakeTakeOutPredicate(size_t shooter_team, size_t shooter_stone, size_t target_team, size_t target_stone);
+
+    /// \brief 投げたストーンが残れば1点，対象のストーンを除去できれば1点とする判定関数を生成します．
+    ///
+    /// 投げたストーンと対象のストーンがともに除外された時点で1点が確定します．
+    RolloutPredicate MakeTakeOutScorePredicate(size_t shooter_team, size_t shooter_stone, size_t target_team, size_t target_stone);
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_ROLLOUT_HPP
@@ -0,0 +1,382 @@
+// サーバーを介さずに AIcyObsidian 同士の試合を1プロセス内で並列に行い，勝率と思考時間を集計します．
+//
+// 実行例: aicy_obsidian_self_play [試合数] [並列数] [エンド数] [1チームあたりの思考時間(ms)]
+//
+// build-book を指定すると，自己対戦に現れたエンド序盤の局面を深く探索して定跡を構築し，キャッシュファイルに格納します．
+//
+// 実行例: aicy_obsidian_self_play build-book [試合数] [並列数] [エンド数] [1チームあたりの思考時間(ms)] [1局面あたりの探索回数]
+//
+// --a <名前>=<値> と --b <名前>=<値> でエンジン A と B の設定を個別に変えて比較できます(複数指定可)．
+// 設定: ponder=0|1, crn=0|1 (共通乱数), noise=random|sobol (共通乱数の列), book=0|1 (定跡)
+//
+// 実行例: aicy_obsidian_self_play --b crn=0 100 4 8 60000
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "engine.hpp"
+#include "lookahead_search.hpp"
+#include "opening_book.hpp"
+#include "worker_pool.hpp"
+
+namespace dc = digitalcurling3;
+
+namespace
+{
+
+    /// \brief 1試合の結果．エンジンは A (0) と B (1) で区別する．
+    struct GameRecord
+    {
+        std::optional<size_t> winner;                           ///< 勝ったエンジン．引き分けの場合は std::nullopt
+        std::array<std::uint32_t, 2> scores{};                  ///< エンジンごとの総得点
+        std::array<obsidian::Engine::Statistics, 2> statistics; ///< エンジンごとの統計
+        std::vector<dc::GameState> book_states;                 ///< 定跡の対象となる局面(OpeningBook::IsBookShot())
+    };
+
+    /// \brief "<名前>=<値>" の形式の設定 \p setting を \p options に反映します．
+    ///
+    /// \param empty_book book=0 の場合に使用する空の定跡
+    ///
+    /// \return 未知の設定や不正な値の場合 false
+    bool ApplyEngineSetting(obsidian::Engine::Options &options, std::string_view setting, std::shared_ptr<obsidian::OpeningBook const> const &empty_book)
+    {
+        auto const separator = setting.find('=');
+        if (separator == std::string_view::npos)
+            return false;
+        auto const name = setting.substr(0, separator);
+        auto const value = setting.substr(separator + 1);
+        if (value != "0" && value != "1" && name != "noise")
+            return false;
+
+        if (name == "ponder")
+        {
+            options.ponder = value == "1";
+        }
+        else if (name == "crn")
+        {
+            options.common_random_numbers = value == "1";
+        }
+        else if (name == "noise")
+        {
+            if (value == "random")
+                options.noise_sequence = obsidian::NoiseSequence::kPseudoRandom;
+            else if (value == "sobol")
+                options.noise_sequence = obsidian::NoiseSequence::kSobol;
+            else
+                return false;
+        }
+        else if (name == "book")
+        {
+            if (value == "0")
+                options.opening_book = empty_book;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    /// \brief 1試合を最後まで行います．
+    ///
+    /// エンジン A は偶数番目の試合で先攻(チーム0)，奇数番目の試合で後攻(チーム1)になります．
+    /// 試合ごとにエンジン，シミュレータ，プレイヤーを生成するので，他の試合とは状態を共有しません．
+    ///
+    /// \param engine_options エンジン A と B の設定
+    GameRecord PlayGame(
+        size_t game_index,
+        dc::GameSetting const &game_setting,
+        std::array<obsidian::Engine::Options, 2> const &engine_options)
+    {
+        // チーム t を担当するエンジンは t ^ (game_index % 2)
+        auto const engine_of = [game_index](size_t team) { return team ^ (game_index % 2); };
+
+        dc::simulators::SimulatorFCV1Factory const simulator_factory;
+        dc::players::PlayerNormalDistFactory const player_factory;
+
+        std::array<std::unique_ptr<obsidian::Engine>, 2> engines; // チーム順
+        std::array<std::array<std::unique_ptr<dc::IPlayer>, 4>, 2> players; // 試合で実際にショットを行うプレイヤー．チーム順
+        for (size_t team = 0; team < 2; ++team)
+        {
+            std::array<std::unique_ptr<dc::IPlayerFactory>, 4> player_factories;
+            for (auto &factory : player_factories)
+            {
+                factory = player_factory.Clone();
+            }
+            std::array<size_t, 4> player_order{ 0, 1, 2, 3 };
+            engines[team] = std::make_unique<obsidian::Engine>(engine_options[engine_of(team)]);
+            engines[team]->OnInit(static_cast<dc::Team>(team), game_setting, simulator_factory.Clone(), std::move(player_factories), player_order);
+
+            // 試合のブレは再現できるように試合ごとのシードを与える
+            for (size_t i = 0; i < players[team].size(); ++i)
+            {
+                dc::players::PlayerNormalDistFactory seeded_factory = player_factory;
+                seeded_factory.seed = static_cast<std::uint32_t>(game_index * 8 + team * 4 + player_order[i]);
+                players[team][i] = seeded_factory.CreatePlayer();
+            }
+        }
+
+        GameRecord record;
+        auto simulator = simulator_factory.CreateSimulator();
+        dc::GameState game_state(game_setting);
+        while (!game_state.IsGameOver())
+        {
+            if (obsidian::OpeningBook::IsBookShot(game_state))
+            {
+                record.book_states.push_back(game_state);
+            }
+
+            size_t const team = static_cast<size_t>(game_state.GetNextTeam());
+            engines[1 - team]->OnOpponentTurn(game_state);
+
+            auto const start = std::chrono::steady_clock::now();
+            dc::Move move = engines[team]->OnMyTurn(game_state);
+            auto const elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+            dc::ApplyMove(game_setting, *simulator, *players[team][game_state.shot / 4], game_state, move, elapsed);
+        }
+
+        for (size_t team = 0; team < 2; ++team)
+        {
+            engines[team]->OnGameOver(game_state);
+            record.scores[engine_of(team)] = game_state.GetTotalScore(static_cast<dc::Team>(team));
+            record.statistics[engine_of(team)] = engines[team]->GetStatistics();
+        }
+        dc::Team const winner = game_state.game_result->winner;
+        if (winner == dc::Team::k0 || winner == dc::Team::k1)
+        {
+            record.winner = engine_of(static_cast<size_t>(winner));
+        }
+        return record;
+    }
+
+    /// \brief 自己対戦に現れた局面を固定の探索回数で探索し，定跡に追加します．
+    ///
+    /// 定跡に同じ局面(OpeningBook::Find() で見つかる局面)がある場合は探索しません．
+    ///
+    /// \return 追加したエントリ数
+    size_t BuildOpeningBook(
+        obsidian::OpeningBook &book,
+        std::vector<std::optional<GameRecord>> const &records,
+        dc::GameSetting const &game_setting,
+        obsidian::VelocityTable const &velocity_table,
+        size_t visits)
+    {
+        dc::simulators::SimulatorFCV1Factory const simulator_factory;
+        obsidian::WorkerPool pool(simulator_factory, { nullptr, nullptr, nullptr, nullptr });
+        auto const solver_simulator = simulator_factory.CreateSimulator();
+
+        size_t added = 0;
+        for (auto const &record : records)
+        {
+            if (!record)
+                continue;
+            for (auto const &game_state : record->book_states)
+            {
+                if (book.Find(game_state, game_setting))
+                    continue;
+
+                // 探索木の再利用は行わず，局面ごとに同じ量の探索を行う
+                obsidian::LookaheadSearch search(pool, game_setting, game_state.GetNextTeam(), &velocity_table);
+                search.SetRoot(game_state);
+                search.Run([visits](size_t root_visits, std::chrono::steady_clock::duration) { return root_visits < visits; });
+                auto const best = search.GetBestShot();
+                if (!best)
+                    continue;
+
+                auto const solution = obsidian::SolveShotVelocityFCV1(
+                    best->target, best->target_speed, best->shot.rotation, obsidian::ShotPrecision::kFinal, &velocity_table, solver_simulator.get());
+                book.Add(game_state, game_setting, dc::moves::Shot{ solution.velocity, best->shot.rotation }, static_cast<std::uint32_t>(search.GetRootVisits()));
+                ++added;
+            }
+        }
+        return added;
+    }
+
+} // unnamed namespace
+
+int main(int argc, char const *argv[])
+{
+    // エンジンごとの設定を取り除き，残りを位置引数とする
+    std::array<std::vector<std::string_view>, 2> engine_settings;
+    std::vector<char const *> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view const arg(argv[i]);
+        if ((arg == "--a" || arg == "--b") && i + 1 < argc)
+        {
+            engine_settings[arg == "--a" ? 0 : 1].emplace_back(argv[++i]);
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+    }
+
+    bool const build_book = !args.empty() && std::string_view(args.front()) == "build-book";
+    if (build_book)
+    {
+        args.erase(args.begin());
+    }
+    if (args.size() > (build_book ? 5u : 4u))
+    {
+        std::cerr << "Usage: command [--a|--b <name>=<value>]... [games] [parallel] [ends] [thinking time per team (ms)]" << std::endl;
+        std::cerr << "       command [--a|--b <name>=<value>]... build-book [games] [parallel] [ends] [thinking time per team (ms)] [visits per position]" << std::endl;
+        std::cerr << "       settings: ponder=0|1, crn=0|1, noise=random|sobol, book=0|1" << std::endl;
+        return 1;
+    }
+
+    // 先読みスレッドがあるので，1試合あたり2スレッドを使う
+    unsigned const default_parallel = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+    size_t const game_count = args.size() > 0 ? std::stoul(args[0]) : 100;
+    unsigned const parallel = args.size() > 1 ? static_cast<unsigned>(std::stoul(args[1])) : default_parallel;
+    auto const end_count = static_cast<std::uint8_t>(args.size() > 2 ? std::stoul(args[2]) : 8);
+    std::chrono::milliseconds const thinking_time(args.size() > 3 ? std::stol(args[3]) : 60000);
+    size_t const book_visits = args.size() > 4 ? std::stoul(args[4]) : 4096;
+
+    dc::GameSetting game_setting;
+    game_setting.max_end = end_count;
+    game_setting.five_rock_rule = true;
+    game_setting.sheet_width = 4.75f;
+    game_setting.thinking_time = { thinking_time, thinking_time };
+    game_setting.extra_end_thinking_time = thinking_time / end_count;
+
+    std::cout << "self play: " << game_count << " games, " << parallel << " parallel, "
+        << int(end_count) << " ends, " << thinking_time.count() << " ms per team" << std::endl;
+
+    // ずれ角のテーブルと定跡は全試合で共有する．定跡を構築する場合は，定跡を使わずに探索した試合から局面を集める．
+    std::string const cache_path = obsidian::Engine::Options().cache_path;
+    auto const velocity_table = obsidian::Engine::PrepareVelocityTable(cache_path, &std::cout);
+    auto const opening_book = obsidian::Engine::PrepareOpeningBook(cache_path, &std::cout);
+    auto const empty_book = std::make_shared<obsidian::OpeningBook const>();
+    auto const game_opening_book = build_book ? empty_book : opening_book;
+
+    // 各エンジンのワーカーは呼出し元スレッドのみとし，並列化は試合単位で行う
+    std::array<obsidian::Engine::Options, 2> engine_options;
+    for (size_t engine = 0; engine < 2; ++engine)
+    {
+        engine_options[engine].worker_count = 1;
+        engine_options[engine].velocity_table = velocity_table;
+        engine_options[engine].opening_book = game_opening_book;
+        for (auto const setting : engine_settings[engine])
+        {
+            if (!ApplyEngineSetting(engine_options[engine], setting, empty_book))
+            {
+                std::cerr << "Unknown engine setting: " << setting << std::endl;
+                return 1;
+            }
+        }
+    }
+    for (size_t engine = 0; engine < 2; ++engine)
+    {
+        std::cout << "engine " << (engine == 0 ? 'A' : 'B') << ":";
+        for (auto const setting : engine_settings[engine])
+            std::cout << ' ' << setting;
+        std::cout << (engine_settings[engine].empty() ? " default" : "") << std::endl;
+    }
+
+    std::vector<std::optional<GameRecord>> records(game_count);
+    std::atomic<size_t> next_game{ 0 };
+    std::mutex output_mutex;
+    auto const start = std::chrono::steady_clock::now();
+
+    auto run_games = [&]()
+    {
+        for (size_t i = next_game++; i < game_count; i = next_game++)
+        {
+            try
+            {
+                records[i] = PlayGame(i, game_setting, engine_options);
+                std::lock_guard<std::mutex> lock(output_mutex);
+                std::cout << "game " << i << ": A " << records[i]->scores[0] << " - " << records[i]->scores[1] << " B" << std::endl;
+            }
+            catch (std::exception &e)
+            {
+                std::lock_guard<std::mutex> lock(output_mutex);
+                std::cout << "game " << i << ": Exception: " << e.what() << std::endl;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < parallel; ++i)
+    {
+        threads.emplace_back(run_games);
+    }
+    run_games();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    double const elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // 集計
+    size_t played = 0;
+    std::array<size_t, 2> wins{ 0, 0 };
+    std::array<size_t, 2> turns{ 0, 0 };
+    std::array<std::chrono::milliseconds, 2> thinking{};
+    std::array<obsidian::TelemetryCounters, 2> telemetry;
+    std::array<size_t, 2> arena_peak_bytes{ 0, 0 };
+    size_t simulations = 0;
+    for (auto const &record : records)
+    {
+        if (!record)
+            continue;
+        ++played;
+        if (record->winner)
+            ++wins[*record->winner];
+        for (size_t engine = 0; engine < 2; ++engine)
+        {
+            turns[engine] += record->statistics[engine].turn_count;
+            thinking[engine] += record->statistics[engine].thinking_time;
+            telemetry[engine] += record->statistics[engine].telemetry;
+            arena_peak_bytes[engine] = std::max(arena_peak_bytes[engine], record->statistics[engine].arena_peak_bytes);
+            simulations += record->statistics[engine].simulation_count;
+        }
+    }
+
+    size_t const draws = played - wins[0] - wins[1];
+    double const win_rate = played > 0 ? (wins[0] + 0.5 * draws) / played : 0.;
+    std::cout << "games      : " << played << " (" << game_count - played << " failed)" << std::endl;
+    std::cout << "result     : A " << wins[0] << " wins, B " << wins[1] << " wins, " << draws << " draws" << std::endl;
+    std::cout << "win rate A : " << win_rate * 100. << " %" << std::endl;
+    for (size_t engine = 0; engine < 2; ++engine)
+    {
+        double const per_shot = turns[engine] > 0 ? static_cast<double>(thinking[engine].count()) / turns[engine] : 0.;
+        std::cout << "time/shot " << (engine == 0 ? 'A' : 'B') << ": " << per_shot << " ms" << std::endl;
+        std::cout << "telemetry " << (engine == 0 ? 'A' : 'B') << ": " << telemetry[engine] << std::endl;
+        std::cout << "arena peak " << (engine == 0 ? 'A' : 'B') << ": " << arena_peak_bytes[engine] / 1024 << " KiB" << std::endl;
+    }
+    std::cout << "simulations: " << simulations << " (" << simulations / elapsed_seconds << " /s)" << std::endl;
+    std::cout << "elapsed    : " << elapsed_seconds << " s" << std::endl;
+
+    if (build_book)
+    {
+        if (!velocity_table->IsAvailable())
+        {
+            std::cerr << "Velocity table is not available." << std::endl;
+            return 1;
+        }
+        obsidian::OpeningBook book = *opening_book;
+        size_t const added = BuildOpeningBook(book, records, game_setting, *velocity_table, book_visits);
+        std::cout << "opening book: " << added << " entries added (" << book.GetEntryCount() << " total)" << std::endl;
+        if (!obsidian::Engine::SavePrecomputeCache(cache_path, *velocity_table, &book, &std::cout))
+            return 1;
+    }
+
+    return 0;
+}
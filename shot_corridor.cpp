@@ -0,0 +1,85 @@
+#include "shot_corridor.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        float Dot(dc::Vector2 const &a, dc::Vector2 const &b)
+        {
+            return a.x * b.x + a.y * b.y;
+        }
+
+    } // unnamed namespace
+
+    ShotCorridor::ShotCorridor(dc::Vector2 const &launch_velocity, dc::Vector2 const &end)
+        : start_(0.f, 0.f)
+        , end_(end)
+    {
+        // 投げたストーンは原点から発射される
+        float const speed = launch_velocity.Length();
+        dc::Vector2 const direction = speed > 0.f ? launch_velocity / speed : dc::Vector2(0.f, 1.f);
+        control_ = start_ + direction * (0.5f * std::max(Dot(end_ - start_, direction), 0.f));
+
+        length_ = 0.f;
+        dc::Vector2 previous = start_;
+        for (size_t i = 1; i <= kSegmentCount; ++i)
+        {
+            dc::Vector2 const point = GetPoint(static_cast<float>(i) / kSegmentCount);
+            length_ += (point - previous).Length();
+            previous = point;
+        }
+    }
+
+    dc::Vector2 ShotCorridor::GetPoint(float t) const
+    {
+        float const s = 1.f - t;
+        return start_ * (s * s) + control_ * (2.f * s * t) + end_ * (t * t);
+    }
+
+    bool ShotCorridor::IsBlocked(BoardSnapshot const &board, std::uint16_t ignored_mask, float clearance, float end_trim) const
+    {
+        std::uint16_t const candidates = board.exists & ~ignored_mask;
+        if (candidates == 0)
+            return false;
+
+        // 終点の手前 end_trim までを折れ線にする．分割は経路の長さに対してほぼ等間隔なので，長さの比で打ち切ってよい．
+        float const t_end = length_ > 0.f ? std::clamp(1.f - end_trim / length_, 0.f, 1.f) : 1.f;
+        std::array<dc::Vector2, kSegmentCount + 1> points;
+        for (size_t i = 0; i <= kSegmentCount; ++i)
+        {
+            points[i] = GetPoint(t_end * static_cast<float>(i) / kSegmentCount);
+        }
+
+        for (size_t index = 0; index < BoardSnapshot::kStoneCount; ++index)
+        {
+            if ((candidates >> index & 1) == 0)
+                continue;
+            dc::Vector2 const stone(board.stones[index].x, board.stones[index].y);
+
+            // 経路は奥へ進み続けるので，ストーンより clearance 以上手前で終わる区間は離れている
+            for (size_t i = 0; i < kSegmentCount; ++i)
+            {
+                if (points[i + 1].y < stone.y - clearance)
+                    continue;
+                if (GetSegmentDistance(stone, points[i], points[i + 1]) < clearance)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    float GetSegmentDistance(dc::Vector2 const &point, dc::Vector2 const &a, dc::Vector2 const &b)
+    {
+        dc::Vector2 const ab = b - a;
+        float const squared_length = Dot(ab, ab);
+        float const t = squared_length > 0.f ? std::clamp(Dot(point - a, ab) / squared_length, 0.f, 1.f) : 0.f;
+        return (point - (a + ab * t)).Length();
+    }
+
+} // namespace obsidian
@@ -0,0 +1,58 @@
+#ifndef AICY_OBSIDIAN_SHOT_CORRIDOR_HPP
+#define AICY_OBSIDIAN_SHOT_CORRIDOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "board_snapshot.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief 投げたストーンが通る経路(カールの通り道)の近似です．
+    ///
+    /// 経路を，発射地点で初速の方向に接し終点を通る放物線(2次ベジェ曲線)で近似します．
+    /// カールによる横方向の加速度がほぼ一定とみなせば，制御点は初速の方向に終点までの進行方向の距離の半分だけ進んだ地点になります．
+    /// シミュレーションの前に，他のストーンに阻まれて成立しない候補ショットを除くために使用します．
+    class ShotCorridor
+    {
+    public:
+        /// \brief 経路を折れ線で近似するときの分割数
+        static constexpr size_t kSegmentCount = 32;
+
+        /// \param launch_velocity ショットの初速
+        ///
+        /// \param end 経路の終点(ヒットの場合は目標地点，ドローの場合は停止地点)
+        ShotCorridor(dc::Vector2 const &launch_velocity, dc::Vector2 const &end);
+
+        /// \brief 経路上の点を返します．
+        ///
+        /// \param t 0 で発射地点，1 で終点
+        dc::Vector2 GetPoint(float t) const;
+
+        /// \brief 経路の途中で，中心間の距離が \p clearance 未満になるストーンがあるか調べます．
+        ///
+        /// \param board 盤面
+        ///
+        /// \param ignored_mask 調べないストーン(ヒットの対象など)のビットマスク
+        ///
+        /// \param clearance 通過に必要な中心間の距離[m]
+        ///
+        /// \param end_trim 終点の手前のこの長さ[m]は調べない．ヒットでは対象と接触する位置までを調べるために使う．
+        bool IsBlocked(BoardSnapshot const &board, std::uint16_t ignored_mask, float clearance, float end_trim = 0.f) const;
+
+    private:
+        dc::Vector2 start_;
+        dc::Vector2 control_;
+        dc::Vector2 end_;
+        float length_;
+    };
+
+    /// \brief 点 \p point と線分 \p a - \p b の距離を返します．
+    float GetSegmentDistance(dc::Vector2 const &point, dc::Vector2 const &a, dc::Vector2 const &b);
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_SHOT_CORRIDOR_HPP
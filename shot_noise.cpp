@@ -0,0 +1,127 @@
+#include "shot_noise.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        /// \brief 標準正規分布の累積分布関数の逆関数(Acklam の有理近似．相対誤差は 1.2e-9 以下)
+        double InverseNormalCdf(double p)
+        {
+            constexpr std::array<double, 6> a = { -3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00 };
+            constexpr std::array<double, 5> b = { -5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01 };
+            constexpr std::array<double, 6> c = { -7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00, -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00 };
+            constexpr std::array<double, 4> d = { 7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00, 3.754408661907416e+00 };
+            constexpr double kLow = 0.02425;
+
+            if (p < kLow)
+            {
+                double const q = std::sqrt(-2. * std::log(p));
+                return (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1.);
+            }
+            if (p > 1. - kLow)
+            {
+                double const q = std::sqrt(-2. * std::log(1. - p));
+                return -(((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1.);
+            }
+            double const q = p - 0.5;
+            double const r = q * q;
+            return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q / (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1.);
+        }
+
+        /// \brief 32bit の値を (0, 1) の一様乱数とみなす．
+        double ToUnitInterval(std::uint32_t value)
+        {
+            return (static_cast<double>(value) + 0.5) / 4294967296.;
+        }
+
+        /// \brief 2次元 Sobol 列の \p index 番目の点
+        ///
+        /// 1次元目は van der Corput 列，2次元目は原始多項式 x + 1 の方向数 v_k = v_{k-1} ^ (v_{k-1} >> 1) による．
+        std::array<std::uint32_t, 2> GetSobolPoint(std::uint32_t index)
+        {
+            std::array<std::uint32_t, 2> point{ 0, 0 };
+            std::uint32_t v0 = 1u << 31;
+            std::uint32_t v1 = 1u << 31;
+            for (; index != 0; index >>= 1)
+            {
+                if (index & 1)
+                {
+                    point[0] ^= v0;
+                    point[1] ^= v1;
+                }
+                v0 >>= 1;
+                v1 ^= v1 >> 1;
+            }
+            return point;
+        }
+
+    } // unnamed namespace
+
+    ShotNoiseModel::ShotNoiseModel(float max_speed, float stddev_speed, float stddev_angle)
+        : max_speed_(max_speed)
+        , stddev_speed_(stddev_speed)
+        , stddev_angle_(stddev_angle)
+    {
+    }
+
+    std::optional<ShotNoiseModel> ShotNoiseModel::FromPlayerFactory(dc::IPlayerFactory const *factory)
+    {
+        if (factory == nullptr)
+        {
+            dc::players::PlayerNormalDistFactory const normal_dist;
+            return ShotNoiseModel(normal_dist.max_speed, normal_dist.stddev_speed, normal_dist.stddev_angle);
+        }
+        if (auto const normal_dist = dynamic_cast<dc::players::PlayerNormalDistFactory const *>(factory))
+        {
+            return ShotNoiseModel(normal_dist->max_speed, normal_dist->stddev_speed, normal_dist->stddev_angle);
+        }
+        if (dynamic_cast<dc::players::PlayerIdenticalFactory const *>(factory))
+        {
+            return ShotNoiseModel(std::numeric_limits<float>::infinity(), 0.f, 0.f);
+        }
+        return std::nullopt;
+    }
+
+    dc::moves::Shot ShotNoiseModel::Apply(dc::moves::Shot const &shot, StandardShotNoise const &noise) const
+    {
+        float const speed = std::min(shot.velocity.Length(), max_speed_) + stddev_speed_ * noise.speed;
+        float const angle = std::atan2(shot.velocity.y, shot.velocity.x) + stddev_angle_ * noise.angle;
+        return dc::moves::Shot{ dc::Vector2(std::cos(angle), std::sin(angle)) * speed, shot.rotation };
+    }
+
+    void CommonShotNoise::Generate(NoiseSequence sequence, std::uint64_t seed, size_t size)
+    {
+        samples_.resize(std::max<size_t>(size, 1));
+        std::mt19937_64 random(seed);
+        if (sequence == NoiseSequence::kSobol)
+        {
+            // ランダムなデジタルシフト(ビットごとの排他的論理和)で列をずらしても，点の散らばり方の性質は保たれる
+            std::uint32_t const shift_speed = static_cast<std::uint32_t>(random());
+            std::uint32_t const shift_angle = static_cast<std::uint32_t>(random());
+            for (size_t i = 0; i < samples_.size(); ++i)
+            {
+                auto const point = GetSobolPoint(static_cast<std::uint32_t>(i));
+                samples_[i].speed = static_cast<float>(InverseNormalCdf(ToUnitInterval(point[0] ^ shift_speed)));
+                samples_[i].angle = static_cast<float>(InverseNormalCdf(ToUnitInterval(point[1] ^ shift_angle)));
+            }
+        }
+        else
+        {
+            std::normal_distribution<float> normal;
+            for (auto &sample : samples_)
+            {
+                sample.speed = normal(random);
+                sample.angle = normal(random);
+            }
+        }
+    }
+
+} // namespace obsidian
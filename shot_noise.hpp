@@ -0,0 +1,79 @@
+#ifndef AICY_OBSIDIAN_SHOT_NOISE_HPP
+#define AICY_OBSIDIAN_SHOT_NOISE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief 1ショットのブレを標準正規分布に従う値で表したものです．
+    struct StandardShotNoise
+    {
+        float speed; ///< 速度のブレ(標準偏差を掛ける前の値)
+        float angle; ///< 方向のブレ(標準偏差を掛ける前の値)
+    };
+
+    /// \brief プレイヤーのブレを，与えた StandardShotNoise から再現するモデルです．
+    ///
+    /// PlayerNormalDist と同じく，初速の大きさを上限で抑えてから，大きさと方向にそれぞれ正規分布のブレを加えます．
+    /// 乱数をプレイヤーの外で決められるので，同じブレを複数の候補ショットに加える(共通乱数)ことができます．
+    class ShotNoiseModel
+    {
+    public:
+        /// \brief プレイヤーのファクトリからモデルを作ります．
+        ///
+        /// \param factory プレイヤーのファクトリ．nullptr の場合は NormalDistプレイヤー(WorkerPool と同じ既定値)
+        ///
+        /// \return ブレを再現できないプレイヤーの場合 std::nullopt
+        static std::optional<ShotNoiseModel> FromPlayerFactory(dc::IPlayerFactory const *factory);
+
+        /// \brief ショットにブレを加えます．
+        dc::moves::Shot Apply(dc::moves::Shot const &shot, StandardShotNoise const &noise) const;
+
+    private:
+        ShotNoiseModel(float max_speed, float stddev_speed, float stddev_angle);
+
+        float max_speed_;
+        float stddev_speed_;
+        float stddev_angle_;
+    };
+
+    /// \brief CommonShotNoise の列の種類
+    enum class NoiseSequence
+    {
+        kPseudoRandom, ///< 擬似乱数
+        kSobol,        ///< スクランブルした2次元 Sobol 列(準乱数)
+    };
+
+    /// \brief すべての候補ショットで共有するブレの列(共通乱数)です．
+    ///
+    /// 候補ごとの i 回目の試行に同じ i 番目のブレを加えると，候補間の評価値の差の分散が小さくなり，
+    /// 少ない試行回数で候補を見分けられます．Sobol 列を使うと，先頭から使った分のブレが分布全体に偏りなく散らばります．
+    /// ターンごとに Generate() で作り直し，探索中は複数のワーカーから読み出すだけにします．
+    class CommonShotNoise
+    {
+    public:
+        /// \brief 列の長さのデフォルト値．ShotSampler の候補ごとの最大試行回数に合わせる．
+        static constexpr size_t kDefaultSize = 256;
+
+        /// \brief 列を作り直します．
+        void Generate(NoiseSequence sequence, std::uint64_t seed, size_t size = kDefaultSize);
+
+        /// \brief \p sample 番目のブレ．列の長さを超えた場合は先頭から繰り返す．Generate() を先に呼ぶ必要がある．
+        StandardShotNoise const &operator[](size_t sample) const { return samples_[sample % samples_.size()]; }
+
+        size_t GetSize() const { return samples_.size(); }
+
+    private:
+        std::vector<StandardShotNoise> samples_;
+    };
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_SHOT_NOISE_HPP
@@ -0,0 +1,125 @@
+#include "shot_sampler.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace obsidian
+{
+
+    double SampleStats::GetVariance() const
+    {
+        if (count < 2)
+            return 0.;
+        double const mean = GetMean();
+        return std::max(0., (sum_squares - mean * sum) / (count - 1));
+    }
+
+    double SampleStats::GetConfidenceHalfWidth(double z, double variance_floor) const
+    {
+        if (count == 0)
+            return std::numeric_limits<double>::infinity();
+        return z * std::sqrt(std::max(GetVariance(), variance_floor) / count);
+    }
+
+    ShotSampler::ShotSampler(WorkerPool &worker_pool)
+        : ShotSampler(worker_pool, Options())
+    {
+    }
+
+    ShotSampler::ShotSampler(WorkerPool &worker_pool, Options const &options)
+        : worker_pool_(worker_pool), options_(options)
+    {
+        if (options_.min_batch_samples == 0)
+        {
+            options_.min_batch_samples = worker_pool_.GetWorkerCount();
+        }
+    }
+
+    size_t ShotSampler::Run(size_t candidate_count, Rollout const &rollout, ContinueCondition const &should_continue)
+    {
+        assert(candidate_count > 0);
+
+        stats_.assign(candidate_count, SampleStats());
+        active_.assign(candidate_count, true);
+        total_samples_ = 0;
+
+        // 最初のバッチは全候補を min_samples 回ずつ試行する
+        auto &arena = worker_pool_.GetCallerArena();
+        size_t samples_per_candidate = options_.min_samples;
+        while (true)
+        {
+            ArenaScope batch_scope(arena);
+            ArenaVector<size_t> job_candidates{ ArenaAllocator<size_t>(arena) };
+            ArenaVector<size_t> job_samples{ ArenaAllocator<size_t>(arena) };
+            for (size_t i = 0; i < candidate_count; ++i)
+            {
+                if (!active_[i])
+                    continue;
+                size_t const samples = std::min(samples_per_candidate, options_.max_samples - stats_[i].count);
+                job_candidates.insert(job_candidates.end(), samples, i);
+                for (size_t sample = stats_[i].count; sample < stats_[i].count + samples; ++sample)
+                    job_samples.push_back(sample);
+            }
+            if (job_candidates.empty())
+                break;
+
+            auto const batch_start = std::chrono::steady_clock::now();
+
+            ArenaVector<double> job_values(job_candidates.size(), 0., ArenaAllocator<double>(arena));
+            worker_pool_.Run(job_candidates.size(), [&](WorkerPool::Worker &worker, size_t i)
+            {
+                job_values[i] = rollout(worker, job_candidates[i], job_samples[i]);
+            });
+
+            for (size_t i = 0; i < job_candidates.size(); ++i)
+            {
+                stats_[job_candidates[i]].Add(job_values[i]);
+            }
+            total_samples_ += job_candidates.size();
+
+            EliminateCandidates();
+            if (std::count(active_.begin(), active_.end(), true) <= 1)
+                break;
+
+            if (!should_continue(total_samples_, std::chrono::steady_clock::now() - batch_start))
+                break;
+
+            // 残った候補でバッチを分け合う
+            size_t const active_count = std::count(active_.begin(), active_.end(), true);
+            samples_per_candidate = (options_.min_batch_samples + active_count - 1) / active_count;
+        }
+
+        size_t best = 0;
+        for (size_t i = 1; i < candidate_count; ++i)
+        {
+            if (active_[i] && (!active_[best] || stats_[i].GetMean() > stats_[best].GetMean()))
+            {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    void ShotSampler::EliminateCandidates()
+    {
+        double best_lower_bound = -std::numeric_limits<double>::infinity();
+        for (size_t i = 0; i < stats_.size(); ++i)
+        {
+            if (active_[i] && stats_[i].count >= options_.min_samples)
+            {
+                best_lower_bound = std::max(best_lower_bound, stats_[i].GetMean() - GetConfidenceHalfWidth(i));
+            }
+        }
+
+        for (size_t i = 0; i < stats_.size(); ++i)
+        {
+            if (active_[i] && stats_[i].count >= options_.min_samples && stats_[i].GetMean() + GetConfidenceHalfWidth(i) < best_lower_bound)
+            {
+                active_[i] = false;
+            }
+        }
+    }
+
+} // namespace obsidian
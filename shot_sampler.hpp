@@ -0,0 +1,101 @@
+#ifndef AICY_OBSIDIAN_SHOT_SAMPLER_HPP
+#define AICY_OBSIDIAN_SHOT_SAMPLER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include "worker_pool.hpp"
+
+namespace obsidian
+{
+
+    /// \brief 試行結果の標本統計
+    struct SampleStats
+    {
+        size_t count = 0;
+        double sum = 0.;
+        double sum_squares = 0.;
+
+        void Add(double value)
+        {
+            ++count;
+            sum += value;
+            sum_squares += value * value;
+        }
+
+        double GetMean() const { return count > 0 ? sum / count : 0.; }
+
+        /// \brief 不偏分散．標本が2個未満の場合は 0
+        double GetVariance() const;
+
+        /// \brief 平均の信頼区間の半幅
+        ///
+        /// \param z 信頼係数(95%信頼区間なら 1.96)
+        ///
+        /// \param variance_floor 分散の下限．標本が少なく分散が過小に見積もられるのを防ぐ．
+        double GetConfidenceHalfWidth(double z, double variance_floor = 0.) const;
+    };
+
+    /// \brief ブレのある試行(ロールアウト)で候補ショットを比較するモンテカルロ評価器です．
+    ///
+    /// 全候補を最低試行回数だけ試行した後，信頼区間の上限が最良候補の下限を下回った候補を除外しながら，
+    /// 残った候補にバッチ単位で試行を割り当てていきます(UCB/LCB による逐次除外)．
+    /// 明らかに劣る候補に試行を費やさず，拮抗する候補の比較に試行を集中できます．
+    class ShotSampler
+    {
+    public:
+        struct Options
+        {
+            size_t min_samples = 8;                ///< 除外判定を始めるまでの候補ごとの試行回数
+            size_t max_samples = 256;              ///< 候補ごとの最大試行回数
+            size_t min_batch_samples = 0;          ///< 1バッチの最小試行回数．0 の場合はワーカー数
+            double confidence_z = 1.96;            ///< 信頼係数
+            double variance_floor = 0.05;          ///< 信頼区間の計算に使う分散の下限
+        };
+
+        /// \brief 1回の試行．候補のインデックスと候補内での試行の通し番号を受け取り評価値を返す．複数のワーカーから同時に呼ばれる．
+        ///
+        /// 通し番号は候補ごとに 0 から数えるので，CommonShotNoise のインデックスに使えば全候補に同じブレの列を加えられる．
+        using Rollout = std::function<double(WorkerPool::Worker &worker, size_t candidate, size_t sample)>;
+
+        /// \brief 継続判定．これまでの総試行回数と直前のバッチの所要時間を受け取り，次のバッチを実行するなら true を返す．
+        using ContinueCondition = std::function<bool(size_t total_samples, std::chrono::steady_clock::duration last_batch_time)>;
+
+        explicit ShotSampler(WorkerPool &worker_pool);
+        ShotSampler(WorkerPool &worker_pool, Options const &options);
+
+        /// \brief 候補を評価し，評価値の平均が最も高い候補のインデックスを返します．
+        ///
+        /// 最初のバッチ(各候補 min_samples 回)は継続判定によらず実行します．
+        size_t Run(size_t candidate_count, Rollout const &rollout, ContinueCondition const &should_continue);
+
+        /// \brief 直前の Run() における候補ごとの統計
+        std::vector<SampleStats> const &GetStats() const { return stats_; }
+
+        /// \brief 直前の Run() で候補が除外されずに残ったか
+        bool IsActive(size_t candidate) const { return active_[candidate]; }
+
+        /// \brief 直前の Run() の総試行回数
+        size_t GetTotalSamples() const { return total_samples_; }
+
+        /// \brief 候補の信頼区間の半幅
+        double GetConfidenceHalfWidth(size_t candidate) const
+        {
+            return stats_[candidate].GetConfidenceHalfWidth(options_.confidence_z, options_.variance_floor);
+        }
+
+    private:
+        /// \brief 信頼区間が最良候補と重ならない候補を除外する．
+        void EliminateCandidates();
+
+        WorkerPool &worker_pool_;
+        Options options_;
+        std::vector<SampleStats> stats_;
+        std::vector<bool> active_;
+        size_t total_samples_ = 0;
+    };
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_SHOT_SAMPLER_HPP
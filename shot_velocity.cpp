@@ -0,0 +1,530 @@
+#include "shot_velocity.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include "telemetry.hpp"
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        using ShotRotation = dc::moves::Shot::Rotation;
+
+        constexpr float kNaN = std::numeric_limits<float>::quiet_NaN();
+
+        /// \brief キャッシュの区画の先頭に書き込むヘッダ．直後に回転方向ごとのずれ角が続く
+        struct VelocityTableSectionHeader
+        {
+            std::uint32_t v0_speed_count;
+            std::uint32_t target_speed_count;
+            float min_v0_speed;
+            float v0_speed_step;
+            float target_speed_coord_step;
+            float max_error;
+        };
+
+        /// \brief キャッシュの区画のデータ形式のバージョン
+        constexpr std::uint32_t kSectionVersion = 2;
+
+        /// \brief 回転方向をテーブルのインデックスに変換する．
+        size_t ToIndex(ShotRotation rotation)
+        {
+            return rotation == ShotRotation::kCCW ? 0 : 1;
+        }
+
+        static_assert(VelocityTable::kTargetSpeedCount == static_cast<size_t>(2.f / VelocityTable::kTargetSpeedCoordStep + 0.5f) + 1);
+
+        /// \brief 格子のインデックス(小数可)を初速に変換する．
+        float GetV0Speed(float index)
+        {
+            return VelocityTable::kMinV0Speed + index * VelocityTable::kV0SpeedStep;
+        }
+
+        /// \brief 格子のインデックス(小数可)を目標速度に変換する．
+        float GetTargetSpeed(float index)
+        {
+            float const coord = index * VelocityTable::kTargetSpeedCoordStep;
+            return coord * coord;
+        }
+
+        /// \brief 呼出し元スレッド専用の FCV1 シミュレータ．シミュレータを渡されなかった場合に使用する．
+        dc::ISimulator &GetThreadSimulatorFCV1()
+        {
+            thread_local std::unique_ptr<dc::ISimulator> s_simulator;
+            if (s_simulator == nullptr)
+            {
+                s_simulator = dc::simulators::SimulatorFCV1Factory().CreateSimulator();
+            }
+            return *s_simulator;
+        }
+
+        /// \brief 初速 \p v0_speed のショットを1本シミュレーションし，速度が \p target_speeds の各値以下になった最初の地点のずれ角を記録する．
+        ///
+        /// \param target_speeds 目標速度．降順に並んでいる必要がある．
+        ///
+        /// \param max_r 原点からこの距離を超えた時点でシミュレーションを打ち切る．
+        ///
+        /// \param delta_angles 出力先．打ち切りにより記録できなかった要素や初速以上の目標速度の要素は NaN になる．
+        void SimulateDeltaAngles(
+            float v0_speed,
+            ShotRotation rotation,
+            std::vector<float> const &target_speeds,
+            float max_r,
+            std::vector<float> &delta_angles)
+        {
+            assert(std::is_sorted(target_speeds.rbegin(), target_speeds.rend()));
+
+            delta_angles.assign(target_speeds.size(), kNaN);
+
+            float const rotation_factor = rotation == ShotRotation::kCCW ? 1.f : -1.f;
+
+            // シミュレータは FCV1 シミュレータを使用する．
+            auto &simulator = GetThreadSimulatorFCV1();
+
+            dc::ISimulator::AllStones init_stones;
+            init_stones[0].emplace(dc::Vector2(), 0.f, dc::Vector2(0.f, v0_speed), 1.57f * rotation_factor);
+            simulator.SetStones(init_stones);
+
+            size_t i = 0;
+            while (i < target_speeds.size() && target_speeds[i] >= v0_speed)
+            {
+                ++i; // 初速以上の目標速度は成立しない
+            }
+
+            auto record = [&](size_t end, dc::Vector2 const &delta)
+            {
+                float const delta_angle = std::atan2(delta.x, delta.y); // 注: delta.x, delta.y の順番で良い
+                for (; i < end; ++i)
+                {
+                    delta_angles[i] = delta_angle;
+                }
+            };
+
+            while (!simulator.AreAllStonesStopped())
+            {
+                auto const &stones = simulator.GetStones();
+                auto const speed = stones[0]->linear_velocity.Length();
+                size_t end = i;
+                while (end < target_speeds.size() && speed <= target_speeds[end])
+                {
+                    ++end;
+                }
+                record(end, stones[0]->position);
+                if (i == target_speeds.size() || stones[0]->position.Length() > max_r)
+                {
+                    return;
+                }
+                simulator.Step();
+            }
+
+            record(target_speeds.size(), simulator.GetStones()[0]->position);
+        }
+
+        /// \brief 初速 \p v0 で投げたストーンが，速度 \p target_speed まで減速した地点を求める．
+        ///
+        /// 目標速度が 0 の場合は停止地点を返す．目標速度を下回った時点で打ち切り，前のフレームとの間を速度で線形補間する．
+        dc::Vector2 SimulateReachedPosition(dc::ISimulator &simulator, dc::Vector2 const &v0, float target_speed, ShotRotation rotation)
+        {
+            float const rotation_factor = rotation == ShotRotation::kCCW ? 1.f : -1.f;
+
+            dc::ISimulator::AllStones init_stones;
+            init_stones[0].emplace(dc::Vector2(), 0.f, v0, 1.57f * rotation_factor);
+            simulator.SetStones(init_stones);
+
+            dc::Vector2 previous_position;
+            float previous_speed = v0.Length();
+            std::uint64_t steps = 0;
+            while (!simulator.AreAllStonesStopped())
+            {
+                simulator.Step();
+                ++steps;
+                auto const &stone = *simulator.GetStones()[0];
+                float const speed = stone.linear_velocity.Length();
+                if (target_speed > 0.f && speed <= target_speed)
+                {
+                    CountTelemetry(TelemetryCounter::kSimulatorStep, steps);
+                    float const t = previous_speed > speed ? (previous_speed - target_speed) / (previous_speed - speed) : 1.f;
+                    return previous_position + (stone.position - previous_position) * t;
+                }
+                previous_position = stone.position;
+                previous_speed = speed;
+            }
+            CountTelemetry(TelemetryCounter::kSimulatorStep, steps);
+            return simulator.GetStones()[0]->position;
+        }
+
+        /// \brief 0, 1, ..., count - 1 のタスクを複数スレッドで実行する．
+        template <class Task>
+        void RunParallel(size_t count, unsigned thread_count, Task const &task)
+        {
+            if (thread_count == 0)
+            {
+                thread_count = std::max(1u, std::thread::hardware_concurrency());
+            }
+
+            std::atomic<size_t> next(0);
+            auto worker = [&]
+            {
+                for (size_t i = next++; i < count; i = next++)
+                {
+                    task(i);
+                }
+            };
+
+            std::vector<std::thread> threads;
+            for (unsigned i = 1; i < thread_count; ++i)
+            {
+                threads.emplace_back(worker);
+            }
+            worker();
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+        }
+
+    } // unnamed namespace
+
+    float EstimateShotSpeedFCV1(float target_r, float target_speed)
+    {
+        assert(target_r > 0.f);
+
+        if (target_speed <= 0.05f)
+        {
+            float constexpr kC0[] = {0.0005048122574925176, 0.2756242531609261};
+            float constexpr kC1[] = {0.00046669575066030805, -29.898958358378636, -0.0014030973174948508};
+            float constexpr kC2[] = {0.13968687866736632, 0.41120940058777616};
+
+            float const c0 = kC0[0] * target_r + kC0[1];
+            float const c1 = -kC1[0] * std::log(target_r + kC1[1]) + kC1[2];
+            float const c2 = kC2[0] * target_r + kC2[1];
+
+            return std::sqrt(c0 * target_speed * target_speed + c1 * target_speed + c2);
+        }
+        else if (target_speed <= 1.f)
+        {
+            float constexpr kC0[] = {-0.0014309170115803444, 0.9858457898438147};
+            float constexpr kC1[] = {-0.0008339331735471273, -29.86751291726946, -0.19811799977982522};
+            float constexpr kC2[] = {0.13967323742978, 0.42816312110477517};
+
+            float const c0 = kC0[0] * target_r + kC0[1];
+            float const c1 = -kC1[0] * std::log(target_r + kC1[1]) + kC1[2];
+            float const c2 = kC2[0] * target_r + kC2[1];
+
+            return std::sqrt(c0 * target_speed * target_speed + c1 * target_speed + c2);
+        }
+        else
+        {
+            float constexpr kC0[] = {1.0833113118071224e-06, -0.00012132851917870833, 0.004578093297561233, 0.9767006869364527};
+            float constexpr kC1[] = {0.07950648211492622, -8.228225657195706, -0.05601306077702578};
+            float constexpr kC2[] = {0.14140440186382008, 0.3875782508767419};
+
+            float const c0 = kC0[0] * target_r * target_r * target_r + kC0[1] * target_r * target_r + kC0[2] * target_r + kC0[3];
+            float const c1 = -kC1[0] * std::log(target_r + kC1[1]) + kC1[2];
+            float const c2 = kC2[0] * target_r + kC2[1];
+
+            return std::sqrt(c0 * target_speed * target_speed + c1 * target_speed + c2);
+        }
+    }
+
+    float SimulateDeltaAngleFCV1(float v0_speed, float target_speed, dc::moves::Shot::Rotation rotation)
+    {
+        std::vector<float> const target_speeds{target_speed};
+        std::vector<float> delta_angles;
+        SimulateDeltaAngles(v0_speed, rotation, target_speeds, std::numeric_limits<float>::infinity(), delta_angles);
+        return std::isnan(delta_angles[0]) ? 0.f : delta_angles[0];
+    }
+
+    bool VelocityTable::Build(float max_error, unsigned thread_count)
+    {
+        available_ = false;
+
+        std::vector<float> target_speeds(kTargetSpeedCount);
+        for (size_t i = 0; i < kTargetSpeedCount; ++i)
+        {
+            target_speeds[i] = GetTargetSpeed(static_cast<float>(kTargetSpeedCount - 1 - i)); // 降順
+        }
+
+        cache_.reset();
+        for (auto &delta_angles : delta_angles_)
+        {
+            delta_angles.assign(kV0SpeedCount * kTargetSpeedCount, kNaN);
+        }
+
+        // 1タスクで初速1本ぶん(テーブルの1行)を埋める
+        RunParallel(kV0SpeedCount * 2, thread_count, [this, &target_speeds](size_t task)
+        {
+            size_t const v0_index = task / 2;
+            ShotRotation const rotation = task % 2 == 0 ? ShotRotation::kCCW : ShotRotation::kCW;
+
+            std::vector<float> row;
+            SimulateDeltaAngles(GetV0Speed(static_cast<float>(v0_index)), rotation, target_speeds, kMaxTargetR, row);
+
+            auto &delta_angles = delta_angles_[ToIndex(rotation)];
+            for (size_t i = 0; i < kTargetSpeedCount; ++i)
+            {
+                delta_angles[v0_index * kTargetSpeedCount + (kTargetSpeedCount - 1 - i)] = row[i];
+            }
+        });
+
+        return Validate(max_error, thread_count);
+    }
+
+    bool VelocityTable::Validate(float max_error, unsigned thread_count)
+    {
+        // 格子の中間点(初速は4行おき)でシミュレーション結果と比較する
+        constexpr size_t kV0SpeedStride = 4;
+        size_t const row_count = (kV0SpeedCount - 1) / kV0SpeedStride;
+
+        std::vector<float> target_speeds(kTargetSpeedCount - 1);
+        for (size_t i = 0; i < target_speeds.size(); ++i)
+        {
+            target_speeds[i] = GetTargetSpeed(static_cast<float>(kTargetSpeedCount - 2 - i) + 0.5f); // 降順
+        }
+
+        std::vector<float> row_errors(row_count * 2, 0.f);
+        RunParallel(row_count * 2, thread_count, [this, &target_speeds, &row_errors](size_t task)
+        {
+            float const v0_speed = GetV0Speed(static_cast<float>(task / 2 * kV0SpeedStride) + 0.5f);
+            ShotRotation const rotation = task % 2 == 0 ? ShotRotation::kCCW : ShotRotation::kCW;
+
+            std::vector<float> row;
+            SimulateDeltaAngles(v0_speed, rotation, target_speeds, kMaxTargetR, row);
+
+            for (size_t i = 0; i < target_speeds.size(); ++i)
+            {
+                if (std::isnan(row[i]))
+                    continue;
+                auto const interpolated = Interpolate(v0_speed, target_speeds[i], rotation);
+                if (!interpolated)
+                    continue; // テーブル範囲外はシミュレーションにフォールバックするので誤差は生じない
+                // 角度の誤差を目標地点での横方向の誤差に換算する(距離は上限値で見積もる)
+                row_errors[task] = std::max(row_errors[task], std::abs(*interpolated - row[i]) * kMaxTargetR);
+            }
+        });
+
+        max_error_ = *std::max_element(row_errors.begin(), row_errors.end());
+        available_ = max_error_ <= max_error;
+        return available_;
+    }
+
+    std::string VelocityTable::GetCacheKey()
+    {
+        return MakeCacheKey(dc::simulators::SimulatorFCV1Factory());
+    }
+
+    bool VelocityTable::Load(std::shared_ptr<PrecomputeCache const> const &cache, float max_error)
+    {
+        available_ = false;
+
+        size_t const value_count = kV0SpeedCount * kTargetSpeedCount;
+        auto const section = cache->FindSection(CacheSection::kVelocityTable, kSectionVersion);
+        if (!section || section->size != sizeof(VelocityTableSectionHeader) + 2 * value_count * sizeof(float))
+            return false;
+
+        VelocityTableSectionHeader header;
+        std::memcpy(&header, section->data, sizeof(header));
+        if (header.v0_speed_count != kV0SpeedCount
+            || header.target_speed_count != kTargetSpeedCount
+            || header.min_v0_speed != kMinV0Speed
+            || header.v0_speed_step != kV0SpeedStep
+            || header.target_speed_coord_step != kTargetSpeedCoordStep)
+        {
+            return false; // 格子が異なるテーブルは使用しない
+        }
+
+        // 区画は64バイト境界に揃っているので，ヘッダの直後の float 列はそのまま参照できる
+        auto const values = reinterpret_cast<float const *>(static_cast<char const *>(section->data) + sizeof(header));
+        cache_ = cache;
+        cached_delta_angles_ = { values, values + value_count };
+
+        max_error_ = header.max_error;
+        available_ = max_error_ <= max_error;
+        return available_;
+    }
+
+    bool VelocityTable::Store(PrecomputeCacheWriter &writer) const
+    {
+        if (!cache_ && delta_angles_[0].empty())
+            return false;
+
+        VelocityTableSectionHeader header;
+        header.v0_speed_count = kV0SpeedCount;
+        header.target_speed_count = kTargetSpeedCount;
+        header.min_v0_speed = kMinV0Speed;
+        header.v0_speed_step = kV0SpeedStep;
+        header.target_speed_coord_step = kTargetSpeedCoordStep;
+        header.max_error = max_error_;
+
+        size_t const value_count = kV0SpeedCount * kTargetSpeedCount;
+        std::vector<char> data(sizeof(header) + 2 * value_count * sizeof(float));
+        std::memcpy(data.data(), &header, sizeof(header));
+        for (size_t i = 0; i < 2; ++i)
+        {
+            std::memcpy(data.data() + sizeof(header) + i * value_count * sizeof(float), GetDeltaAngles(i), value_count * sizeof(float));
+        }
+        writer.AddSection(CacheSection::kVelocityTable, kSectionVersion, data.data(), data.size());
+        return true;
+    }
+
+    float const *VelocityTable::GetDeltaAngles(size_t rotation_index) const
+    {
+        return cache_ ? cached_delta_angles_[rotation_index] : delta_angles_[rotation_index].data();
+    }
+
+    std::optional<float> VelocityTable::LookupDeltaAngle(float v0_speed, float target_speed, dc::moves::Shot::Rotation rotation) const
+    {
+        if (!available_)
+            return std::nullopt;
+        return Interpolate(v0_speed, target_speed, rotation);
+    }
+
+    std::optional<float> VelocityTable::Interpolate(float v0_speed, float target_speed, dc::moves::Shot::Rotation rotation) const
+    {
+        float const x = (v0_speed - kMinV0Speed) / kV0SpeedStep;
+        float const y = std::sqrt(target_speed) / kTargetSpeedCoordStep;
+        if (!(x >= 0.f && x <= kV0SpeedCount - 1 && y >= 0.f && y <= kTargetSpeedCount - 1))
+            return std::nullopt;
+
+        size_t const ix = std::min(static_cast<size_t>(x), kV0SpeedCount - 2);
+        size_t const iy = std::min(static_cast<size_t>(y), kTargetSpeedCount - 2);
+        float const fx = x - ix;
+        float const fy = y - iy;
+
+        float const *row0 = GetDeltaAngles(ToIndex(rotation)) + ix * kTargetSpeedCount + iy;
+        float const *row1 = row0 + kTargetSpeedCount;
+        float const result = (row0[0] * (1.f - fy) + row0[1] * fy) * (1.f - fx) + (row1[0] * (1.f - fy) + row1[1] * fy) * fx;
+
+        // 近傍に記録されていない格子点(NaN)がある場合は補間しない
+        if (std::isnan(result))
+            return std::nullopt;
+        return result;
+    }
+
+    dc::Vector2 EstimateShotVelocityFCV1(
+        dc::Vector2 const &target_position,
+        float target_speed,
+        dc::moves::Shot::Rotation rotation,
+        VelocityTable const *table)
+    {
+        assert(target_speed >= 0.f);
+        assert(target_speed <= 4.f);
+
+        CountTelemetry(TelemetryCounter::kVelocityEstimate);
+
+        // 初速度の大きさを逆算する
+        // 逆算には専用の関数を用いる．
+
+        float const v0_speed = EstimateShotSpeedFCV1(target_position.Length(), target_speed);
+
+        assert(target_speed < v0_speed);
+
+        // 発射方向のずれ角を求める．テーブルが使用できない場合は一度シミュレーションを行う．
+
+        float delta_angle;
+        if (auto const looked_up = table ? table->LookupDeltaAngle(v0_speed, target_speed, rotation) : std::nullopt)
+        {
+            delta_angle = *looked_up;
+        }
+        else
+        {
+            delta_angle = SimulateDeltaAngleFCV1(v0_speed, target_speed, rotation);
+        }
+
+        float const target_angle = std::atan2(target_position.y, target_position.x);
+        float const v0_angle = target_angle + delta_angle; // 発射方向
+
+        return dc::Vector2(v0_speed * std::cos(v0_angle), v0_speed * std::sin(v0_angle));
+    }
+
+    ShotSolverOptions GetShotSolverOptions(ShotPrecision precision)
+    {
+        switch (precision)
+        {
+        case ShotPrecision::kSearch:
+            return ShotSolverOptions{ 0.02f, 3 };
+        case ShotPrecision::kFinal:
+            break;
+        }
+        return ShotSolverOptions{ 0.002f, 8 };
+    }
+
+    ShotSolution SolveShotVelocityFCV1(
+        dc::Vector2 const &target_position,
+        float target_speed,
+        dc::moves::Shot::Rotation rotation,
+        ShotSolverOptions const &options,
+        VelocityTable const *table,
+        dc::ISimulator *simulator)
+    {
+        assert(target_speed >= 0.f);
+        assert(options.max_iterations > 0);
+
+        CountTelemetry(TelemetryCounter::kVelocitySolve);
+
+        constexpr float kMinV0Speed = 0.1f;
+        constexpr float kMaxV0Speed = 10.f;
+
+        float const target_r = target_position.Length();
+        float const target_angle = std::atan2(target_position.y, target_position.x);
+
+        // 回帰式とテーブルを初期値とする
+        float v0_speed = EstimateShotSpeedFCV1(target_r, target_speed);
+        float v0_angle = target_angle;
+        if (auto const delta_angle = table ? table->LookupDeltaAngle(v0_speed, target_speed, rotation) : std::nullopt)
+        {
+            v0_angle += *delta_angle;
+        }
+
+        auto &solver_simulator = simulator ? *simulator : GetThreadSimulatorFCV1();
+
+        ShotSolution best{ dc::Vector2(), std::numeric_limits<float>::infinity(), 0, false };
+        float previous_v0_speed = 0.f;
+        float previous_r_error = 0.f;
+        for (unsigned iteration = 1; iteration <= options.max_iterations; ++iteration)
+        {
+            dc::Vector2 const v0(v0_speed * std::cos(v0_angle), v0_speed * std::sin(v0_angle));
+            auto const reached = SimulateReachedPosition(solver_simulator, v0, target_speed, rotation);
+
+            float const error = (reached - target_position).Length();
+            if (error < best.error)
+            {
+                best = ShotSolution{ v0, error, iteration, error <= options.tolerance };
+            }
+            best.iterations = iteration;
+            if (best.converged)
+                break;
+
+            // 軌跡は発射方向の回転に対してほぼ不変なので，方向は到達地点の角度のずれだけ回せばよい
+            v0_angle += target_angle - std::atan2(reached.y, reached.x);
+
+            // 初速の大きさは到達距離の誤差に対してセカント法で修正する
+            float const reached_r = reached.Length();
+            float const r_error = reached_r - target_r;
+            float next_v0_speed;
+            if (iteration == 1 || r_error == previous_r_error)
+            {
+                // 到達距離は概ね初速の2乗に比例する
+                next_v0_speed = reached_r > 0.f ? v0_speed * std::sqrt(target_r / reached_r) : v0_speed * 2.f;
+            }
+            else
+            {
+                next_v0_speed = v0_speed - r_error * (v0_speed - previous_v0_speed) / (r_error - previous_r_error);
+            }
+            previous_v0_speed = v0_speed;
+            previous_r_error = r_error;
+            v0_speed = std::clamp(next_v0_speed, std::max(kMinV0Speed, target_speed), kMaxV0Speed);
+        }
+
+        return best;
+    }
+
+} // namespace obsidian
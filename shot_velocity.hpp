@@ -0,0 +1,202 @@
+#ifndef AICY_OBSIDIAN_SHOT_VELOCITY_HPP
+#define AICY_OBSIDIAN_SHOT_VELOCITY_HPP
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "precompute_cache.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief シミュレータFCV1において，原点から距離 \p target_r の地点を速度 \p target_speed で通過するショットの初速の大きさを回帰式で求めます．
+    ///
+    /// \param target_r 原点(投擲地点)から目標地点までの距離
+    ///
+    /// \param target_speed 目標地点到達時の速度
+    ///
+    /// \return 初速の大きさ
+    float EstimateShotSpeedFCV1(float target_r, float target_speed);
+
+    /// \brief シミュレータFCV1において，初速 \p v0_speed で投げたストーンが速度 \p target_speed まで減速した地点の，発射方向からのずれ角を求めます．
+    ///
+    /// 関数内で1ショット分のシミュレーションを行うため高速ではありません．
+    ///
+    /// \return ずれ角[rad]．正の値は発射方向から反時計回りのずれを表す．
+    float SimulateDeltaAngleFCV1(float v0_speed, float target_speed, dc::moves::Shot::Rotation rotation);
+
+    /// \brief シミュレータFCV1のカールによるずれ角を事前計算したテーブルです．
+    ///
+    /// ずれ角は初速と目標地点での速度のみで決まるため，テーブルは (初速, 目標速度) をキーとし，回転方向ごとに保持します．
+    /// 初速は目標地点までの距離から EstimateShotSpeedFCV1() で求まるので，実質的には (目標距離, 目標速度) で引くテーブルです．
+    /// 初速1本ぶんのシミュレーションでテーブルの1行すべてが埋まるので，構築はショット数本ぶんの時間で済みます．
+    ///
+    /// 値の取得は双線形補間で行います．構築時・読込時に格子の中間点でシミュレーション結果と比較し，
+    /// 補間による目標地点での横方向の誤差が許容値を超える場合はテーブルを使用不可とします．
+    class VelocityTable
+    {
+    public:
+        static constexpr float kMinV0Speed = 2.f;
+        static constexpr float kMaxV0Speed = 4.8f;
+        static constexpr float kV0SpeedStep = 0.02f;
+        static constexpr float kMaxTargetSpeed = 4.f;
+        static constexpr float kTargetSpeedCoordStep = 0.025f; ///< 目標速度の平方根の刻み幅．停止直前はずれ角の変化が急なので，低速側ほど細かく区切る．
+        static constexpr size_t kV0SpeedCount = static_cast<size_t>((kMaxV0Speed - kMinV0Speed) / kV0SpeedStep + 0.5f) + 1;
+        static constexpr size_t kTargetSpeedCount = 81; ///< sqrt(kMaxTargetSpeed) / kTargetSpeedCoordStep + 1
+
+        /// \brief テーブルの対象とする原点からの最大距離．これより遠い地点の値は記録しません．
+        static constexpr float kMaxTargetR = 44.f;
+
+        /// \brief 補間による目標地点での横方向誤差の許容値のデフォルト値[m]
+        static constexpr float kDefaultMaxError = 0.005f;
+
+        /// \brief シミュレーションでテーブルを構築します．
+        ///
+        /// \param max_error 許容する横方向誤差[m]
+        ///
+        /// \param thread_count 構築に使用するスレッド数
+        ///
+        /// \return 構築したテーブルの誤差が許容値以内なら true
+        bool Build(float max_error = kDefaultMaxError, unsigned thread_count = 0);
+
+        /// \brief テーブルを格納するキャッシュのキー．テーブルは既定のパラメータの FCV1 シミュレータで構築します．
+        static std::string GetCacheKey();
+
+        /// \brief キャッシュからテーブルを読み込みます．
+        ///
+        /// 値はコピーせずにキャッシュのデータを直接参照し，キャッシュはこのテーブルが保持します．
+        ///
+        /// \return 読み込みに成功し，記録された誤差が許容値以内なら true
+        bool Load(std::shared_ptr<PrecomputeCache const> const &cache, float max_error = kDefaultMaxError);
+
+        /// \brief キャッシュにテーブルを追加します．
+        ///
+        /// \return テーブルが構築済みの場合 true
+        bool Store(PrecomputeCacheWriter &writer) const;
+
+        /// \brief テーブルが使用可能か調べます．
+        bool IsAvailable() const { return available_; }
+
+        /// \brief 構築時に計測された横方向誤差の最大値[m]
+        float GetMaxError() const { return max_error_; }
+
+        /// \brief ずれ角を補間で求めます．
+        ///
+        /// \return テーブルの範囲外の場合 std::nullopt
+        std::optional<float> LookupDeltaAngle(float v0_speed, float target_speed, dc::moves::Shot::Rotation rotation) const;
+
+    private:
+        bool Validate(float max_error, unsigned thread_count);
+        std::optional<float> Interpolate(float v0_speed, float target_speed, dc::moves::Shot::Rotation rotation) const;
+        float const *GetDeltaAngles(size_t rotation_index) const;
+
+        bool available_ = false;
+        float max_error_ = 0.f;
+        std::array<std::vector<float>, 2> delta_angles_; ///< Build() で構築した値．[回転方向][初速インデックス * kTargetSpeedCount + 目標速度インデックス]．範囲外は NaN
+        std::shared_ptr<PrecomputeCache const> cache_;   ///< Load() で読み込んだキャッシュ．nullptr でない場合は delta_angles_ の代わりに参照する
+        std::array<float const *, 2> cached_delta_angles_{}; ///< cache_ 内の値．並びは delta_angles_ と同じ
+    };
+
+    /// \brief シミュレータFCV1において，指定地点を指定速度で通過するショットの初速を逆算します．
+    ///
+    /// 使用上の注意：
+    /// - この関数はシミュレータFCV1に特化した関数です．他のシミュレータには対応していません．
+    ///   したがって，この関数を使用した場合必然的にシミュレータFCV1に特化した思考エンジンになります．
+    ///  （余談：複数のシミュレータに対応したショット速度を逆算する関数をライブラリから提供しさえすれば，
+    ///   その関数を使用することで思考エンジンが特定のシミュレータに特化するといったことは無くなります．
+    ///   ただ，今後どのようなシミュレータを追加するか現状では何とも言えなく，
+    ///   どのようにショット速度を逆算すべきかも何とも言えないので，現状そのような関数はライブラリでは提供していません）
+    /// - \p table が使用可能な場合，発射方向はテーブルから補間で求めます．
+    ///   そうでない場合は関数内でシミュレータFCV1を使用して1ショット分シミュレーションを行うため，実行は高速とは言えません．
+    /// - この関数は解析的にもとめたものでなく，シミュレーション結果から回帰分析で求めた関数です．したがって，特に飛距離にはある程度誤差が存在します．
+    ///
+    /// \param target_position 目標地点
+    ///
+    /// \param target_speed 目標地点到達時の速度．
+    ///     0 にすればドローショット(石を停止させるショット)，0 より大きくすればヒットショット(石を他の石にぶつけるショット)になる．
+    ///
+    /// \param rotation ショットの回転方向
+    ///
+    /// \param table ずれ角のテーブル．nullptr の場合は常にシミュレーションを行う．
+    ///
+    /// \return 推測されたストーンの初速ベクトル
+    dc::Vector2 EstimateShotVelocityFCV1(
+        dc::Vector2 const &target_position,
+        float target_speed,
+        dc::moves::Shot::Rotation rotation,
+        VelocityTable const *table = nullptr);
+
+    /// \brief SolveShotVelocityFCV1() の精度の段階
+    enum class ShotPrecision
+    {
+        kSearch, ///< 探索中に何度も求めるショット用．許容値を緩め，試行回数を抑える
+        kFinal,  ///< 実際に投げるショット用
+    };
+
+    /// \brief SolveShotVelocityFCV1() の収束条件
+    struct ShotSolverOptions
+    {
+        float tolerance;         ///< 目標地点からのずれの許容値[m]
+        unsigned max_iterations; ///< シミュレーション回数の上限
+    };
+
+    /// \brief 精度の段階に対応する収束条件を返します．
+    ShotSolverOptions GetShotSolverOptions(ShotPrecision precision);
+
+    /// \brief SolveShotVelocityFCV1() の結果
+    struct ShotSolution
+    {
+        dc::Vector2 velocity; ///< 初速ベクトル
+        float error;          ///< 最良の試行での目標地点からのずれ[m]
+        unsigned iterations;  ///< 行ったシミュレーションの回数
+        bool converged;       ///< ずれが許容値以内に収まったか
+    };
+
+    /// \brief シミュレータFCV1において，指定地点を指定速度で通過するショットの初速を反復により求めます．
+    ///
+    /// EstimateShotSpeedFCV1() の回帰式と \p table のずれ角を初期値とし，目標速度まで減速した地点(ドローの場合は停止地点)で打ち切る
+    /// 短いシミュレーションを繰り返して初速を修正します．FCV1 のストーンの軌跡は発射方向の回転に対してほぼ不変なので，
+    /// 発射方向は到達地点の角度のずれだけ回し，初速の大きさは到達距離の誤差に対してセカント法で修正します．
+    /// 浮動小数点の丸めにより到達距離は発射方向によって数mm変わるため，シミュレーションは毎回実際の発射方向で行います．
+    ///
+    /// 通常2〜4回で収束します．収束しなかった場合は，最もずれの小さかった試行の初速を返します．
+    ///
+    /// \param target_position 目標地点
+    ///
+    /// \param target_speed 目標地点到達時の速度．0 の場合はドローショットになる．
+    ///
+    /// \param rotation ショットの回転方向
+    ///
+    /// \param options 収束条件
+    ///
+    /// \param table 発射方向の初期値に使用するずれ角のテーブル．nullptr の場合は1回目の試行を方向の推定に使う．
+    ///
+    /// \param simulator 試行に使用する FCV1 シミュレータ．ストーンの配置は上書きされる．nullptr の場合は呼出し元スレッド専用のシミュレータを使用する．
+    ShotSolution SolveShotVelocityFCV1(
+        dc::Vector2 const &target_position,
+        float target_speed,
+        dc::moves::Shot::Rotation rotation,
+        ShotSolverOptions const &options,
+        VelocityTable const *table = nullptr,
+        dc::ISimulator *simulator = nullptr);
+
+    /// \brief 精度の段階を指定して SolveShotVelocityFCV1() を呼び出します．
+    inline ShotSolution SolveShotVelocityFCV1(
+        dc::Vector2 const &target_position,
+        float target_speed,
+        dc::moves::Shot::Rotation rotation,
+        ShotPrecision precision,
+        VelocityTable const *table = nullptr,
+        dc::ISimulator *simulator = nullptr)
+    {
+        return SolveShotVelocityFCV1(target_position, target_speed, rotation, GetShotSolverOptions(precision), table, simulator);
+    }
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_SHOT_VELOCITY_HPP
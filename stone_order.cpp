@@ -0,0 +1,165 @@
+#include "stone_order.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        constexpr size_t kStoneCount = StoneOrder::kStoneCount;
+        constexpr size_t kStonesPerTeam = kStoneCount / 2;
+        constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+        /// \brief Batcher の奇偶マージソートのネットワークの比較器の数(16入力)
+        constexpr size_t kComparatorCount = 63;
+
+        using Comparator = std::pair<std::uint8_t, std::uint8_t>;
+
+        /// \brief Batcher の奇偶マージソートのネットワークの比較器を順に \p output に渡す．
+        template <class Output>
+        constexpr void ForEachComparator(Output &&output)
+        {
+            for (size_t p = 1; p < kStoneCount; p <<= 1)
+            {
+                for (size_t k = p; k >= 1; k >>= 1)
+                {
+                    for (size_t j = k % p; j + k < kStoneCount; j += 2 * k)
+                    {
+                        for (size_t i = 0; i < k && i + j + k < kStoneCount; ++i)
+                        {
+                            if ((i + j) / (2 * p) == (i + j + k) / (2 * p))
+                                output(i + j, i + j + k);
+                        }
+                    }
+                }
+            }
+        }
+
+        constexpr size_t CountComparators()
+        {
+            size_t count = 0;
+            ForEachComparator([&count](size_t, size_t) { ++count; });
+            return count;
+        }
+
+        static_assert(CountComparators() == kComparatorCount);
+
+        /// \brief ソーティングネットワークをコンパイル時に生成する．
+        constexpr std::array<Comparator, kComparatorCount> MakeSortingNetwork()
+        {
+            std::array<Comparator, kComparatorCount> network{};
+            size_t count = 0;
+            ForEachComparator([&](size_t a, size_t b)
+            {
+                network[count].first = static_cast<std::uint8_t>(a);
+                network[count].second = static_cast<std::uint8_t>(b);
+                ++count;
+            });
+            return network;
+        }
+
+        constexpr auto kSortingNetwork = MakeSortingNetwork();
+
+        /// \brief 非負の float のビット列は大小関係を保つので，整数として比較できる．
+        std::uint32_t ToOrderedBits(float value)
+        {
+            std::uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        std::uint64_t MakeKey(size_t index, float squared_distance)
+        {
+            return static_cast<std::uint64_t>(ToOrderedBits(squared_distance)) << 32 | index;
+        }
+
+        /// \brief 盤面 \p board のストーン \p index のキー．存在しないストーンは距離を無限大とする
+        std::uint64_t MakeKey(BoardSnapshot const &board, size_t index)
+        {
+            return MakeKey(index, board.HasStone(index)
+                ? GetSquaredDistanceFromTee(dc::Vector2(board.stones[index].x, board.stones[index].y)) : kInfinity);
+        }
+
+    } // unnamed namespace
+
+    void StoneOrder::Build(BoardSnapshot const &board)
+    {
+        for (size_t i = 0; i < kStoneCount; ++i)
+        {
+            keys_[i] = MakeKey(board, i);
+        }
+        Sort();
+    }
+
+    void StoneOrder::Build(dc::GameState::Stones const &stones)
+    {
+        for (size_t team = 0; team < 2; ++team)
+        {
+            for (size_t i = 0; i < kStonesPerTeam; ++i)
+            {
+                auto const &stone = stones[team][i];
+                size_t const index = team * kStonesPerTeam + i;
+                keys_[index] = MakeKey(index, stone ? GetSquaredDistanceFromTee(stone->position) : kInfinity);
+            }
+        }
+        Sort();
+    }
+
+    void StoneOrder::Update(BoardSnapshot const &board, std::uint16_t moved_mask)
+    {
+        // 動いていないストーンのキーは並んだまま残る
+        for (auto &key : keys_)
+        {
+            size_t const index = static_cast<size_t>(key & 0xff);
+            if ((moved_mask >> index & 1) != 0)
+            {
+                key = MakeKey(board, index);
+            }
+        }
+        Sort();
+    }
+
+    std::optional<dc::Team> StoneOrder::GetScoringTeam() const
+    {
+        if (house_count_ == 0)
+            return std::nullopt;
+        return static_cast<dc::Team>((*this)[0] / kStonesPerTeam);
+    }
+
+    void StoneOrder::Sort()
+    {
+        for (auto const &[a, b] : kSortingNetwork)
+        {
+            std::uint64_t const low = std::min(keys_[a], keys_[b]);
+            std::uint64_t const high = std::max(keys_[a], keys_[b]);
+            keys_[a] = low;
+            keys_[b] = high;
+        }
+
+        // 昇順に並んでいるので，条件を満たすキーの数がそのまま先頭からの個数になる
+        std::uint64_t const present_limit = static_cast<std::uint64_t>(ToOrderedBits(kInfinity)) << 32;
+        std::uint64_t const house_limit = (static_cast<std::uint64_t>(ToOrderedBits(kHouseSquaredDistance)) << 32) | 0xffffffffu;
+        count_ = 0;
+        house_count_ = 0;
+        for (size_t i = 0; i < kStoneCount; ++i)
+        {
+            count_ += keys_[i] < present_limit;
+            house_count_ += keys_[i] <= house_limit;
+        }
+
+        // ハウス内で相手のストーンより内側にある，ティーに最も近いストーンのチームのストーン数
+        score_ = 0;
+        if (house_count_ > 0)
+        {
+            size_t const scoring_team = (*this)[0] / kStonesPerTeam;
+            while (score_ < house_count_ && (*this)[score_] / kStonesPerTeam == scoring_team)
+                ++score_;
+        }
+    }
+
+} // namespace obsidian
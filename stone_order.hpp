@@ -0,0 +1,68 @@
+#ifndef AICY_OBSIDIAN_STONE_ORDER_HPP
+#define AICY_OBSIDIAN_STONE_ORDER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "board_snapshot.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief ストーンをティーからの距離順に並べた索引です．
+    ///
+    /// 距離の2乗をストーンごとに一度だけ計算し，(距離の2乗, インデックス) を64bitのキーにまとめて
+    /// 16要素のソーティングネットワークで並べます．比較は分岐の無い min / max だけで行います．
+    /// ショット後の盤面は Update() で動いたストーンのキーだけを計算し直して並べ直せます．
+    ///
+    /// インデックスは ISimulator::AllStones と同じ(チーム * 8 + チーム内の番号)です．
+    class StoneOrder
+    {
+    public:
+        static constexpr size_t kStoneCount = dc::ISimulator::kStoneMax;
+
+        /// \brief 盤面から索引を作成します．
+        void Build(BoardSnapshot const &board);
+
+        /// \brief 盤面から索引を作成します．
+        void Build(dc::GameState::Stones const &stones);
+
+        /// \brief \p moved_mask のビットが立っているストーンのキーだけを計算し直して並べ直します．
+        ///
+        /// \param board 動いた後の盤面．ビットの立っていないストーンは前回の Build() または Update() から動いていない必要がある．
+        ///
+        /// \param moved_mask 動いた(または除外された，追加された)ストーンのビットマスク
+        void Update(BoardSnapshot const &board, std::uint16_t moved_mask);
+
+        /// \brief 盤面上にあるストーンの数
+        size_t GetCount() const { return count_; }
+
+        /// \brief ティーに \p rank 番目に近いストーンのインデックス．\p rank が GetCount() 以上の場合は盤面上に無いストーン
+        size_t operator[](size_t rank) const { return static_cast<size_t>(keys_[rank] & 0xff); }
+
+        /// \brief ハウス内(IsInHouse() と同じ判定)にあるストーンの数
+        size_t GetHouseCount() const { return house_count_; }
+
+        /// \brief その時点でエンドが終わった場合に得点するチーム．ハウス内にストーンが無い場合は std::nullopt
+        std::optional<dc::Team> GetScoringTeam() const;
+
+        /// \brief その時点でエンドが終わった場合の得点(得点するチームのストーン数)
+        size_t GetScore() const { return score_; }
+
+    private:
+        /// \brief keys_ を並べ，ストーン数と得点を数え直す．
+        void Sort();
+
+        std::array<std::uint64_t, kStoneCount> keys_{}; ///< 上位32bitが距離の2乗のビット列，下位8bitがインデックス．昇順．存在しないストーンは距離が無限大
+        size_t count_ = 0;
+        size_t house_count_ = 0;
+        size_t score_ = 0;
+    };
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_STONE_ORDER_HPP
@@ -0,0 +1,88 @@
+#include "telemetry.hpp"
+
+namespace obsidian
+{
+
+    char const *ToString(TelemetryCounter counter)
+    {
+        switch (counter)
+        {
+        case TelemetryCounter::kVelocityEstimate:
+            return "estimate";
+        case TelemetryCounter::kVelocitySolve:
+            return "solve";
+        case TelemetryCounter::kRollout:
+            return "rollout";
+        case TelemetryCounter::kApplyMove:
+            return "apply_move";
+        case TelemetryCounter::kSimulatorStep:
+            return "step";
+        case TelemetryCounter::kSimulatorLoad:
+            return "load";
+        case TelemetryCounter::kSimulatorSave:
+            return "save";
+        case TelemetryCounter::kCacheHit:
+            return "cache_hit";
+        case TelemetryCounter::kCacheMiss:
+            return "cache_miss";
+        default:
+            return "unknown";
+        }
+    }
+
+    char const *ToString(TelemetryPhase phase)
+    {
+        switch (phase)
+        {
+        case TelemetryPhase::kLookahead:
+            return "lookahead";
+        case TelemetryPhase::kSearch:
+            return "search";
+        case TelemetryPhase::kRefine:
+            return "refine";
+        default:
+            return "unknown";
+        }
+    }
+
+    TelemetryCounters &TelemetryCounters::operator+=(TelemetryCounters const &other)
+    {
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            counts[i] += other.counts[i];
+        }
+        for (size_t i = 0; i < phase_times.size(); ++i)
+        {
+            phase_times[i] += other.phase_times[i];
+        }
+        return *this;
+    }
+
+    TelemetryCounters &TelemetryCounters::operator-=(TelemetryCounters const &other)
+    {
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            counts[i] -= other.counts[i];
+        }
+        for (size_t i = 0; i < phase_times.size(); ++i)
+        {
+            phase_times[i] -= other.phase_times[i];
+        }
+        return *this;
+    }
+
+    std::ostream &operator<<(std::ostream &os, TelemetryCounters const &telemetry)
+    {
+        for (size_t i = 0; i < telemetry.counts.size(); ++i)
+        {
+            os << (i == 0 ? "" : ", ") << ToString(static_cast<TelemetryCounter>(i)) << ' ' << telemetry.counts[i];
+        }
+        for (size_t i = 0; i < telemetry.phase_times.size(); ++i)
+        {
+            os << ", " << ToString(static_cast<TelemetryPhase>(i)) << ' '
+                << std::chrono::duration<double, std::milli>(telemetry.phase_times[i]).count() << " ms";
+        }
+        return os;
+    }
+
+} // namespace obsidian
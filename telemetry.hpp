@@ -0,0 +1,125 @@
+#ifndef AICY_OBSIDIAN_TELEMETRY_HPP
+#define AICY_OBSIDIAN_TELEMETRY_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace obsidian
+{
+
+    /// \brief 回数を数える処理
+    enum class TelemetryCounter : std::uint8_t
+    {
+        kVelocityEstimate, ///< EstimateShotVelocityFCV1() の呼出し
+        kVelocitySolve,    ///< SolveShotVelocityFCV1() の呼出し
+        kRollout,          ///< RunEarlyExitRollout() によるロールアウト
+        kApplyMove,        ///< ApplyMove() によるロールアウト
+        kSimulatorStep,    ///< ロールアウトと初速の逆算での ISimulator::Step() (ApplyMove() の内部は含まない)
+        kSimulatorLoad,    ///< ISimulator::Load()
+        kSimulatorSave,    ///< ISimulator::Save()
+        kCacheHit,         ///< 置換表のヒット
+        kCacheMiss,        ///< 置換表のミス
+        kCount,
+    };
+
+    /// \brief 時間を計る OnMyTurn() の段階
+    enum class TelemetryPhase : std::uint8_t
+    {
+        kLookahead, ///< LookaheadSearch::Run()
+        kSearch,    ///< 探索が足りない場合の SearchShot()
+        kRefine,    ///< 採用したショットの初速の精密化
+        kCount,
+    };
+
+    constexpr size_t kTelemetryCounterCount = static_cast<size_t>(TelemetryCounter::kCount);
+    constexpr size_t kTelemetryPhaseCount = static_cast<size_t>(TelemetryPhase::kCount);
+
+    char const *ToString(TelemetryCounter counter);
+    char const *ToString(TelemetryPhase phase);
+
+    /// \brief カウンタと各段階の時間の集計です．
+    ///
+    /// 1つの集計は同時に1スレッドからしか更新しません(ワーカーごと，思考スレッドごとに持ちます)．
+    /// 合算は更新しているスレッドが無いときに行います．
+    struct TelemetryCounters
+    {
+        std::array<std::uint64_t, kTelemetryCounterCount> counts{};
+        std::array<std::chrono::nanoseconds, kTelemetryPhaseCount> phase_times{};
+
+        std::uint64_t &operator[](TelemetryCounter counter) { return counts[static_cast<size_t>(counter)]; }
+        std::uint64_t operator[](TelemetryCounter counter) const { return counts[static_cast<size_t>(counter)]; }
+
+        TelemetryCounters &operator+=(TelemetryCounters const &other);
+        TelemetryCounters &operator-=(TelemetryCounters const &other);
+    };
+
+    inline TelemetryCounters operator+(TelemetryCounters a, TelemetryCounters const &b) { return a += b; }
+    inline TelemetryCounters operator-(TelemetryCounters a, TelemetryCounters const &b) { return a -= b; }
+
+    /// \brief "name N, ..." の形式で1行に書き込みます(改行は含みません)．
+    std::ostream &operator<<(std::ostream &os, TelemetryCounters const &telemetry);
+
+    namespace detail
+    {
+        /// \brief このスレッドの集計先．TelemetryScope の外では nullptr
+        inline thread_local TelemetryCounters *current_telemetry = nullptr;
+    } // namespace detail
+
+    /// \brief スコープの間，このスレッドの集計先を \p counters にします．
+    ///
+    /// スコープは入れ子にでき，抜けると元の集計先に戻ります．
+    class TelemetryScope
+    {
+    public:
+        explicit TelemetryScope(TelemetryCounters &counters)
+            : previous_(detail::current_telemetry)
+        {
+            detail::current_telemetry = &counters;
+        }
+        TelemetryScope(TelemetryScope const &) = delete;
+        TelemetryScope &operator=(TelemetryScope const &) = delete;
+        ~TelemetryScope() { detail::current_telemetry = previous_; }
+
+    private:
+        TelemetryCounters *previous_;
+    };
+
+    /// \brief このスレッドの集計先のカウンタに \p n を加えます．集計先が無い場合は何もしません．
+    inline void CountTelemetry(TelemetryCounter counter, std::uint64_t n = 1)
+    {
+        if (auto *const counters = detail::current_telemetry)
+        {
+            (*counters)[counter] += n;
+        }
+    }
+
+    /// \brief スコープの間の経過時間を，このスレッドの集計先の \p phase に加えます．
+    class TelemetryPhaseTimer
+    {
+    public:
+        explicit TelemetryPhaseTimer(TelemetryPhase phase)
+            : phase_(phase)
+            , start_(std::chrono::steady_clock::now())
+        {
+        }
+        TelemetryPhaseTimer(TelemetryPhaseTimer const &) = delete;
+        TelemetryPhaseTimer &operator=(TelemetryPhaseTimer const &) = delete;
+        ~TelemetryPhaseTimer()
+        {
+            if (auto *const counters = detail::current_telemetry)
+            {
+                counters->phase_times[static_cast<size_t>(phase_)] += std::chrono::steady_clock::now() - start_;
+            }
+        }
+
+    private:
+        TelemetryPhase phase_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_TELEMETRY_HPP
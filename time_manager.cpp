@@ -0,0 +1,66 @@
+#include "time_manager.hpp"
+
+#include <algorithm>
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        /// \brief エンド内のショット番号に対する思考時間の重み
+        float GetShotWeight(int shot)
+        {
+            return 1.f + static_cast<float>(shot) / 8.f;
+        }
+
+    } // unnamed namespace
+
+    void TimeManager::StartTurn(dc::GameSetting const &game_setting, dc::GameState const &game_state, dc::Team team)
+    {
+        start_ = Clock::now();
+
+        auto const remaining = game_state.thinking_time_remaining[static_cast<size_t>(team)];
+
+        // このエンドの残りの自チームのショット (現在のショットを含む)
+        float current_end_weight = 0.f;
+        int shot_count = 0;
+        for (int shot = game_state.shot; shot < dc::GameState::kShotPerEnd; shot += 2)
+        {
+            current_end_weight += GetShotWeight(shot);
+            ++shot_count;
+        }
+
+        // 以降のエンドのショット．延長エンドでは思考時間がエンドごとに与え直されるので数えない．
+        float total_weight = current_end_weight;
+        if (game_state.end + 1 < game_setting.max_end)
+        {
+            float end_weight = 0.f;
+            for (int shot = 0; shot < dc::GameState::kShotPerEnd / 2; ++shot)
+            {
+                end_weight += GetShotWeight(shot * 2);
+            }
+            int const remaining_end_count = game_setting.max_end - game_state.end - 1;
+            total_weight += end_weight * remaining_end_count;
+            shot_count += remaining_end_count * dc::GameState::kShotPerEnd / 2;
+        }
+
+        auto const distributable = remaining - safety_margin_ * shot_count;
+        if (distributable <= std::chrono::milliseconds(0))
+        {
+            budget_ = std::chrono::milliseconds(0);
+            return;
+        }
+
+        budget_ = std::chrono::milliseconds(static_cast<std::chrono::milliseconds::rep>(
+            distributable.count() * GetShotWeight(game_state.shot) / total_weight));
+        budget_ = std::min(budget_, remaining - safety_margin_);
+    }
+
+    std::chrono::milliseconds TimeManager::GetRemaining() const
+    {
+        auto const remaining = std::chrono::duration_cast<std::chrono::milliseconds>(GetDeadline() - Clock::now());
+        return std::max(remaining, std::chrono::milliseconds(0));
+    }
+
+} // namespace obsidian
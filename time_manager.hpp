@@ -0,0 +1,65 @@
+#ifndef AICY_OBSIDIAN_TIME_MANAGER_HPP
+#define AICY_OBSIDIAN_TIME_MANAGER_HPP
+
+#include <chrono>
+#include "digitalcurling3/digitalcurling3.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief 残り思考時間を自チームの残りショットに配分し，1ターンの締切を管理します．
+    ///
+    /// 配分はエンドの後半のショットほど重くします(ハンマーを含む終盤のショットほど結果への影響が大きいため)．
+    /// 残りショットそれぞれについてネットワーク遅延等に備えた余裕時間を差し引いてから配分するので，
+    /// 締切を守っている限り時間切れで負けることはありません．
+    class TimeManager
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /// \brief 1ショットあたりの余裕時間のデフォルト値
+        static constexpr std::chrono::milliseconds kDefaultSafetyMargin{300};
+
+        explicit TimeManager(std::chrono::milliseconds safety_margin = kDefaultSafetyMargin)
+            : safety_margin_(safety_margin)
+        {
+        }
+
+        /// \brief ターンの開始時に呼び，このターンの思考時間を決定します．
+        ///
+        /// \param game_setting 試合設定
+        ///
+        /// \param game_state 現在の試合状況
+        ///
+        /// \param team 自チーム
+        void StartTurn(dc::GameSetting const &game_setting, dc::GameState const &game_state, dc::Team team);
+
+        /// \brief このターンに割り当てた思考時間
+        std::chrono::milliseconds GetBudget() const { return budget_; }
+
+        /// \brief このターンの締切
+        Clock::time_point GetDeadline() const { return start_ + budget_; }
+
+        /// \brief ターン開始からの経過時間
+        std::chrono::milliseconds GetElapsed() const
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start_);
+        }
+
+        /// \brief 締切までの残り時間(締切を過ぎた場合は 0)
+        std::chrono::milliseconds GetRemaining() const;
+
+        /// \brief 締切を過ぎたか調べます．
+        bool IsTimeUp() const { return Clock::now() >= GetDeadline(); }
+
+    private:
+        std::chrono::milliseconds safety_margin_;
+        Clock::time_point start_;
+        std::chrono::milliseconds budget_{0};
+    };
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_TIME_MANAGER_HPP
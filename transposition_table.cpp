@@ -0,0 +1,173 @@
+#include "transposition_table.hpp"
+
+#include <cmath>
+#include <cstring>
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        /// \brief splitmix64 の混合関数
+        std::uint64_t Mix(std::uint64_t value)
+        {
+            value += 0x9e3779b97f4a7c15ull;
+            value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+            value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+            return value ^ (value >> 31);
+        }
+
+        std::uint32_t Quantize(float value, float quantum)
+        {
+            return static_cast<std::uint32_t>(static_cast<std::int32_t>(std::lround(value / quantum)));
+        }
+
+        /// \brief 2つの32bit値と種別から1要素分のハッシュを作る．
+        std::uint64_t HashElement(std::uint64_t kind, std::uint32_t a, std::uint32_t b)
+        {
+            return Mix(Mix(kind) ^ (static_cast<std::uint64_t>(a) << 32 | b));
+        }
+
+        std::uint32_t ToBits(float value)
+        {
+            std::uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        float FromBits(std::uint32_t bits)
+        {
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        /// \brief 0 は空きエントリを表すので使用しない．
+        std::uint64_t NonZeroKey(std::uint64_t key)
+        {
+            return key == 0 ? 1 : key;
+        }
+
+    } // unnamed namespace
+
+    TranspositionTable::TranspositionTable(unsigned entry_count_log2)
+        : mask_((size_t(1) << entry_count_log2) - 1)
+        , entries_(new Entry[mask_ + 1])
+    {
+    }
+
+    std::uint64_t TranspositionTable::ComputeStonesKey(dc::GameState::Stones const &stones)
+    {
+        std::uint64_t key = 0;
+        for (size_t team = 0; team < stones.size(); ++team)
+        {
+            for (size_t i = 0; i < stones[team].size(); ++i)
+            {
+                if (auto const &stone = stones[team][i])
+                {
+                    // ストーンの角度は円同士の衝突に影響しないのでキーに含めない
+                    std::uint64_t const slot = team * stones[team].size() + i;
+                    key ^= HashElement(slot, Quantize(stone->position.x, kPositionQuantum), Quantize(stone->position.y, kPositionQuantum));
+                }
+            }
+        }
+        return key;
+    }
+
+    std::uint64_t TranspositionTable::ComputeShotKey(dc::GameState const &game_state, dc::moves::Shot const &shot)
+    {
+        constexpr std::uint64_t kVelocityKind = kStoneCount;
+        constexpr std::uint64_t kTurnKind = kStoneCount + 1;
+        std::uint32_t const turn = static_cast<std::uint32_t>(game_state.shot) << 8 | static_cast<std::uint32_t>(game_state.GetNextTeam());
+        return HashElement(kVelocityKind, Quantize(shot.velocity.x, kVelocityQuantum), Quantize(shot.velocity.y, kVelocityQuantum))
+            ^ HashElement(kTurnKind, turn, static_cast<std::uint32_t>(shot.rotation));
+    }
+
+    std::optional<dc::GameState::Stones> TranspositionTable::Find(std::uint64_t key) const
+    {
+        key = NonZeroKey(key);
+        Entry const &entry = entries_[key & mask_];
+
+        std::uint64_t const sequence = entry.sequence.load(std::memory_order_acquire);
+        if ((sequence & 1) != 0 || entry.key.load(std::memory_order_relaxed) != key)
+        {
+            miss_count_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        std::uint32_t const exists = entry.exists.load(std::memory_order_relaxed);
+        std::array<std::uint32_t, kStoneCount * 3> values;
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            values[i] = entry.values[i].load(std::memory_order_relaxed);
+        }
+
+        // 読み出し中に書き換えられていないか確認する
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.sequence.load(std::memory_order_relaxed) != sequence)
+        {
+            miss_count_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        dc::GameState::Stones stones;
+        for (size_t team = 0; team < stones.size(); ++team)
+        {
+            for (size_t i = 0; i < stones[team].size(); ++i)
+            {
+                size_t const slot = team * stones[team].size() + i;
+                if ((exists >> slot & 1) != 0)
+                {
+                    stones[team][i].emplace(
+                        dc::Vector2(FromBits(values[slot * 3]), FromBits(values[slot * 3 + 1])),
+                        FromBits(values[slot * 3 + 2]));
+                }
+            }
+        }
+        hit_count_.fetch_add(1, std::memory_order_relaxed);
+        return stones;
+    }
+
+    void TranspositionTable::Store(std::uint64_t key, dc::GameState::Stones const &stones)
+    {
+        key = NonZeroKey(key);
+        Entry &entry = entries_[key & mask_];
+
+        std::uint64_t sequence = entry.sequence.load(std::memory_order_relaxed);
+        if ((sequence & 1) != 0 || !entry.sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire))
+            return;
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::uint32_t exists = 0;
+        for (size_t team = 0; team < stones.size(); ++team)
+        {
+            for (size_t i = 0; i < stones[team].size(); ++i)
+            {
+                size_t const slot = team * stones[team].size() + i;
+                if (auto const &stone = stones[team][i])
+                {
+                    exists |= std::uint32_t(1) << slot;
+                    entry.values[slot * 3].store(ToBits(stone->position.x), std::memory_order_relaxed);
+                    entry.values[slot * 3 + 1].store(ToBits(stone->position.y), std::memory_order_relaxed);
+                    entry.values[slot * 3 + 2].store(ToBits(stone->angle), std::memory_order_relaxed);
+                }
+            }
+        }
+        entry.exists.store(exists, std::memory_order_relaxed);
+        entry.key.store(key, std::memory_order_relaxed);
+
+        entry.sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    void TranspositionTable::Clear()
+    {
+        for (size_t i = 0; i <= mask_; ++i)
+        {
+            entries_[i].key.store(0, std::memory_order_relaxed);
+        }
+        hit_count_.store(0, std::memory_order_relaxed);
+        miss_count_.store(0, std::memory_order_relaxed);
+    }
+
+} // namespace obsidian
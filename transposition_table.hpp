@@ -0,0 +1,84 @@
+#ifndef AICY_OBSIDIAN_TRANSPOSITION_TABLE_HPP
+#define AICY_OBSIDIAN_TRANSPOSITION_TABLE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include "digitalcurling3/digitalcurling3.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief ブレの無いショットの結果を盤面とショットのハッシュで引く，固定サイズのロックフリーなハッシュ表です．
+    ///
+    /// キーはストーン位置とショットの初速を量子化した値の Zobrist 形式のハッシュ(要素ごとのハッシュの排他的論理和)です．
+    /// ブレのあるショットの結果は試行ごとに異なるので格納しないでください．
+    ///
+    /// 各エントリはシーケンスロックで保護されており，複数のスレッドから同時に Find(), Store() できます．
+    /// 同じ位置のエントリは常に上書きされ，書き込み中のエントリの読み出しはミスとして扱います．
+    class TranspositionTable
+    {
+    public:
+        /// \brief ストーン位置の量子化の単位[m]
+        static constexpr float kPositionQuantum = 0.0001f;
+
+        /// \brief ショットの初速の量子化の単位[m/s]
+        static constexpr float kVelocityQuantum = 0.0001f;
+
+        /// \param entry_count_log2 エントリ数の2を底とする対数
+        explicit TranspositionTable(unsigned entry_count_log2 = 15);
+
+        /// \brief 盤面のハッシュを計算します．
+        static std::uint64_t ComputeStonesKey(dc::GameState::Stones const &stones);
+
+        /// \brief ショットのハッシュを計算します．
+        ///
+        /// フリーガードゾーンのルールや投げるストーンが手番によって変わるので，ショット番号と手番のチームも含めます．
+        static std::uint64_t ComputeShotKey(dc::GameState const &game_state, dc::moves::Shot const &shot);
+
+        /// \brief 試合状況とショットのキーを計算します．ComputeStonesKey() と ComputeShotKey() の排他的論理和です．
+        static std::uint64_t ComputeKey(dc::GameState const &game_state, dc::moves::Shot const &shot)
+        {
+            return ComputeStonesKey(game_state.stones) ^ ComputeShotKey(game_state, shot);
+        }
+
+        /// \brief 格納されたショットの結果を探します．
+        ///
+        /// \return 見つかった場合ショット後のストーン，見つからなかった場合 std::nullopt
+        std::optional<dc::GameState::Stones> Find(std::uint64_t key) const;
+
+        /// \brief ショットの結果を格納します．他のスレッドが同じエントリに書き込み中の場合は何もしません．
+        void Store(std::uint64_t key, dc::GameState::Stones const &stones);
+
+        /// \brief 全エントリと統計を消去します．
+        void Clear();
+
+        std::uint64_t GetHitCount() const { return hit_count_.load(std::memory_order_relaxed); }
+        std::uint64_t GetMissCount() const { return miss_count_.load(std::memory_order_relaxed); }
+        size_t GetEntryCount() const { return mask_ + 1; }
+
+    private:
+        static constexpr size_t kStoneCount = dc::ISimulator::kStoneMax;
+
+        struct Entry
+        {
+            std::atomic<std::uint64_t> sequence{ 0 }; ///< 奇数の間は書き込み中
+            std::atomic<std::uint64_t> key{ 0 };      ///< 0 は空きエントリ
+            std::atomic<std::uint32_t> exists{ 0 };   ///< ストーンが存在するかのビットマスク
+            std::array<std::atomic<std::uint32_t>, kStoneCount * 3> values{}; ///< ストーンごとの x, y, 角度のビット列
+        };
+
+        size_t mask_;
+        std::unique_ptr<Entry[]> entries_;
+        mutable std::atomic<std::uint64_t> hit_count_{ 0 };
+        mutable std::atomic<std::uint64_t> miss_count_{ 0 };
+    };
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_TRANSPOSITION_TABLE_HPP
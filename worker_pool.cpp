@@ -0,0 +1,208 @@
+#include "worker_pool.hpp"
+
+#include <algorithm>
+
+namespace obsidian
+{
+
+    namespace
+    {
+
+        /// \brief ワーカー用のプレイヤーを生成する．
+        ///
+        /// 乱数のシードが固定されたプレイヤーを複製すると全ワーカーが同じブレを生成してしまうため，シードは外す．
+        std::unique_ptr<dc::IPlayer> CreateWorkerPlayer(dc::IPlayerFactory const *factory)
+        {
+            if (factory == nullptr)
+            {
+                return dc::players::PlayerNormalDistFactory().CreatePlayer();
+            }
+
+            auto clone = factory->Clone();
+            if (auto normal_dist = dynamic_cast<dc::players::PlayerNormalDistFactory *>(clone.get()))
+            {
+                normal_dist->seed.reset();
+            }
+            return clone->CreatePlayer();
+        }
+
+    } // unnamed namespace
+
+    struct ThreadPool::Batch
+    {
+        Task const *task;
+        size_t job_count;
+        std::atomic<size_t> next_job{0};
+        size_t running_threads = 0; ///< 呼出し元以外でこの呼出しのジョブを実行中のスレッド数
+        std::exception_ptr error;
+    };
+
+    ThreadPool::ThreadPool(unsigned thread_count)
+    {
+        if (thread_count == 0)
+        {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        // スレッド0は呼出し元スレッドが担当する
+        for (size_t i = 1; i < thread_count; ++i)
+        {
+            threads_.emplace_back(&ThreadPool::ThreadMain, this, i);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        start_condition_.notify_all();
+        for (auto &thread : threads_)
+        {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::Run(size_t job_count, Task const &task)
+    {
+        Batch batch;
+        batch.task = &task;
+        batch.job_count = job_count;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            batches_.push_back(&batch);
+        }
+        start_condition_.notify_all();
+
+        RunJobs(batch, 0);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        RemoveBatch(batch);
+        done_condition_.wait(lock, [&batch] { return batch.running_threads == 0; });
+
+        if (batch.error)
+        {
+            std::rethrow_exception(batch.error);
+        }
+    }
+
+    void ThreadPool::ThreadMain(size_t thread_index)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            start_condition_.wait(lock, [this] { return stopping_ || !batches_.empty(); });
+            if (stopping_)
+                return;
+
+            // 同時に複数の呼出しがある場合は，スレッドを順番に割り当てる
+            auto &batch = *batches_[next_batch_++ % batches_.size()];
+            ++batch.running_threads;
+            lock.unlock();
+
+            RunJobs(batch, thread_index);
+
+            lock.lock();
+            --batch.running_threads;
+            RemoveBatch(batch); // ジョブを取り尽くしたので，他のスレッドが割り当てられないようにする
+            done_condition_.notify_all();
+        }
+    }
+
+    void ThreadPool::RunJobs(Batch &batch, size_t thread_index)
+    {
+        for (size_t i = batch.next_job++; i < batch.job_count; i = batch.next_job++)
+        {
+            try
+            {
+                (*batch.task)(thread_index, i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!batch.error)
+                {
+                    batch.error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    void ThreadPool::RemoveBatch(Batch const &batch)
+    {
+        auto const it = std::find(batches_.begin(), batches_.end(), &batch);
+        if (it != batches_.end())
+        {
+            batches_.erase(it);
+        }
+    }
+
+    WorkerPool::WorkerPool(
+        dc::ISimulatorFactory const &simulator_factory,
+        std::array<dc::IPlayerFactory const *, 4> const &player_factories,
+        unsigned worker_count)
+        : WorkerPool(simulator_factory, player_factories, std::make_shared<ThreadPool>(worker_count))
+    {
+    }
+
+    WorkerPool::WorkerPool(
+        dc::ISimulatorFactory const &simulator_factory,
+        std::array<dc::IPlayerFactory const *, 4> const &player_factories,
+        std::shared_ptr<ThreadPool> thread_pool)
+        : thread_pool_(std::move(thread_pool))
+    {
+        for (size_t i = 0; i < thread_pool_->GetThreadCount(); ++i)
+        {
+            auto worker = std::make_unique<Worker>();
+            worker->index = i;
+            worker->simulator = simulator_factory.CreateSimulator();
+            worker->simulator_storage = worker->simulator->CreateStorage();
+            worker->simulator->Save(*worker->simulator_storage);
+            ++worker->telemetry[TelemetryCounter::kSimulatorSave];
+            for (size_t j = 0; j < worker->players.size(); ++j)
+            {
+                worker->players[j] = CreateWorkerPlayer(player_factories[j]);
+                worker->noise_models[j] = ShotNoiseModel::FromPlayerFactory(player_factories[j]);
+            }
+            worker->noiseless_player = dc::players::PlayerIdenticalFactory().CreatePlayer();
+            workers_.push_back(std::move(worker));
+        }
+    }
+
+    void WorkerPool::Run(size_t job_count, Job const &job)
+    {
+        thread_pool_->Run(job_count, [this, &job](size_t thread_index, size_t i)
+        {
+            auto &worker = *workers_[thread_index];
+            TelemetryScope telemetry_scope(worker.telemetry);
+            job(worker, i);
+        });
+    }
+
+    TelemetryCounters WorkerPool::CollectTelemetry() const
+    {
+        TelemetryCounters total;
+        for (auto const &worker : workers_)
+        {
+            total += worker->telemetry;
+        }
+        return total;
+    }
+
+    void WorkerPool::EnableSimulatorFCV1(bool enabled)
+    {
+        for (auto &worker : workers_)
+        {
+            if (enabled)
+            {
+                worker->fcv1_simulator.emplace();
+            }
+            else
+            {
+                worker->fcv1_simulator.reset();
+            }
+        }
+    }
+
+} // namespace obsidian
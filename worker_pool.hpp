@@ -0,0 +1,178 @@
+#ifndef AICY_OBSIDIAN_WORKER_POOL_HPP
+#define AICY_OBSIDIAN_WORKER_POOL_HPP
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "arena.hpp"
+#include "batch_simulator.hpp"
+#include "shot_noise.hpp"
+#include "telemetry.hpp"
+
+namespace obsidian
+{
+
+    namespace dc = digitalcurling3;
+
+    /// \brief 複数の WorkerPool で共有できるスレッドの集まりです．
+    ///
+    /// 複数のスレッドから同時に Run() を呼び出すことができ，各呼出しのジョブは空いているスレッドで分担して実行されます．
+    /// 1プロセスで複数の試合を行う場合に，試合ごとにスレッドを生成せずハードウェアのスレッド数に収めるために使用します．
+    class ThreadPool
+    {
+    public:
+        /// \brief ジョブ．引数はジョブを実行するスレッドのインデックス(呼出し元スレッドは0)とジョブのインデックス
+        using Task = std::function<void(size_t, size_t)>;
+
+        /// \brief スレッドを生成します．
+        ///
+        /// \param thread_count スレッド数(呼出し元スレッドを含む)．0 の場合はハードウェアのスレッド数
+        explicit ThreadPool(unsigned thread_count = 0);
+
+        ThreadPool(ThreadPool const &) = delete;
+        ThreadPool &operator=(ThreadPool const &) = delete;
+
+        ~ThreadPool();
+
+        /// \brief スレッド数(呼出し元スレッドを含む)
+        size_t GetThreadCount() const { return threads_.size() + 1; }
+
+        /// \brief ジョブ 0, 1, ..., job_count - 1 を実行し，すべて終わるまで待ちます．
+        ///
+        /// 呼出し元スレッドもスレッド0として実行に参加します．
+        /// ジョブが例外を送出した場合，最初の例外をこの関数から再送出します．
+        void Run(size_t job_count, Task const &task);
+
+    private:
+        struct Batch;
+
+        void ThreadMain(size_t thread_index);
+        void RunJobs(Batch &batch, size_t thread_index);
+        void RemoveBatch(Batch const &batch);
+
+        std::vector<std::thread> threads_;
+        std::mutex mutex_;
+        std::condition_variable start_condition_;
+        std::condition_variable done_condition_;
+        std::vector<Batch *> batches_; ///< ジョブが残っている可能性のある呼出し
+        size_t next_batch_ = 0;        ///< 次にスレッドを割り当てる batches_ の位置(呼出し間で順番に割り当てる)
+        bool stopping_ = false;
+    };
+
+    /// \brief 試合中ずっと生存するワーカースレッドのプールです．
+    ///
+    /// 各ワーカーは専用のシミュレータ，シミュレータのストレージ，プレイヤーを持つので，
+    /// ジョブの中ではそれらを他のワーカーと共有せずに使用できます．
+    /// スレッドは ThreadPool のものを使用し，ワーカー i は ThreadPool のスレッド i が担当します．
+    /// ThreadPool は他の WorkerPool と共有できます．
+    class WorkerPool
+    {
+    public:
+        /// \brief ワーカーごとの作業領域
+        struct Worker
+        {
+            size_t index;
+            std::unique_ptr<dc::ISimulator> simulator;
+            std::unique_ptr<dc::ISimulatorStorage> simulator_storage; ///< 生成直後の simulator の状態
+            std::array<std::unique_ptr<dc::IPlayer>, 4> players;     ///< OnInit で決定したショット順に並んだプレイヤー
+            std::unique_ptr<dc::IPlayer> noiseless_player;           ///< ブレの無いプレイヤー(相手のショットの予測などに使用する)
+            std::array<std::optional<ShotNoiseModel>, 4> noise_models; ///< players と同じ順のブレのモデル．ブレを再現できないプレイヤーは std::nullopt
+            TelemetryCounters telemetry;                             ///< このワーカーで実行したジョブの集計
+            dc::GameState scratch_game_state;                        ///< ApplyMove() 用の局面．代入で使い回してジョブごとの確保を避ける
+            std::optional<BoardSimulatorFCV1> fcv1_simulator;        ///< 仮想関数を介さない FCV1 のシミュレータ．EnableSimulatorFCV1() で有効にした場合のみ存在する
+
+            /// \brief ロールアウトに使うシミュレータを \p function に渡して呼び出します．
+            ///
+            /// fcv1_simulator が有効ならそれを，そうでなければ dc::ISimulator の simulator を渡すので，
+            /// \p function はどちらも受け取れる必要があります(引数が auto & のラムダなど)．
+            /// ApplyMove() のように dc::ISimulator が必要な処理では simulator を直接使用してください．
+            template <class Function>
+            auto VisitSimulator(Function &&function)
+            {
+                if (fcv1_simulator)
+                    return function(*fcv1_simulator);
+                return function(*simulator);
+            }
+        };
+
+        /// \brief ジョブ．引数はジョブを実行するワーカーとジョブのインデックス
+        using Job = std::function<void(Worker &, size_t)>;
+
+        /// \brief プールを生成します．
+        ///
+        /// \param simulator_factory 各ワーカーのシミュレータを生成するファクトリ
+        ///
+        /// \param player_factories ショット順に並んだプレイヤーのファクトリ．nullptr の場合は NormalDistプレイヤーを使用する．
+        ///
+        /// \param worker_count ワーカー数(呼出し元スレッドを含む)．0 の場合はハードウェアのスレッド数
+        WorkerPool(
+            dc::ISimulatorFactory const &simulator_factory,
+            std::array<dc::IPlayerFactory const *, 4> const &player_factories,
+            unsigned worker_count = 0);
+
+        /// \brief 共有のスレッドを使用するプールを生成します．
+        ///
+        /// \param simulator_factory 各ワーカーのシミュレータを生成するファクトリ
+        ///
+        /// \param player_factories ショット順に並んだプレイヤーのファクトリ．nullptr の場合は NormalDistプレイヤーを使用する．
+        ///
+        /// \param thread_pool 使用するスレッド．ワーカー数はこのスレッド数になる．
+        WorkerPool(
+            dc::ISimulatorFactory const &simulator_factory,
+            std::array<dc::IPlayerFactory const *, 4> const &player_factories,
+            std::shared_ptr<ThreadPool> thread_pool);
+
+        WorkerPool(WorkerPool const &) = delete;
+        WorkerPool &operator=(WorkerPool const &) = delete;
+
+        /// \brief ワーカー数(呼出し元スレッドを含む)
+        size_t GetWorkerCount() const { return workers_.size(); }
+
+        /// \brief ジョブ 0, 1, ..., job_count - 1 を全ワーカーで分担して実行し，すべて終わるまで待ちます．
+        ///
+        /// 呼出し元スレッドもワーカー0として実行に参加します．複数スレッドから同時に呼び出すことはできません．
+        /// ジョブが例外を送出した場合，最初の例外をこの関数から再送出します．
+        void Run(size_t job_count, Job const &job);
+
+        /// \brief ショット順 \p player のプレイヤーのブレのモデル(全ワーカーで同じ)．ブレを再現できないプレイヤーは std::nullopt
+        std::optional<ShotNoiseModel> const &GetNoiseModel(size_t player) const { return workers_.front()->noise_models[player]; }
+
+        /// \brief 全ワーカーの集計を合算します．Run() の実行中に呼び出してはいけません．
+        TelemetryCounters CollectTelemetry() const;
+
+        /// \brief Run() を呼び出すスレッドの探索の作業領域です．
+        ///
+        /// バッチのジョブの一覧など，Run() の前後で組み立てて破棄するデータに使用します．
+        /// ジョブ自体はワーカーのシミュレータと固定長の盤面だけで動くので，ワーカーごとの作業領域は持ちません．
+        /// Run() を呼び出すスレッドからのみ使用できます．
+        Arena &GetCallerArena() { return caller_arena_; }
+
+        /// \brief ロールアウトで BoardSimulatorFCV1 を使用するか設定します．Run() の実行中に呼び出してはいけません．
+        ///
+        /// 試合のシミュレータが FCV1 で，ValidateBatchSimulatorFCV1() で一致を確認できた場合にのみ有効にしてください．
+        void EnableSimulatorFCV1(bool enabled);
+
+        /// \brief GetCallerArena() の作業領域を空にします．Run() の実行中や，作業領域から確保したデータが残っている間に呼び出してはいけません．
+        ///
+        /// \return 前回の呼出しからの作業領域の使用量の最大値[byte]
+        size_t ResetCallerArena() { return caller_arena_.Reset(); }
+
+    private:
+        std::shared_ptr<ThreadPool> thread_pool_;
+        std::vector<std::unique_ptr<Worker>> workers_;
+        Arena caller_arena_;
+    };
+
+} // namespace obsidian
+
+#endif // AICY_OBSIDIAN_WORKER_POOL_HPP